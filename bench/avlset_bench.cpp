@@ -0,0 +1,1091 @@
+// MIT License
+// Copyright (c) 2025 blackcow9622
+// Licensed under the MIT License. See LICENSE file in the project root for
+// details.
+//
+// AvlSet 벤치마크 모음
+// 사용법: avlset_bench [시나리오 이름 ...]  (인자가 없으면 전체 실행)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/AVLSet.cpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ElapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+// 0..n-1 을 섞은 키 배열
+std::vector<int> ShuffledKeys(int n, unsigned seed = 12345) {
+  std::vector<int> keys(n);
+  for (int i = 0; i < n; ++i) {
+    keys[i] = i;
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(seed));
+  return keys;
+}
+
+// 전체 로그 재생 vs 스냅샷 + 꼬리 로그 재생
+void BenchRecovery() {
+  const int n = 1000000;
+  const double snapshot_at = 0.9; // 90% 지점에서 체크포인트
+  const char *snapshot = "bench_recovery.snap";
+  const char *tail_log = "bench_recovery_tail.log";
+  const char *full_log = "bench_recovery_full.log";
+  remove(snapshot);
+  std::vector<int> keys = ShuffledKeys(n);
+
+  {
+    AvlSetLog tail(1024), full(1024);
+    tail.Open(tail_log, 0);
+    full.Open(full_log, 0);
+    AvlSet with_checkpoint, without_checkpoint;
+    with_checkpoint.AttachLog(&tail);
+    without_checkpoint.AttachLog(&full);
+    for (int i = 0; i < n; ++i) {
+      if (i == (int)(n * snapshot_at)) {
+        with_checkpoint.Checkpoint(snapshot);
+      }
+      with_checkpoint.InsertKey(keys[i]);
+      without_checkpoint.InsertKey(keys[i]);
+    }
+  }
+
+  Clock::time_point start = Clock::now();
+  {
+    AvlSet set;
+    set.Recover("bench_recovery_missing.snap", full_log);
+  }
+  double full_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  {
+    AvlSet set;
+    set.Recover(snapshot, tail_log);
+  }
+  double tail_ms = ElapsedMs(start);
+
+  printf("recovery  n=%d  full replay %.1f ms  snapshot+tail %.1f ms  "
+         "(x%.1f)\n",
+         n, full_ms, tail_ms, full_ms / tail_ms);
+
+  remove(snapshot);
+  remove(tail_log);
+  remove(full_log);
+}
+
+// 군집된 64비트 키: AvlBlockSet 과 AvlSet 의 키당 메모리와 전체 순회 시간
+void BenchBlockSet() {
+  const int n = 1000000;
+  const int64_t base = 1700000000000000000LL;
+  std::mt19937_64 rng(99);
+  std::vector<int64_t> keys(n);
+  int64_t t = base;
+  for (int i = 0; i < n; ++i) {
+    t += 1 + (int64_t)(rng() % 2000); // 증가하는 타임스탬프
+    keys[i] = t;
+  }
+  std::shuffle(keys.begin(), keys.end(), rng);
+
+  AvlBlockSet blocks;
+  AvlSet set; // 비교용: 하위 32비트만 저장
+  for (int64_t key : keys) {
+    blocks.Insert(key);
+    set.InsertKey((int)(key - base));
+  }
+
+  Clock::time_point start = Clock::now();
+  int64_t sum = 0;
+  blocks.ForEach([&](int64_t key) { sum += key - base; });
+  double block_scan_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  int64_t sum2 = 0;
+  AvlSet::Node *cur = set.root_;
+  while (cur && cur->left) {
+    cur = cur->left;
+  }
+  while (cur) {
+    sum2 += cur->key;
+    if (cur->right) {
+      cur = cur->right;
+      while (cur->left) {
+        cur = cur->left;
+      }
+    } else {
+      AvlSet::Node *child = cur;
+      cur = cur->parent;
+      while (cur && cur->right == child) {
+        child = cur;
+        cur = cur->parent;
+      }
+    }
+  }
+  double set_scan_ms = ElapsedMs(start);
+
+  printf("blockset  n=%d  bytes/key %.2f vs %.2f  scan %.2f ms vs %.2f ms "
+         "(diff %lld)\n",
+         n, (double)blocks.MemoryBytes() / n, (double)sizeof(AvlSet::Node),
+         block_scan_ms, set_scan_ms, (long long)(sum - sum2));
+}
+
+// 같은 명령열을 엔진별로 실행한 시간 (ns/op)
+template <typename Set>
+void RunEngine(const char *name, const std::vector<int> &keys,
+               const std::vector<int> &probes) {
+  Set set;
+  long long check = 0;
+  Clock::time_point start = Clock::now();
+  for (int key : keys) {
+    check += set.Execute(kOpInsert, key).v[0];
+  }
+  double insert_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  for (int key : probes) {
+    check += set.Execute(kOpFind, key).v[0];
+  }
+  double find_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  for (int key : probes) {
+    check += set.Execute(kOpRank, key).count;
+  }
+  double rank_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  for (int key : probes) {
+    check += set.Execute(kOpUpperBound, key).count;
+  }
+  double upper_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  for (int key : keys) {
+    check += set.Execute(kOpErase, key).v[0];
+  }
+  double erase_ms = ElapsedMs(start);
+
+  double n = (double)keys.size(), q = (double)probes.size();
+  printf("engines   %-6s insert %6.1f  find %6.1f  rank %6.1f  upper %6.1f  "
+         "erase %6.1f ns/op  (check %lld)\n",
+         name, insert_ms * 1e6 / n, find_ms * 1e6 / q, rank_ms * 1e6 / q,
+         upper_ms * 1e6 / q, erase_ms * 1e6 / n, check % 1000);
+}
+
+// AVL 엔진과 B+ 트리 엔진 비교
+void BenchEngines() {
+  const int n = 1000000;
+  std::vector<int> keys = ShuffledKeys(n);
+  std::vector<int> probes = ShuffledKeys(n, 777); // 모두 존재하는 키
+  RunEngine<AvlSet>("avl", keys, probes);
+  RunEngine<BPlusSet>("bptree", keys, probes);
+}
+
+// 구간 합: AvlAggSet::Aggregate vs 구간 내 노드 순회
+void BenchAggregate() {
+  const int n = 1000000, queries = 100;
+  std::vector<int> keys = ShuffledKeys(n);
+  AvlAggSet<AvlSumMonoid> sums;
+  for (int key : keys) {
+    sums.InsertKey(key);
+  }
+
+  std::mt19937 rng(5);
+  std::vector<std::pair<int, int>> ranges(queries);
+  for (auto &range : ranges) {
+    int lo = (int)(rng() % n), len = (int)(rng() % (n / 10));
+    range = std::make_pair(lo, lo + len);
+  }
+
+  Clock::time_point start = Clock::now();
+  long long agg_total = 0;
+  for (const auto &range : ranges) {
+    agg_total += sums.Aggregate(range.first, range.second);
+  }
+  double agg_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  long long scan_total = 0;
+  for (const auto &range : ranges) {
+    // UpperBound(lo - 1) 부터 hi 까지 후임자를 따라가며 더한다
+    AvlSet::Node *cur = nullptr;
+    for (AvlSet::Node *t = sums.root_; t;) {
+      if (t->key >= range.first) {
+        cur = t;
+        t = t->left;
+      } else {
+        t = t->right;
+      }
+    }
+    while (cur && cur->key <= range.second) {
+      scan_total += cur->key;
+      if (cur->right) {
+        cur = cur->right;
+        while (cur->left) {
+          cur = cur->left;
+        }
+      } else {
+        AvlSet::Node *child = cur;
+        cur = cur->parent;
+        while (cur && cur->right == child) {
+          child = cur;
+          cur = cur->parent;
+        }
+      }
+    }
+  }
+  double scan_ms = ElapsedMs(start);
+
+  printf("aggregate n=%d  %d range sums: augmented %.2f ms  scan %.1f ms  "
+         "(diff %lld)\n",
+         n, queries, agg_ms, scan_ms, agg_total - scan_total);
+}
+
+// 핑거 탐색: 정렬/거의 정렬된 삽입과 직전 키 근처의 Next/UpperBound
+void RunFinger(const char *name, const std::vector<int> &keys, bool finger) {
+  AvlSet set;
+  set.EnableFinger(finger);
+  long long check = 0;
+  Clock::time_point start = Clock::now();
+  for (int key : keys) {
+    check += set.InsertKey(key);
+  }
+  double insert_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  for (int key : keys) {
+    check += set.NextKey(key).count;
+    check += set.UpperBoundKey(key + 1).count;
+  }
+  double query_ms = ElapsedMs(start);
+
+  double n = (double)keys.size();
+  printf("finger    %-11s %-4s insert %6.1f  next+upper %6.1f ns/op  "
+         "(check %lld)\n",
+         name, finger ? "on" : "off", insert_ms * 1e6 / n,
+         query_ms * 1e6 / (2 * n), check % 1000);
+}
+
+void BenchFinger() {
+  const int n = 1000000;
+  std::vector<int> sorted(n);
+  for (int i = 0; i < n; ++i) {
+    sorted[i] = i * 2;
+  }
+  // 거의 정렬: 64 개 창 안에서만 섞는다
+  std::vector<int> near_sorted = sorted;
+  std::mt19937 rng(3);
+  for (int i = 0; i + 64 <= n; i += 64) {
+    std::shuffle(near_sorted.begin() + i, near_sorted.begin() + i + 64, rng);
+  }
+  for (bool finger : {false, true}) {
+    RunFinger("sorted", sorted, finger);
+  }
+  for (bool finger : {false, true}) {
+    RunFinger("near-sorted", near_sorted, finger);
+  }
+}
+
+// 조회 필터: 없는 키 위주의 Find 와 소수의 키에 몰리는 Find
+void RunLookup(const char *name, const std::vector<int> &keys,
+               const std::vector<int> &probes, bool filter) {
+  AvlSet set;
+  set.EnableLookupFilter(filter);
+  for (int key : keys) {
+    set.InsertKey(key);
+  }
+  long long check = 0;
+  Clock::time_point start = Clock::now();
+  for (int key : probes) {
+    check += set.FindKey(key).v[0];
+  }
+  double ms = ElapsedMs(start);
+  printf("lookup    %-9s %-4s find %6.1f ns/op  (check %lld)\n", name,
+         filter ? "on" : "off", ms * 1e6 / probes.size(), check % 1000);
+}
+
+void BenchLookup() {
+  const int n = 1000000, q = 2000000;
+  std::vector<int> keys = ShuffledKeys(n);
+  for (int &key : keys) {
+    key *= 2; // 짝수만 저장
+  }
+  std::mt19937 rng(34);
+  std::vector<int> misses(q), hot(q);
+  for (int i = 0; i < q; ++i) {
+    // 90% 는 없는 홀수 키, 10% 는 있는 키
+    misses[i] = (int)(rng() % n) * 2 + (i % 10 != 0 ? 1 : 0);
+    hot[i] = (int)(rng() % 512) * 2; // 512 개의 인기 키
+  }
+  for (bool filter : {false, true}) {
+    RunLookup("miss-90%", keys, misses, filter);
+  }
+  for (bool filter : {false, true}) {
+    RunLookup("hot-512", keys, hot, filter);
+  }
+}
+
+// 컴파일 시간에 만든 StaticAvlSet 과 시작 시 Insert 로 만드는 AvlSet
+constexpr int kAllowList[] = {
+    1031, 7,    512,  88,   4096, 3,    250,  999,  61,   1500, 42,
+    777,  2048, 19,   333,  640,  12,   8191, 95,   460,  1200, 27,
+    5000, 150,  71,   3100, 880,  9,    2600, 404,  1777, 33};
+constexpr StaticAvlSet kAllowSet(kAllowList);
+
+void BenchStatic() {
+  const int q = 10000000;
+  Clock::time_point start = Clock::now();
+  AvlSet set;
+  for (int key : kAllowList) {
+    set.InsertKey(key);
+  }
+  double build_us = ElapsedMs(start) * 1000;
+
+  // 트리 모양이 달라 깊이*높이의 합은 서로 다르다
+  long long dynamic_check = 0, static_check = 0;
+  start = Clock::now();
+  for (int i = 0; i < q; ++i) {
+    dynamic_check += set.FindKey(i & 8191).v[0];
+  }
+  double dynamic_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  for (int i = 0; i < q; ++i) {
+    static_check += kAllowSet.Find(i & 8191).v[0];
+  }
+  double static_ms = ElapsedMs(start);
+
+  printf("static    %zu keys  AvlSet build %.1f us (static: 0)  find %.1f vs "
+         "%.1f ns/op  (check %lld %lld)\n",
+         sizeof(kAllowList) / sizeof(int), build_us, dynamic_ms * 1e6 / q,
+         static_ms * 1e6 / q, dynamic_check % 1000, static_check % 1000);
+}
+
+// 구간 트리: 찌르기 질의를 AvlIntervalSet (개별, 배치) 과 선형 탐색으로
+void BenchInterval() {
+  const int n = 200000, queries = 2000, span = 100000000;
+  std::mt19937 rng(37);
+  AvlIntervalSet tree;
+  std::vector<std::pair<int, int>> ranges;
+  for (int i = 0; i < n; ++i) {
+    int low = (int)(rng() % span), high = low + (int)(rng() % 20000);
+    if (tree.InsertInterval(low, high)) {
+      ranges.push_back(std::make_pair(low, high));
+    }
+  }
+  std::vector<int> points(queries);
+  for (int &x : points) {
+    x = (int)(rng() % span);
+  }
+
+  Clock::time_point start = Clock::now();
+  size_t tree_hits = 0;
+  for (int x : points) {
+    tree_hits += tree.Stab(x).size();
+  }
+  double tree_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  size_t batch_hits = 0;
+  for (const auto &hits : tree.StabBatch(points)) {
+    batch_hits += hits.size();
+  }
+  double batch_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  size_t scan_hits = 0;
+  for (int x : points) {
+    for (const auto &range : ranges) {
+      scan_hits += (range.first <= x && x <= range.second);
+    }
+  }
+  double scan_ms = ElapsedMs(start);
+
+  printf("interval  n=%zu  %d stabs: tree %.2f ms  batch %.2f ms  scan %.1f ms"
+         "  (hits %zu %zu %zu)\n",
+         ranges.size(), queries, tree_ms, batch_ms, scan_ms, tree_hits,
+         batch_hits, scan_hits);
+}
+
+// EraseIf: 개별 삭제와 재구성의 교차점 (삭제 비율별)
+double TimeEraseIf(const std::vector<int> &keys, double fraction,
+                   double rebuild_fraction) {
+  AvlSet set;
+  for (int key : keys) {
+    set.InsertKey(key);
+  }
+  unsigned threshold = (unsigned)(fraction * 10000);
+  Clock::time_point start = Clock::now();
+  set.EraseIf(
+      [&](int k) { return (unsigned)k * 2654435761u % 10000 < threshold; },
+      rebuild_fraction);
+  return ElapsedMs(start);
+}
+
+void BenchEraseIf() {
+  const int n = 1000000;
+  std::vector<int> keys = ShuffledKeys(n);
+  printf("eraseif   n=%d  %u hw threads  (default rebuild at %.0f%%)\n", n,
+         std::thread::hardware_concurrency(),
+         AvlSet::kEraseIfRebuildFraction * 100);
+  for (double fraction : {0.001, 0.01, 0.02, 0.05, 0.1, 0.25, 0.5, 0.9}) {
+    double individual = TimeEraseIf(keys, fraction, 2.0);
+    double rebuild = TimeEraseIf(keys, fraction, 0.0);
+    printf("eraseif   erase %5.1f%%  individual %7.1f ms  rebuild %7.1f ms"
+           "  -> %s\n",
+           fraction * 100, individual, rebuild,
+           individual < rebuild ? "individual" : "rebuild");
+  }
+}
+
+// 전체 합: 단일 스레드 중위 순회 vs ParallelReduce (풀 크기별)
+void BenchParallelReduce() {
+  const int n = 4000000;
+  std::vector<int> keys = ShuffledKeys(n);
+  AvlSet set;
+  for (int key : keys) {
+    set.InsertKey(key);
+  }
+
+  Clock::time_point start = Clock::now();
+  long long serial_sum = 0;
+  AvlSet::Node *cur = set.SelectNode(1);
+  for (; cur; cur = AvlSet::Successor(cur)) {
+    serial_sum += cur->key;
+  }
+  double serial_ms = ElapsedMs(start);
+  printf("reduce    n=%d  serial walk %.1f ms\n", n, serial_ms);
+
+  unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1; threads <= hw; threads *= 2) {
+    AvlWorkPool pool(threads);
+    start = Clock::now();
+    long long sum = set.ParallelReduce(
+        0LL, [](int k) { return (long long)k; },
+        [](long long a, long long b) { return a + b; }, pool);
+    double ms = ElapsedMs(start);
+    printf("reduce    %2u threads  %.1f ms  (x%.2f, diff %lld)\n", threads, ms,
+           serial_ms / ms, sum - serial_sum);
+  }
+}
+
+// 삭제가 몰리는 구간: 즉시 삭제(AvlSet) vs 지연 삭제(AvlLazySet).
+// 키의 절반을 지우는 시간과 그 뒤 전체 키를 Find 하는 시간
+template <typename Set>
+void RunLazy(const char *name, Set &set, const std::vector<int> &keys) {
+  for (int key : keys) {
+    set.InsertKey(key);
+  }
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < keys.size(); i += 2) {
+    set.EraseKey(keys[i]);
+  }
+  double erase_ms = ElapsedMs(start);
+  start = Clock::now();
+  long long found = 0;
+  for (int key : keys) {
+    found += set.FindKey(key).v[0] >= 0;
+  }
+  double find_ms = ElapsedMs(start);
+  printf("lazy      %-12s erase %7.1f ms  find %7.1f ms  (found %lld)\n",
+         name, erase_ms, find_ms, found);
+}
+
+void BenchLazy() {
+  const int n = 1000000;
+  std::vector<int> keys = ShuffledKeys(n);
+  printf("lazy      n=%d, erase every other key\n", n);
+  {
+    AvlSet eager;
+    RunLazy("eager", eager, keys);
+  }
+  for (double ratio : {0.25, 1.0}) {
+    AvlLazySet lazy(ratio);
+    char name[32];
+    snprintf(name, sizeof(name), "lazy r=%.2f", ratio);
+    RunLazy(name, lazy, keys);
+  }
+}
+
+// 이 스레드의 dTLB 읽기 미스 카운터. 커널이 허용하지 않으면 -1 을 돌려준다
+class TlbMissCounter {
+public:
+  TlbMissCounter() : fd_(-1) {
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    fd_ = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+  ~TlbMissCounter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+  long long Read() {
+    long long count = -1;
+    if (fd_ < 0 || read(fd_, &count, sizeof(count)) != sizeof(count)) {
+      return -1;
+    }
+    return count;
+  }
+
+private:
+  int fd_;
+};
+
+// 이 프로세스가 투명 huge page 로 받은 메모리 (kB, 알 수 없으면 -1)
+long long AnonHugePagesKb() {
+  FILE *f = fopen("/proc/self/smaps_rollup", "r");
+  if (f == nullptr) {
+    return -1;
+  }
+  char line[256];
+  long long kb = -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "AnonHugePages: %lld kB", &kb) == 1) {
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
+// 노드 할당 방식별 무작위 Find 의 지연과 dTLB 미스:
+// new (힙) vs arena 4K 페이지 vs arena 2MB 페이지
+void RunArena(const char *name, const std::vector<int> &keys,
+              const AvlArenaOptions *options) {
+  AvlSet set;
+  if (options) {
+    set.EnableArena(*options);
+  }
+  long long thp_before = AnonHugePagesKb();
+  for (int key : keys) {
+    set.InsertKey(key);
+  }
+  long long thp_kb = AnonHugePagesKb() - thp_before;
+  std::vector<int> probes = ShuffledKeys((int)keys.size(), 7);
+  TlbMissCounter tlb;
+  Clock::time_point start = Clock::now();
+  long long sum = 0;
+  for (int x : probes) {
+    sum += set.FindKey(x).v[0];
+  }
+  double ms = ElapsedMs(start);
+  long long misses = tlb.Read();
+  printf("arena     %-10s %6.1f ns/find  dTLB misses/find %s  THP %lld kB"
+         "  hugetlb chunks %zu  (sum %lld)\n",
+         name, ms * 1e6 / probes.size(),
+         misses < 0 ? "n/a"
+                    : std::to_string((double)misses / probes.size()).c_str(),
+         thp_kb, set.arena() ? set.arena()->huge_chunks() : 0, sum);
+}
+
+void BenchArena() {
+  const int n = 2000000;
+  std::vector<int> keys = ShuffledKeys(n);
+  printf("arena     n=%d random Find\n", n);
+  RunArena("heap", keys, nullptr);
+  AvlArenaOptions small;
+  small.huge_pages = false;
+  RunArena("arena 4K", keys, &small);
+  AvlArenaOptions huge;
+  RunArena("arena 2M", keys, &huge);
+}
+
+// 명령 해석 비용: 텍스트 vs 이진(varint, 고정 32비트). 트리 연산 없이
+// 같은 명령 n 개를 메모리에서 읽어 들이는 시간
+void BenchBinary() {
+  const int n = 4000000;
+  std::mt19937 rng(45);
+  std::vector<AvlCommand> commands(n);
+  std::string text = "1\n" + std::to_string(n) + "\n";
+  for (AvlCommand &command : commands) {
+    command.op = (AvlOp)(rng() % kOpCount);
+    command.x = AvlOpHasArg(command.op) ? (int)(rng() % 1000000) : 0;
+    text += kAvlOpNames[command.op];
+    if (AvlOpHasArg(command.op)) {
+      text += " " + std::to_string(command.x);
+    }
+    text += "\n";
+  }
+  long long checksum = 0;
+
+  FILE *f = fmemopen(&text[0], text.size(), "r");
+  Clock::time_point start = Clock::now();
+  AvlTextReader reader(f);
+  int T, Q, x;
+  std::string token;
+  reader.NextInt(&T);
+  reader.NextInt(&Q);
+  for (int i = 0; i < Q && reader.NextToken(&token); ++i) {
+    AvlOp op;
+    ParseAvlOp(token, &op);
+    x = 0;
+    if (AvlOpHasArg(op)) {
+      reader.NextInt(&x);
+    }
+    checksum += op + x;
+  }
+  double text_ms = ElapsedMs(start);
+  fclose(f);
+  printf("binary    n=%d  text      %7.1f ms  %5.1f MB  (checksum %lld)\n", n,
+         text_ms, text.size() / 1e6, checksum);
+
+  for (uint8_t flags : {(uint8_t)0, kAvlBinaryFixed32}) {
+    FILE *out = tmpfile();
+    {
+      AvlBinaryWriter writer(out);
+      writer.WriteHeader(1, flags);
+      writer.WriteCount(n);
+      for (const AvlCommand &command : commands) {
+        writer.WriteCommand(command.op, command.x);
+      }
+    }
+    std::string bytes(ftell(out), '\0');
+    rewind(out);
+    size_t read = fread(&bytes[0], 1, bytes.size(), out);
+    fclose(out);
+    std::istringstream in(bytes.substr(0, read));
+    checksum = 0;
+    start = Clock::now();
+    AvlBinaryReader binary(in);
+    binary.ReadHeader(&T);
+    binary.NextCount(&Q);
+    AvlCommand command;
+    for (int i = 0; i < Q && binary.NextCommand(&command); ++i) {
+      checksum += command.op + command.x;
+    }
+    double ms = ElapsedMs(start);
+    printf("binary    n=%d  %-8s  %7.1f ms  %5.1f MB  (checksum %lld, x%.1f)\n",
+           n, flags ? "fixed32" : "varint", ms, bytes.size() / 1e6, checksum,
+           text_ms / ms);
+  }
+}
+
+// 여러 작업 프로세스가 같은 집합을 쓸 때: 프로세스마다 AvlSet 을 짓는 비용과
+// 공유 메모리 세그먼트에 붙는 비용, 그리고 무작위 Find 의 지연
+void BenchShared() {
+  const int n = 1000000, workers = 8;
+  std::vector<int> keys = ShuffledKeys(n);
+  std::vector<int> probes = ShuffledKeys(n, 9);
+
+  Clock::time_point start = Clock::now();
+  AvlSet local;
+  for (int key : keys) {
+    local.InsertKey(key);
+  }
+  double build_ms = ElapsedMs(start);
+  start = Clock::now();
+  long long sum = 0;
+  for (int x : probes) {
+    sum += local.FindKey(x).v[0];
+  }
+  double local_ns = ElapsedMs(start) * 1e6 / n;
+  size_t local_bytes = local.MemoryUsage().reserved_bytes;
+
+  std::string name = "/avlset_bench_" + std::to_string(getpid());
+  AvlSharedSet::Unlink(name.c_str());
+  AvlSharedSet writer;
+  if (!writer.Create(name.c_str(), n)) {
+    printf("shared    cannot create %s\n", name.c_str());
+    return;
+  }
+  start = Clock::now();
+  for (int key : keys) {
+    writer.InsertKey(key);
+  }
+  double shared_build_ms = ElapsedMs(start);
+  start = Clock::now();
+  AvlSharedSet reader;
+  reader.Open(name.c_str(), false);
+  double attach_ms = ElapsedMs(start);
+  start = Clock::now();
+  long long shared_sum = 0;
+  for (int x : probes) {
+    shared_sum += reader.FindKey(x).v[0];
+  }
+  double shared_ns = ElapsedMs(start) * 1e6 / n;
+  AvlSharedSet::Unlink(name.c_str());
+
+  printf("shared    n=%d  %d workers\n", n, workers);
+  printf("shared    private  build %7.1f ms/worker  find %6.1f ns  "
+         "%6.1f MB x %d\n",
+         build_ms, local_ns, local_bytes / 1e6, workers);
+  printf("shared    shared   build %7.1f ms once    find %6.1f ns  "
+         "%6.1f MB total, attach %.3f ms  (diff %lld)\n",
+         shared_build_ms, shared_ns, writer.bytes() / 1e6, attach_ms,
+         shared_sum - sum);
+}
+
+// 시간 순 키의 만료: 오래된 키부터 창 W 개씩 지우는 시간을 키마다 EraseKey,
+// EraseRange, ExtractRange 로 비교한다 (전체 키의 절반을 지운다)
+void BenchEraseRange() {
+  const int n = 1000000;
+  std::vector<int> keys = ShuffledKeys(n);
+  printf("range     n=%d  expire n/2 oldest keys in windows of W\n", n);
+  for (int window : {16, 256, 4096, 65536}) {
+    double ms[3];
+    for (int method = 0; method < 3; ++method) {
+      AvlSet set;
+      for (int key : keys) {
+        set.InsertKey(key);
+      }
+      Clock::time_point start = Clock::now();
+      for (int lo = 0; lo < n / 2; lo += window) {
+        int hi = std::min(lo + window, n / 2) - 1;
+        if (method == 0) {
+          for (int key = lo; key <= hi; ++key) {
+            set.EraseKey(key);
+          }
+        } else if (method == 1) {
+          set.EraseRange(lo, hi);
+        } else {
+          set.ExtractRange(lo, hi);
+        }
+      }
+      ms[method] = ElapsedMs(start);
+      if (set.n_ != n - n / 2) {
+        printf("range     size mismatch %d\n", set.n_);
+      }
+    }
+    printf("range     W=%-6d  EraseKey %7.1f ms  EraseRange %7.1f ms  "
+           "ExtractRange %7.1f ms  (x%.1f)\n",
+           window, ms[0], ms[1], ms[2], ms[0] / ms[1]);
+  }
+}
+
+// Dijkstra 용 그래프: 정점마다 (도착 정점, 가중치) 간선 목록
+struct Graph {
+  int vertices;
+  std::vector<std::vector<std::pair<int, int>>> edges;
+};
+
+Graph RandomGraph(int vertices, int degree, unsigned seed) {
+  Graph g{vertices, std::vector<std::vector<std::pair<int, int>>>(vertices)};
+  std::mt19937 rng(seed);
+  for (int v = 0; v < vertices; ++v) {
+    for (int i = 0; i < degree; ++i) {
+      g.edges[v].push_back({(int)(rng() % vertices), 1 + (int)(rng() % 64)});
+    }
+  }
+  return g;
+}
+
+// 키 (거리 << bits) | 정점 을 쓰는 감소 연산이 있는 Dijkstra. 큐는 PopMin 과
+// EraseKey/InsertKey 를 가진 집합 (walk 면 PopMin 대신 루트에서 왼쪽으로
+// 내려가 최소 키를 찾고 EraseKey 한다). 거리의 합을 돌려준다
+template <typename Queue>
+long long DijkstraWithSet(const Graph &g, int bits, Queue &queue, bool walk) {
+  std::vector<int> dist(g.vertices, INT_MAX);
+  dist[0] = 0;
+  queue.InsertKey(0);
+  int key;
+  while (true) {
+    if (walk) {
+      if (queue.root_ == nullptr) {
+        break;
+      }
+      AvlSet::Node *node = queue.root_;
+      while (node->left) {
+        node = node->left;
+      }
+      key = node->key;
+      queue.EraseKey(key);
+    } else if (!queue.PopMin(&key)) {
+      break;
+    }
+    int u = key & ((1 << bits) - 1);
+    for (const auto &edge : g.edges[u]) {
+      int d = dist[u] + edge.second;
+      int v = edge.first;
+      if (d < dist[v]) {
+        if (dist[v] != INT_MAX) {
+          queue.EraseKey(dist[v] << bits | v);
+        }
+        dist[v] = d;
+        queue.InsertKey(d << bits | v);
+      }
+    }
+  }
+  long long sum = 0;
+  for (int d : dist) {
+    sum += d == INT_MAX ? 0 : d;
+  }
+  return sum;
+}
+
+long long DijkstraWithStdSet(const Graph &g) {
+  std::vector<int> dist(g.vertices, INT_MAX);
+  std::set<std::pair<int, int>> queue;
+  dist[0] = 0;
+  queue.insert({0, 0});
+  while (!queue.empty()) {
+    int u = queue.begin()->second;
+    queue.erase(queue.begin());
+    for (const auto &edge : g.edges[u]) {
+      int d = dist[u] + edge.second;
+      int v = edge.first;
+      if (d < dist[v]) {
+        if (dist[v] != INT_MAX) {
+          queue.erase({dist[v], v});
+        }
+        dist[v] = d;
+        queue.insert({d, v});
+      }
+    }
+  }
+  long long sum = 0;
+  for (int d : dist) {
+    sum += d == INT_MAX ? 0 : d;
+  }
+  return sum;
+}
+
+// 감소 연산 대신 중복을 넣고 꺼낼 때 낡은 항목을 건너뛴다 (흔한 구현)
+long long DijkstraWithHeap(const Graph &g) {
+  std::vector<int> dist(g.vertices, INT_MAX);
+  std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>,
+                      std::greater<std::pair<int, int>>>
+      queue;
+  dist[0] = 0;
+  queue.push({0, 0});
+  while (!queue.empty()) {
+    std::pair<int, int> top = queue.top();
+    queue.pop();
+    int u = top.second;
+    if (top.first != dist[u]) {
+      continue;
+    }
+    for (const auto &edge : g.edges[u]) {
+      int d = dist[u] + edge.second;
+      int v = edge.first;
+      if (d < dist[v]) {
+        dist[v] = d;
+        queue.push({d, v});
+      }
+    }
+  }
+  long long sum = 0;
+  for (int d : dist) {
+    sum += d == INT_MAX ? 0 : d;
+  }
+  return sum;
+}
+
+// 우선순위 큐로 쓸 때: 무작위 그래프의 Dijkstra 를 std::priority_queue,
+// std::set, AvlSet (루트에서 최소 키 찾기 / PopMin) 으로 비교한다
+void BenchPriorityQueue() {
+  const int bits = 16; // 키의 아래 16비트가 정점 번호
+  for (int degree : {4, 16}) {
+    Graph g = RandomGraph(1 << bits, degree, 50);
+    Clock::time_point start = Clock::now();
+    long long heap_sum = DijkstraWithHeap(g);
+    double heap_ms = ElapsedMs(start);
+    start = Clock::now();
+    long long set_sum = DijkstraWithStdSet(g);
+    double set_ms = ElapsedMs(start);
+    AvlSet walk_queue, pop_queue;
+    start = Clock::now();
+    long long walk_sum = DijkstraWithSet(g, bits, walk_queue, true);
+    double walk_ms = ElapsedMs(start);
+    start = Clock::now();
+    long long pop_sum = DijkstraWithSet(g, bits, pop_queue, false);
+    double pop_ms = ElapsedMs(start);
+    printf("pq        V=%d E=%d  priority_queue %6.1f ms  std::set %6.1f ms  "
+           "AvlSet walk %6.1f ms  PopMin %6.1f ms  (diff %lld %lld %lld)\n",
+           g.vertices, g.vertices * degree, heap_ms, set_ms, walk_ms, pop_ms,
+           set_sum - heap_sum, walk_sum - heap_sum, pop_sum - heap_sum);
+  }
+
+  // 꺼내기만: n 개를 넣고 모두 꺼낸다
+  const int n = 1000000;
+  std::vector<int> keys = ShuffledKeys(n);
+  AvlSet walk_queue, pop_queue;
+  for (int key : keys) {
+    walk_queue.InsertKey(key);
+    pop_queue.InsertKey(key);
+  }
+  Clock::time_point start = Clock::now();
+  while (walk_queue.root_) {
+    AvlSet::Node *node = walk_queue.root_;
+    while (node->left) {
+      node = node->left;
+    }
+    walk_queue.EraseKey(node->key);
+  }
+  double walk_ms = ElapsedMs(start);
+  start = Clock::now();
+  int key;
+  while (pop_queue.PopMin(&key)) {
+  }
+  double pop_ms = ElapsedMs(start);
+  printf("pq        pop all n=%d  walk + EraseKey %6.1f ms  PopMin %6.1f ms  "
+         "(x%.2f)\n",
+         n, walk_ms, pop_ms, walk_ms / pop_ms);
+}
+
+// 큰 입력에서 avlset_app 의 순차 모드와 --pipeline 모드의 전체 실행 시간.
+// 현재 디렉터리(빌드 디렉터리)의 avlset_app 을 실행한다
+void BenchPipeline() {
+  const char *input = "bench_pipeline_input.txt";
+  const int q = 2000000;
+  if (access("./avlset_app", X_OK) != 0) {
+    printf("pipeline  skipped: ./avlset_app not found\n");
+    return;
+  }
+
+  FILE *fp = fopen(input, "w");
+  std::mt19937 rng(8);
+  fprintf(fp, "1\n%d\n", q);
+  for (int i = 0; i < q; ++i) {
+    int x = (int)(rng() % (q / 2));
+    // 삽입과 읽기 명령을 섞는다 (중복 삽입이 없도록 i 를 키로 사용)
+    if (i % 3 == 0) {
+      fprintf(fp, "Insert %d\n", i);
+    } else if (i % 3 == 1) {
+      fprintf(fp, "Find %d\n", x);
+    } else {
+      fprintf(fp, "UpperBound %d\n", x);
+    }
+  }
+  fclose(fp);
+
+  const char *modes[] = {"", " --pipeline"};
+  double ms[2];
+  for (int i = 0; i < 2; ++i) {
+    std::string command = std::string("./avlset_app") + modes[i] + " < " +
+                          input + " > /dev/null";
+    Clock::time_point start = Clock::now();
+    if (system(command.c_str()) != 0) {
+      printf("pipeline  failed: %s\n", command.c_str());
+      return;
+    }
+    ms[i] = ElapsedMs(start);
+  }
+  printf("pipeline  q=%d  sequential %.1f ms  pipelined %.1f ms  (x%.2f, "
+         "%u hw threads)\n",
+         q, ms[0], ms[1], ms[0] / ms[1], std::thread::hardware_concurrency());
+  remove(input);
+}
+
+// 읽기 위주의 입력에서 avlset_app 의 순차 모드와 --parallel-reads=N
+// (최소 구간 길이별)의 전체 실행 시간. 빌드 디렉터리에서 실행한다
+void BenchParallelReads() {
+  const char *input = "bench_reads_input.txt";
+  const int n = 200000, q = 2000000;
+  if (access("./avlset_app", X_OK) != 0) {
+    printf("reads     skipped: ./avlset_app not found\n");
+    return;
+  }
+
+  for (int write_every : {100, 1000}) {
+    FILE *fp = fopen(input, "w");
+    std::mt19937 rng(41);
+    fprintf(fp, "1\n%d\n", n + q);
+    for (int i = 0; i < n; ++i) {
+      fprintf(fp, "Insert %d\n", i * 2);
+    }
+    for (int i = 0; i < q; ++i) {
+      int x = (int)(rng() % (2 * n));
+      if (i % write_every == 0) { // 홀수 키만 넣으므로 중복이 없다
+        fprintf(fp, "Insert %d\n", 2 * n + 2 * i + 1);
+      } else if (i % 3 == 0) {
+        fprintf(fp, "Rank %d\n", x);
+      } else {
+        fprintf(fp, i % 3 == 1 ? "Find %d\n" : "UpperBound %d\n", x);
+      }
+    }
+    fclose(fp);
+
+    const char *modes[] = {"", " --parallel-reads=64", " --parallel-reads=256",
+                           " --parallel-reads=1024"};
+    double base_ms = 0;
+    for (const char *mode : modes) {
+      std::string command = std::string("./avlset_app") + mode + " < " +
+                            input + " > /dev/null";
+      Clock::time_point start = Clock::now();
+      if (system(command.c_str()) != 0) {
+        printf("reads     failed: %s\n", command.c_str());
+        return;
+      }
+      double ms = ElapsedMs(start);
+      base_ms = (mode[0] == '\0') ? ms : base_ms;
+      printf("reads     1 write/%-4d %-22s %7.1f ms  (x%.2f, %u hw threads)\n",
+             write_every, mode[0] ? mode + 1 : "sequential", ms, base_ms / ms,
+             std::thread::hardware_concurrency());
+    }
+  }
+  remove(input);
+}
+
+struct Scenario {
+  const char *name;
+  void (*run)();
+};
+
+const Scenario kScenarios[] = {
+    {"recovery", BenchRecovery},
+    {"blockset", BenchBlockSet},
+    {"engines", BenchEngines},
+    {"aggregate", BenchAggregate},
+    {"pipeline", BenchPipeline},
+    {"finger", BenchFinger},
+    {"lookup", BenchLookup},
+    {"static", BenchStatic},
+    {"interval", BenchInterval},
+    {"eraseif", BenchEraseIf},
+    {"reduce", BenchParallelReduce},
+    {"reads", BenchParallelReads},
+    {"lazy", BenchLazy},
+    {"arena", BenchArena},
+    {"binary", BenchBinary},
+    {"shared", BenchShared},
+    {"range", BenchEraseRange},
+    {"pq", BenchPriorityQueue},
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const Scenario &scenario : kScenarios) {
+    bool selected = (argc == 1);
+    for (int i = 1; i < argc; ++i) {
+      selected = selected || strcmp(argv[i], scenario.name) == 0;
+    }
+    if (selected) {
+      scenario.run();
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,213 @@
+// MIT License
+// Copyright (c) 2025 blackcow9622
+// Licensed under the MIT License. See LICENSE file in the project root for
+// details.
+//
+// avlset_app --serve 용 부하 생성기
+// 사용법: avlset_loadgen [--socket=PATH] [--connections=N] [--batch=B]
+//                        [--seconds=S] [--keys=K]
+// --socket 이 없으면 같은 프로세스 안에서 서버를 띄워 측정한다.
+// 연결마다 스레드 하나가 B 개의 명령을 한 번에 보내고 응답 B 줄을 모두 받을
+// 때까지의 왕복 시간을 잰다. 전체 처리량과 왕복 시간의 p50/p99/최대를 출력
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/AVLSet.cpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadOptions {
+  std::string socket_path;
+  int connections = 4;
+  int batch = 64;
+  double seconds = 3;
+  int keys = 100000;
+};
+
+struct ConnectionResult {
+  long long commands = 0;
+  std::vector<double> batch_us; // 묶음별 왕복 시간
+  bool failed = false;
+};
+
+int Connect(const std::string &path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool SendAll(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+// 응답 lines 줄을 받을 때까지 읽는다
+bool ReceiveLines(int fd, int lines) {
+  char buf[1 << 16];
+  while (lines > 0) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      return false;
+    }
+    lines -= (int)std::count(buf, buf + n, '\n');
+  }
+  return true;
+}
+
+// 읽기 위주 명령 섞기: Insert 20%, Erase 10%, 나머지는 조회
+void RunConnection(const LoadOptions &options, int id,
+                   Clock::time_point deadline, ConnectionResult *result) {
+  int fd = Connect(options.socket_path);
+  if (fd < 0) {
+    result->failed = true;
+    return;
+  }
+  static const char *const kReads[] = {"Find", "Rank", "UpperBound", "Prev",
+                                       "Next"};
+  std::mt19937 rng(1000 + id);
+  std::string request = "Use load\n";
+  int expected = 1;
+  char line[64];
+  while (Clock::now() < deadline) {
+    for (int i = 0; i < options.batch; ++i) {
+      int x = (int)(rng() % options.keys);
+      unsigned r = rng() % 10;
+      const char *name = r < 2 ? "Insert" : r < 3 ? "Erase" : kReads[r % 5];
+      request.append(line, snprintf(line, sizeof(line), "%s %d\n", name, x));
+    }
+    expected += options.batch;
+    Clock::time_point start = Clock::now();
+    if (!SendAll(fd, request) || !ReceiveLines(fd, expected)) {
+      result->failed = true;
+      break;
+    }
+    result->batch_us.push_back(
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count());
+    result->commands += options.batch;
+    request.clear();
+    expected = 0;
+  }
+  close(fd);
+}
+
+double Percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+bool ParseOptions(int argc, char **argv, LoadOptions *options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(0, eq);
+    const char *value = eq == std::string::npos ? "" : argv[i] + eq + 1;
+    if (name == "--socket" && *value) {
+      options->socket_path = value;
+    } else if (name == "--connections" && atoi(value) > 0) {
+      options->connections = atoi(value);
+    } else if (name == "--batch" && atoi(value) > 0) {
+      options->batch = atoi(value);
+    } else if (name == "--seconds" && atof(value) > 0) {
+      options->seconds = atof(value);
+    } else if (name == "--keys" && atoi(value) > 0) {
+      options->keys = atoi(value);
+    } else {
+      fprintf(stderr, "unknown option: %s\n", argv[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  LoadOptions options;
+  if (!ParseOptions(argc, argv, &options)) {
+    return 1;
+  }
+
+  std::unique_ptr<AvlServer> server; // --socket 이 없을 때만 사용
+  std::thread server_thread;
+  if (options.socket_path.empty()) {
+    options.socket_path =
+        "/tmp/avlset_loadgen." + std::to_string(getpid()) + ".sock";
+    server.reset(new AvlServer(options.socket_path));
+    if (!server->Listen()) {
+      fprintf(stderr, "cannot listen on %s\n", options.socket_path.c_str());
+      return 1;
+    }
+    server_thread = std::thread([&] { server->Run(); });
+  }
+
+  std::vector<ConnectionResult> results(options.connections);
+  std::vector<std::thread> clients;
+  Clock::time_point start = Clock::now();
+  Clock::time_point deadline =
+      start + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(options.seconds));
+  for (int i = 0; i < options.connections; ++i) {
+    clients.emplace_back(RunConnection, std::cref(options), i, deadline,
+                         &results[i]);
+  }
+  for (std::thread &client : clients) {
+    client.join();
+  }
+  double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  if (server) {
+    server->Stop();
+    server_thread.join();
+  }
+
+  long long commands = 0;
+  std::vector<double> latencies;
+  for (const ConnectionResult &result : results) {
+    if (result.failed) {
+      fprintf(stderr, "a connection failed\n");
+      return 1;
+    }
+    commands += result.commands;
+    latencies.insert(latencies.end(), result.batch_us.begin(),
+                     result.batch_us.end());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  printf("loadgen   %d connections  batch %d  %.1f s  %s server\n",
+         options.connections, options.batch, elapsed,
+         server ? "in-process" : "external");
+  printf("loadgen   %.0f commands/s  batch round trip p50 %.1f us  "
+         "p99 %.1f us  max %.1f us  (%zu batches)\n",
+         commands / elapsed, Percentile(latencies, 0.5),
+         Percentile(latencies, 0.99),
+         latencies.empty() ? 0.0 : latencies.back(), latencies.size());
+  return 0;
+}
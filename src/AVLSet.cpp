@@ -3,12 +3,579 @@
 // Licensed under the MIT License. See LICENSE file in the project root for
 // details. 작성자 : 조현우, 작성일 : 2025.11.16
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <pthread.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef AVLSET_HAVE_NUMA // CMake 가 libnuma 를 찾았을 때 정의
+#include <numa.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 using namespace std;
 
+// 다음에 방문할 노드를 미리 캐시로 가져온다 (지원하지 않는 컴파일러에서는 무시)
+#if defined(__GNUC__) || defined(__clang__)
+#define AVLSET_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define AVLSET_PREFETCH(p) ((void)(p))
+#endif
+
+class AvlSetLog;
+
+// 명령 종류 (텍스트 명령 이름과 같은 순서)
+enum AvlOp : uint8_t {
+  kOpFind,
+  kOpInsert,
+  kOpEmpty,
+  kOpSize,
+  kOpPrev,
+  kOpNext,
+  kOpUpperBound,
+  kOpRank,
+  kOpErase,
+  kOpCount // 명령 종류의 개수
+};
+
+static const char *const kAvlOpNames[kOpCount] = {
+    "Find", "Insert", "Empty", "Size", "Prev",
+    "Next", "UpperBound", "Rank", "Erase"};
+
+// 명령 이름을 AvlOp 로 변환 (알 수 없는 명령이면 false)
+static bool ParseAvlOp(const char *name, size_t len, AvlOp *op) {
+  for (int i = 0; i < kOpCount; ++i) {
+    if (strlen(kAvlOpNames[i]) == len &&
+        memcmp(name, kAvlOpNames[i], len) == 0) {
+      *op = (AvlOp)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool ParseAvlOp(const string &name, AvlOp *op) {
+  return ParseAvlOp(name.data(), name.size(), op);
+}
+
+// Empty, Size 를 제외한 명령은 정수 인자 x 를 받는다
+static bool AvlOpHasArg(AvlOp op) { return op != kOpEmpty && op != kOpSize; }
+
+// Insert, Erase 를 제외한 명령은 트리를 바꾸지 않는다
+static bool AvlOpIsReadOnly(AvlOp op) {
+  return op != kOpInsert && op != kOpErase && op != kOpCount;
+}
+
+// 명령 하나의 결과: 한 줄에 공백으로 구분해 출력할 정수 1~2개
+struct AvlReply {
+  int count;
+  int v[2];
+};
+
+static constexpr AvlReply MakeReply(int a) { return AvlReply{1, {a, 0}}; }
+static constexpr AvlReply MakeReply(int a, int b) {
+  return AvlReply{2, {a, b}};
+}
+
+static void PrintReply(const AvlReply &reply) {
+  if (reply.count == 2) {
+    cout << reply.v[0] << ' ' << reply.v[1] << '\n';
+  } else {
+    cout << reply.v[0] << '\n';
+  }
+}
+
+// PrintReply 와 같은 한 줄을 *out 뒤에 덧붙인다
+static void AppendReply(string *out, const AvlReply &reply) {
+  char line[32];
+  int len = (reply.count == 2) ? snprintf(line, sizeof(line), "%d %d\n",
+                                          reply.v[0], reply.v[1])
+                               : snprintf(line, sizeof(line), "%d\n",
+                                          reply.v[0]);
+  out->append(line, len);
+}
+
+// 블록 Bloom 필터: 키 하나의 비트는 모두 64바이트 블록 하나에 들어 있어
+// 조회 한 번에 캐시 라인 하나만 읽는다. 삭제는 지원하지 않는다
+class AvlBloomFilter {
+public:
+  AvlBloomFilter() : count_(0), capacity_(0) {}
+
+  void Reset(size_t capacity); // capacity 개의 키에 맞는 크기로 비운다
+  void Add(int key);
+  bool MayContain(int key) const; // false 이면 키가 확실히 없다
+  size_t count() const { return count_; }
+  size_t capacity() const { return capacity_; }
+  size_t bytes() const { return bits_.size() * sizeof(uint64_t); }
+
+private:
+  static const int kBitsPerKey = 10; // 오탐률 약 1%
+  static const int kProbes = 4;      // 블록 안에서 세우는 비트 수
+  static uint64_t Hash(int key);
+
+  vector<uint64_t> bits_; // 블록당 8 워드 (512비트)
+  size_t count_, capacity_;
+};
+
+uint64_t AvlBloomFilter::Hash(int key) { // splitmix64
+  uint64_t h = (uint32_t)key + 0x9e3779b97f4a7c15ULL;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+void AvlBloomFilter::Reset(size_t capacity) {
+  size_t blocks = capacity * kBitsPerKey / 512 + 1;
+  bits_.assign(blocks * 8, 0);
+  count_ = 0;
+  capacity_ = capacity;
+}
+
+void AvlBloomFilter::Add(int key) {
+  uint64_t h = Hash(key);
+  uint64_t *block = &bits_[(h >> 40) % (bits_.size() / 8) * 8];
+  for (int i = 0; i < kProbes; ++i, h >>= 9) { // 9비트씩 블록 안의 위치
+    block[(h >> 6) & 7] |= 1ULL << (h & 63);
+  }
+  ++count_;
+}
+
+bool AvlBloomFilter::MayContain(int key) const {
+  uint64_t h = Hash(key);
+  const uint64_t *block = &bits_[(h >> 40) % (bits_.size() / 8) * 8];
+  for (int i = 0; i < kProbes; ++i, h >>= 9) {
+    if (!(block[(h >> 6) & 7] & (1ULL << (h & 63)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 조회 필터와 캐시의 누적 통계
+struct AvlLookupStats {
+  uint64_t lookups = 0;         // 필터를 켠 뒤의 Find/Rank 수
+  uint64_t filter_rejects = 0;  // 필터가 트리를 보지 않고 거른 수
+  uint64_t false_positives = 0; // 필터를 통과했지만 없던 키
+  uint64_t cache_hits = 0;      // 캐시에서 노드를 바로 찾은 수
+};
+
+// 메모리 사용량 (바이트). slack 은 살아 있는 노드 밖의 예약 공간이다
+// (할당자 헤더와 정렬, 재사용을 기다리는 노드, 필터와 캐시 등)
+struct AvlMemoryUsage {
+  size_t keys = 0;
+  size_t node_bytes = 0;     // 살아 있는 노드가 차지하는 바이트
+  size_t reserved_bytes = 0; // 할당자에게서 받은 바이트 전체
+  size_t slack_bytes = 0;    // reserved_bytes - node_bytes
+  double bytes_per_key = 0;  // reserved_bytes / keys
+};
+
+// 힙 할당 하나가 실제로 차지하는 바이트 (할당자 헤더와 정렬 포함).
+// 노드 크기는 몇 가지뿐이므로 크기별로 한 번만 malloc 으로 재고 기억한다
+static size_t AvlHeapChunkBytes(size_t request) {
+#ifdef __GLIBC__
+  static const size_t kCachedRequests = 512; // 이보다 큰 요청은 매번 잰다
+  static std::atomic<size_t> cache[kCachedRequests]; // 0 이면 아직 모름
+  size_t bytes = request < kCachedRequests ? cache[request].load() : 0;
+  if (bytes == 0) { // 동시에 재더라도 같은 값을 쓴다
+    void *p = malloc(request);
+    bytes = malloc_usable_size(p) + sizeof(size_t);
+    free(p);
+    if (request < kCachedRequests) {
+      cache[request].store(bytes);
+    }
+  }
+  return bytes;
+#else
+  return (request + sizeof(size_t) + 15) / 16 * 16;
+#endif
+}
+
+static AvlMemoryUsage MakeMemoryUsage(size_t keys, size_t node_bytes,
+                                      size_t reserved_bytes) {
+  AvlMemoryUsage usage;
+  usage.keys = keys;
+  usage.node_bytes = node_bytes;
+  usage.reserved_bytes = reserved_bytes;
+  usage.slack_bytes = reserved_bytes - node_bytes;
+  usage.bytes_per_key = keys ? (double)reserved_bytes / keys : 0.0;
+  return usage;
+}
+
+// 작업 훔치기(work stealing) 스레드 풀.
+// 작업자마다 자기 큐가 있어 자기 큐의 뒤에서 꺼내고, 비면 다른 큐의 앞에서
+// 훔친다. ParallelFor 를 부른 스레드도 끝날 때까지 같은 방식으로 작업을
+// 실행하므로 작업 안에서 다시 ParallelFor 를 불러도 멈추지 않는다
+class AvlWorkPool {
+public:
+  explicit AvlWorkPool(size_t threads = 0); // 0 이면 하드웨어 스레드 수
+  ~AvlWorkPool();
+  AvlWorkPool(const AvlWorkPool &) = delete;
+  AvlWorkPool &operator=(const AvlWorkPool &) = delete;
+
+  size_t size() const { return workers_.size() + 1; } // 호출 스레드 포함
+  // work(0) ... work(count - 1) 을 실행하고 모두 끝날 때까지 기다린다
+  void ParallelFor(size_t count, const function<void(size_t)> &work);
+  static AvlWorkPool &Default(); // 처음 쓸 때 만드는 공용 풀
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<function<void()>> tasks;
+  };
+  vector<unique_ptr<Queue>> queues_; // 작업자별 + 마지막은 외부 호출 스레드용
+  vector<std::thread> workers_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::atomic<size_t> queued_; // 큐에 남은 작업 수
+  bool stop_;
+
+  bool RunOne(size_t self); // 작업 하나를 찾아 실행했으면 true
+  void WorkerLoop(size_t self);
+};
+
+AvlWorkPool::AvlWorkPool(size_t threads) : queued_(0), stop_(false) {
+  if (threads == 0) {
+    threads = max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    queues_.emplace_back(new Queue);
+  }
+  for (size_t i = 0; i + 1 < threads; ++i) {
+    workers_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+AvlWorkPool::~AvlWorkPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+AvlWorkPool &AvlWorkPool::Default() {
+  static AvlWorkPool pool;
+  return pool;
+}
+
+bool AvlWorkPool::RunOne(size_t self) {
+  function<void()> task;
+  for (size_t i = 0; i < queues_.size() && !task; ++i) {
+    Queue &queue = *queues_[(self + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      continue;
+    }
+    if (i == 0) { // 자기 큐는 뒤에서 (최근에 넣은 작업이 캐시에 남아 있다)
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else { // 다른 큐에서는 앞에서 훔친다
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+  }
+  if (!task) {
+    return false;
+  }
+  queued_--;
+  task();
+  return true;
+}
+
+void AvlWorkPool::WorkerLoop(size_t self) {
+  while (true) {
+    if (RunOne(self)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+    if (stop_) {
+      return;
+    }
+  }
+}
+
+void AvlWorkPool::ParallelFor(size_t count,
+                              const function<void(size_t)> &work) {
+  std::atomic<size_t> remaining(count);
+  for (size_t i = 0; i < count; ++i) { // 작업을 큐마다 돌아가며 나눠 준다
+    Queue &queue = *queues_[i % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back([&work, &remaining, i] {
+      work(i);
+      remaining--;
+    });
+    queued_++;
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_); // 잠들려는 작업자와 경합 방지
+  }
+  wake_.notify_all();
+  while (remaining > 0) {
+    if (!RunOne(queues_.size() - 1)) {
+      std::this_thread::yield(); // 남은 작업은 다른 스레드가 실행 중
+    }
+  }
+}
+
+// 노드 arena 설정
+struct AvlArenaOptions {
+  bool huge_pages = true; // 2MB 페이지 (명시적 MAP_HUGETLB, 없으면 THP)
+  int numa_node = -1;     // 0 이상이면 그 NUMA 노드에 메모리를 묶는다
+};
+
+// 같은 크기의 블록을 2MB 경계에 맞춘 2MB 청크에서 잘라 주는 할당기.
+// 노드들이 적은 수의 큰 페이지에 모이므로 큰 트리의 TLB 미스가 줄어든다.
+// huge page 는 예약된 풀(MAP_HUGETLB)을 먼저 시도하고, 없으면 일반 매핑에
+// madvise(MADV_HUGEPAGE) 를 건다. 해제된 블록은 목록에 모았다가 다시 쓰고
+// 청크는 arena 가 사라질 때 한꺼번에 반환한다. 블록은 포인터 크기로 정렬된다
+class AvlNodeArena {
+public:
+  static constexpr size_t kChunkBytes = 2 << 20;
+
+  AvlNodeArena(size_t block_bytes, const AvlArenaOptions &options);
+  ~AvlNodeArena();
+  AvlNodeArena(const AvlNodeArena &) = delete;
+  AvlNodeArena &operator=(const AvlNodeArena &) = delete;
+
+  void *Allocate(); // 메모리가 없으면 bad_alloc
+  void Free(void *p);
+
+  size_t block_bytes() const { return block_; }
+  size_t live() const { return live_; } // 할당된 블록 수
+  size_t reserved_bytes() const { return chunks_.size() * kChunkBytes; }
+  size_t huge_chunks() const { return huge_chunks_; } // MAP_HUGETLB 청크 수
+  bool numa_bound() const { return numa_bound_; }
+
+private:
+  size_t block_;
+  AvlArenaOptions options_;
+  vector<char *> chunks_;
+  char *next_, *end_; // 마지막 청크의 남은 범위
+  void *free_;        // 해제된 블록 목록 (블록의 첫 워드로 연결)
+  size_t live_;
+  size_t huge_chunks_;
+  bool try_hugetlb_; // 예약된 huge page 가 없으면 다시 시도하지 않는다
+  bool numa_bound_;
+
+  char *MapChunk();
+};
+
+AvlNodeArena::AvlNodeArena(size_t block_bytes, const AvlArenaOptions &options)
+    : block_((max(block_bytes, sizeof(void *)) + sizeof(void *) - 1) /
+             sizeof(void *) * sizeof(void *)),
+      options_(options), next_(nullptr), end_(nullptr), free_(nullptr),
+      live_(0), huge_chunks_(0), try_hugetlb_(options.huge_pages),
+      numa_bound_(false) {}
+
+AvlNodeArena::~AvlNodeArena() {
+  for (char *chunk : chunks_) {
+    munmap(chunk, kChunkBytes);
+  }
+}
+
+char *AvlNodeArena::MapChunk() {
+  void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (try_hugetlb_) { // 예약된 2MB 페이지: 주소도 2MB 경계에 맞춰진다
+    p = mmap(nullptr, kChunkBytes, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    try_hugetlb_ = (p != MAP_FAILED);
+    huge_chunks_ += (p != MAP_FAILED);
+  }
+#endif
+  if (p == MAP_FAILED) { // 두 배를 매핑한 뒤 2MB 경계 밖의 앞뒤를 잘라낸다
+    char *raw = static_cast<char *>(mmap(nullptr, 2 * kChunkBytes,
+                                         PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (raw == MAP_FAILED) {
+      return nullptr;
+    }
+    uintptr_t base = reinterpret_cast<uintptr_t>(raw);
+    char *aligned = raw + ((kChunkBytes - base % kChunkBytes) % kChunkBytes);
+    if (aligned > raw) {
+      munmap(raw, aligned - raw);
+    }
+    munmap(aligned + kChunkBytes, raw + kChunkBytes - aligned);
+    p = aligned;
+#ifdef MADV_HUGEPAGE
+    if (options_.huge_pages) {
+      madvise(p, kChunkBytes, MADV_HUGEPAGE); // 실패해도 4K 페이지로 동작
+    }
+#endif
+  }
+#ifdef AVLSET_HAVE_NUMA
+  // 처음 쓰기 전에 묶어야 페이지가 그 노드에서 할당된다
+  if (options_.numa_node >= 0 && numa_available() >= 0 &&
+      options_.numa_node <= numa_max_node()) {
+    numa_tonode_memory(p, kChunkBytes, options_.numa_node);
+    numa_bound_ = true;
+  }
+#endif
+  return static_cast<char *>(p);
+}
+
+void *AvlNodeArena::Allocate() {
+  live_++;
+  if (free_ != nullptr) {
+    void *p = free_;
+    free_ = *static_cast<void **>(p);
+    return p;
+  }
+  if (next_ == nullptr || end_ - next_ < (ptrdiff_t)block_) {
+    char *chunk = MapChunk();
+    if (chunk == nullptr) {
+      live_--;
+      throw bad_alloc();
+    }
+    chunks_.push_back(chunk);
+    next_ = chunk;
+    end_ = chunk + kChunkBytes;
+  }
+  void *p = next_;
+  next_ += block_;
+  return p;
+}
+
+void AvlNodeArena::Free(void *p) {
+  *static_cast<void **>(p) = free_;
+  free_ = p;
+  live_--;
+}
+
+// 부모 링크를 가진 AVL 트리의 회전과 재균형 (AvlSet, AvlMap, AvlSharedSet,
+// AvlBlockSet 이 함께 쓴다). Ref 는 노드 포인터나 노드 번호이고 0 이 빈
+// 자식이다. Tree 는 다음을 제공한다:
+//   At(x)        x 의 노드 (left, right, parent, height)
+//   RootSlot()   루트를 담은 자리 (Ref &)
+//   ResizeHs(x)  자식으로부터 height 와 size 등 부분트리 값을 다시 계산
+//   RotateLeft(x), RotateRight(y)
+//                AvlReBalance 가 부른다. 회전마다 할 일이 없으면
+//                AvlRotateLeft/AvlRotateRight 를 그대로 부른다
+template <typename Tree, typename Ref> int AvlHeightOf(Tree *t, Ref x) {
+  return x ? t->At(x).height : 0;
+}
+
+template <typename Tree, typename Ref> int AvlBalanceOf(Tree *t, Ref x) {
+  return x ? AvlHeightOf(t, t->At(x).left) - AvlHeightOf(t, t->At(x).right)
+           : 0;
+}
+
+// x 의 부모가 x 대신 y 를 가리키게 한다
+template <typename Tree, typename Ref> void AvlReplace(Tree *t, Ref x, Ref y) {
+  Ref p = t->At(x).parent;
+  if (!p) {
+    t->RootSlot() = y;
+  } else if (t->At(p).left == x) {
+    t->At(p).left = y;
+  } else {
+    t->At(p).right = y;
+  }
+  if (y) {
+    t->At(y).parent = p;
+  }
+}
+
+// x 의 오른쪽 자식 y 를 x 자리로 올리고 y 를 돌려준다
+template <typename Tree, typename Ref> Ref AvlRotateLeft(Tree *t, Ref x) {
+  Ref y = t->At(x).right;
+  AvlReplace(t, x, y);
+  Ref b = t->At(y).left;
+  t->At(x).right = b;
+  if (b) {
+    t->At(b).parent = x;
+  }
+  t->At(y).left = x;
+  t->At(x).parent = y;
+  t->ResizeHs(x);
+  t->ResizeHs(y);
+  return y;
+}
+
+// y 의 왼쪽 자식 x 를 y 자리로 올리고 x 를 돌려준다
+template <typename Tree, typename Ref> Ref AvlRotateRight(Tree *t, Ref y) {
+  Ref x = t->At(y).left;
+  AvlReplace(t, y, x);
+  Ref b = t->At(x).right;
+  t->At(y).left = b;
+  if (b) {
+    t->At(b).parent = y;
+  }
+  t->At(x).right = y;
+  t->At(y).parent = x;
+  t->ResizeHs(y);
+  t->ResizeHs(x);
+  return x;
+}
+
+// start 부터 루트까지 부분트리 값을 다시 계산하며 균형을 맞춘다
+template <typename Tree, typename Ref> void AvlReBalance(Tree *t, Ref start) {
+  for (Ref cur = start; cur; cur = t->At(cur).parent) {
+    t->ResizeHs(cur);
+    int balance = AvlBalanceOf(t, cur);
+    if (balance == 2) { // LL or LR
+      if (AvlBalanceOf(t, t->At(cur).left) < 0) {
+        t->RotateLeft(t->At(cur).left);
+      }
+      t->RotateRight(cur);
+      cur = t->At(cur).parent; // 회전으로 올라온 노드는 이미 계산되었다
+    } else if (balance == -2) { // RR or RL
+      if (AvlBalanceOf(t, t->At(cur).right) > 0) {
+        t->RotateRight(t->At(cur).right);
+      }
+      t->RotateLeft(cur);
+      cur = t->At(cur).parent;
+    }
+  }
+}
+
 class AvlSet {
 public:
-  AvlSet() : root_(nullptr), n_(0) {}
+  AvlSet()
+      : root_(nullptr), n_(0), finger_on_(false), finger_(nullptr),
+        finger_depth_(0), filter_on_(false), filter_stale_(0),
+        shape_epoch_(1), log_(nullptr), epoch_(0), leftmost_(nullptr),
+        rightmost_(nullptr), free_list_(nullptr) {}
+  virtual ~AvlSet();
+  AvlSet(const AvlSet &) = delete;
+  AvlSet &operator=(const AvlSet &) = delete;
+
   // 기본기능
   void Find(int x);       // set에서 key == x 인 노드를 찾는다
   void Insert(int x);     // set에 존재하지 않는 새로운 키 x를 삽입한다
@@ -22,6 +589,74 @@ public:
   void Rank(int x);  // 노드의 순위를 구한다
   void Erase(int x); // 노드 x를 삭제한다
 
+  AvlReply Execute(AvlOp op, int x); // 명령 하나를 출력 없이 실행
+
+  // 배치 기능 (출력 대신 입력 순서대로 결과를 반환)
+  vector<int> FindBatch(const vector<int> &xs); // 깊이*높이, 없으면 -1
+  vector<pair<int, int>>
+  RankBatch(const vector<int> &xs); // (깊이*높이, 순위), 없으면 (-1, 0)
+
+  // pred(key) 가 참인 키를 모두 삭제하고 삭제한 개수를 돌려준다.
+  // 트리를 부분트리 단위로 나눠 병렬로 펼치며 pred 를 평가한 뒤, 삭제할 키가
+  // rebuild_fraction 비율 이상이면 남은 노드로 균형 트리를 O(n) 에 다시 짓고
+  // 그보다 적으면 하나씩 EraseKey 한다. pred 는 여러 스레드에서 호출된다
+  template <typename Pred>
+  size_t EraseIf(Pred pred, double rebuild_fraction = kEraseIfRebuildFraction);
+
+  // [lo, hi] 구간의 키를 모두 삭제하고 삭제한 개수를 돌려준다. 트리를 구간의
+  // 양 끝에서 잘라(split) 남은 두 조각을 다시 잇는다(join). 균형 조정은
+  // O(log n) 이고 삭제한 k 개의 노드 해제에 O(k) 가 든다
+  size_t EraseRange(int lo, int hi);
+  // EraseRange 와 같지만 떼어낸 키들을 새 집합으로 돌려준다. 노드를 그대로
+  // 옮기며, Load 의 slab 이나 arena 노드를 쓰는 집합에서는 새로 할당한다
+  unique_ptr<AvlSet> ExtractRange(int lo, int hi);
+
+  // 우선순위 큐 기능: 가장 작은/큰 키를 *x 에 담는다 (비어 있으면 false).
+  // 양 끝 노드를 따로 유지하므로 Min/Max 는 O(1), Pop 은 탐색 없이 그 노드를
+  // 바로 지우고 부모 쪽 경로만 균형을 맞춘다
+  bool Min(int *x) const;
+  bool Max(int *x) const;
+  bool PopMin(int *x);
+  bool PopMax(int *x);
+
+  // 키 순서 [0, n) 을 순위가 같은 구간들로 나눠(O(구간 수 * log n))
+  // pool 에서 병렬로 처리한다. 한 구간 안에서는 키 순서대로 진행한다.
+  // fn(key) 는 여러 스레드에서 동시에 호출된다
+  template <typename Fn>
+  void ParallelForEach(Fn fn, AvlWorkPool &pool = AvlWorkPool::Default());
+  // combine(..combine(combine(identity, map(k1)), map(k2)).., map(kn)).
+  // combine 은 결합 법칙만 만족하면 된다 (구간별 결과를 키 순서로 합친다)
+  template <typename T, typename Map, typename Combine>
+  T ParallelReduce(T identity, Map map, Combine combine,
+                   AvlWorkPool &pool = AvlWorkPool::Default());
+
+  // 핑거 탐색 (선택): 마지막으로 접근한 노드에서 시작하여
+  // 거리 d 만큼 떨어진 키를 O(log d) 에 찾는다 (Find, Insert, Prev, Next,
+  // UpperBound). 읽기 명령도 핑거를 갱신하므로 동시에 읽을 때는 끈다
+  void EnableFinger(bool on);
+
+  // 조회 필터 (선택): 없는 키의 Find/Rank 는 Bloom 필터가 바로 거르고,
+  // 자주 찾는 키는 (노드, 깊이) 직접 사상 캐시에서 찾는다
+  void EnableLookupFilter(bool on);
+  const AvlLookupStats &lookup_stats() const { return stats_; }
+
+  AvlMemoryUsage MemoryUsage() const; // 현재 메모리 사용량, O(반환된 노드 수)
+
+  // 이후의 노드를 AvlNodeArena 에서 할당한다 (빈 집합에서만, 성공 시 true).
+  // 파생 클래스의 노드와 Load 의 slab 노드는 arena 를 쓰지 않는다
+  bool EnableArena(const AvlArenaOptions &options);
+  const AvlNodeArena *arena() const { return arena_.get(); }
+
+  // 스냅샷 (성공 시 true)
+  bool Save(const char *path); // 트리를 이진 스냅샷 파일로 저장
+  bool Load(const char *path); // 스냅샷 파일로부터 트리를 한 번에 복원
+
+  // 내구성 (선택)
+  void AttachLog(AvlSetLog *log); // 이후의 Insert/Erase 를 로그에 기록
+  bool Checkpoint(const char *snapshot_path); // 스냅샷 저장 후 로그 비우기
+  bool Recover(const char *snapshot_path,
+               const char *log_path); // 스냅샷 + 그 이후의 로그만 재생
+
 //private:  //for test code
   struct Node;
   Node *root_;
@@ -34,8 +669,106 @@ public:
   void ReBalance(Node *start_node); // 균형 맞추기
   Node *RotateLeft(Node *x);        // 좌측으로 회전
   Node *RotateRight(Node *y);       // 우측으로 회전
+  void Replace(Node *x, Node *y) { AvlReplace(this, x, y); }
+  static Node &At(Node *x) { return *x; } // AvlReBalance 등이 쓰는 접근자
+  Node *&RootSlot() { return root_; }
 
   Node *FindNode(int x); // 노드 반환
+  int InsertKey(int x);  // 출력 없이 삽입, Insert 가 출력할 값 반환
+  int EraseKey(int x);   // 출력 없이 삭제, Erase 가 출력할 값 반환
+  void EraseNode(Node *node); // 트리의 노드 하나를 삭제
+  AvlReply FindKey(int x); // 이하 같은 이름의 명령이 출력할 결과 반환
+  AvlReply PrevKey(int x);
+  AvlReply NextKey(int x);
+  AvlReply UpperBoundKey(int x);
+  AvlReply RankKey(int x);
+
+  bool finger_on_;
+  Node *finger_;     // 마지막으로 접근한 노드 (없으면 nullptr)
+  int finger_depth_; // finger_ 의 깊이
+  void SetFinger(Node *x, int depth); // 핑거를 켠 경우에만 갱신
+  // x 의 탐색 경로 위에 있는 노드를 핑거에서 올라가며 찾는다 (꺼져 있으면 루트)
+  Node *FingerStart(int x, int *depth, Node **bound);
+  Node *FindNodeFrom(int x, int *depth); // 핑거를 이용한 FindNode
+
+  struct CacheEntry {
+    Node *node;
+    int depth;
+    uint64_t epoch; // 저장할 때의 shape_epoch_
+  };
+  bool filter_on_;
+  AvlBloomFilter filter_;
+  size_t filter_stale_;      // 필터에 남아 있는 삭제된 키의 수
+  vector<CacheEntry> cache_; // 키의 해시로 위치가 정해지는 캐시
+  uint64_t shape_epoch_; // 회전, 삭제마다 증가 (이전 세대 캐시 항목은 무효)
+  AvlLookupStats stats_;
+  void RebuildFilter();                    // 트리의 키로 필터를 다시 만든다
+  Node *LookupNode(int x, int *depth);     // 필터, 캐시, 트리 순으로 조회
+  static size_t CacheSlot(int x) { return (uint32_t)x * 2654435761u >> 22; }
+  static const int kCacheSize = 1024;      // CacheSlot 의 범위 (2^10)
+
+  AvlSetLog *log_; // 연결된 작업 로그 (없으면 nullptr)
+  uint64_t epoch_; // 마지막 스냅샷의 세대 번호
+
+  // 가장 작은/큰 키의 노드 (빈 트리면 nullptr). 회전은 중위 순서를 바꾸지
+  // 않으므로 삽입/삭제만 한 칸씩 옮기고, 트리를 통째로 바꾸는 작업은
+  // ResetBounds 로 다시 찾는다
+  Node *leftmost_;
+  Node *rightmost_;
+  void ResetBounds(); // root_ 에서 양 끝까지 내려가 다시 찾는다, O(log n)
+
+  // 노드 메모리 관리
+  vector<pair<Node *, int>> slabs_; // Load 가 한 번에 할당한 노드 블록과 개수
+  Node *free_list_; // 삭제된 slab 노드 재사용 목록 (left 로 연결)
+  unique_ptr<AvlNodeArena> arena_; // 있으면 새 노드를 여기서 할당
+  virtual Node *NewNode(int x, Node *p = nullptr); // 노드 할당
+  virtual void DeleteNode(Node *x);                // 노드 해제
+  virtual size_t NodeBytes() const;                // 노드 하나의 크기
+  void Clear();                                    // 모든 노드 해제
+
+  // 증강(augmentation) 확장 지점: 파생 클래스가 노드에 추가 값을 유지할 때 사용
+  virtual void Augment(Node *) {} // ResizeHs 마지막에 호출 (자식은 최신 상태)
+
+  // 배치 탐색에서 동시에 진행하는 탐색 경로의 수
+  static const int kBatchGroup = 8;
+
+  // EraseIf: 펼침 작업 하나는 부분트리 전체(whole) 또는 노드 하나다
+  struct FlattenTask {
+    Node *node;
+    size_t offset; // 중위 순서 배열에서의 시작 위치
+    bool whole;
+  };
+  // 이보다 많이 지우면 다시 짓는 편이 빠르다. avlset_bench eraseif 로 잰
+  // 단일 코어의 교차점은 10~25% 사이이며, 코어가 많으면 더 낮아진다
+  static constexpr double kEraseIfRebuildFraction = 0.15;
+  static const size_t kParallelGrain = 16384; // 스레드 하나에 줄 최소 노드 수
+  static size_t WorkerCount(size_t items);    // items 개에 쓸 스레드 수
+  // 작업 0..count-1 을 실행한다. threads > 1 이면 공용 풀에서 나눠 실행한다
+  static void RunParallel(size_t count, size_t threads,
+                          const function<void(size_t)> &work);
+  static void PartitionSubtrees(Node *x, size_t chunk, size_t *offset,
+                                vector<FlattenTask> *tasks);
+  static void FlattenSubtree(Node *x, Node **out); // 중위 순서로 기록
+  // 정렬된 노드들로 균형 트리를 만든다 (threads > 1 이면 양쪽을 공용 풀에서)
+  Node *BuildBalanced(Node **nodes, size_t count, Node *parent, size_t threads);
+  size_t EraseFlagged(const vector<Node *> &nodes, const vector<char> &erase,
+                      double rebuild_fraction);
+
+  // 분할/결합: 떼어낸 부분트리는 꼭대기의 parent 가 nullptr 이다. 회전이
+  // root_ 를 덮어쓸 수 있으므로 호출한 쪽이 끝에서 root_ 를 다시 정한다
+  Node *Join(Node *l, Node *m, Node *r); // 키 l < m < r, 새 꼭대기 반환
+  Node *Join(Node *l, Node *r);          // 키 l < r
+  // t 를 x 보다 작은 (include 면 x 이하인) 키와 나머지 키로 나눈다
+  void Split(Node *t, int x, bool include, Node **less, Node **rest);
+  // [lo, hi] 의 키를 떼어내 그 노드들을 키 순서로 nodes 에 담는다
+  void CutRange(int lo, int hi, vector<Node *> *nodes);
+
+  // 병렬 순회: 구간 i 의 첫 노드와 노드 수로 body(first, count, i) 를 실행
+  Node *SelectNode(int k);          // k 번째(1부터) 노드
+  static Node *Successor(Node *x);  // 중위 순서의 다음 노드
+  size_t RangeCount(const AvlWorkPool &pool) const;
+  void ForEachRange(AvlWorkPool &pool,
+                    const function<void(Node *, int, size_t)> &body);
 };
 
 struct AvlSet::Node {
@@ -47,440 +780,5456 @@ struct AvlSet::Node {
   Node *left, *right, *parent;
 };
 
-int AvlSet::BalanceDegree(Node *x) {
-  if (!x) {
-    return 0;
+// 스냅샷 파일 형식: 헤더 + 전위 순회 순서의 노드 배열 (자식은 인덱스로 저장)
+struct AvlSnapshotHeader {
+  char magic[4];     // "AVLS"
+  uint32_t version;  // 파일 형식 버전
+  uint32_t count;    // 노드 개수
+  int32_t root;      // 루트 인덱스 (빈 트리면 -1)
+  uint64_t checksum; // 노드 배열의 FNV-1a 해시
+  uint64_t epoch;    // 스냅샷 세대 번호 (버전 2부터)
+};
+
+struct AvlSnapshotNode {
+  int32_t key;
+  int32_t height;
+  int32_t size;
+  int32_t left, right; // 자식 인덱스 (없으면 -1)
+};
+
+static const char kAvlSnapshotMagic[4] = {'A', 'V', 'L', 'S'};
+static const uint32_t kAvlSnapshotVersion = 2;
+
+// 버전 1 헤더에는 epoch 필드가 없다
+static size_t AvlSnapshotHeaderSize(uint32_t version) {
+  return (version == 1) ? offsetof(AvlSnapshotHeader, epoch)
+                        : sizeof(AvlSnapshotHeader);
+}
+
+static uint64_t AvlChecksum(const void *data, size_t len) {
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  uint64_t h = 1469598103934665603ULL;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
   }
-  int lh = (x->left) ? x->left->height : 0;
-  int rh = (x->right) ? x->right->height : 0;
-  return lh - rh;
+  return h;
 }
 
-void AvlSet::ResizeHs(Node *x) {
-  if (!x) {
-    return;
+// 스냅샷 파일을 mmap 하고 헤더, 인덱스 범위, 체크섬, 트리 모양을 검증한다
+class AvlSnapshotFile {
+public:
+  AvlSnapshotFile() : base_(nullptr), len_(0) {}
+  ~AvlSnapshotFile() { Close(); }
+  AvlSnapshotFile(const AvlSnapshotFile &) = delete;
+  AvlSnapshotFile &operator=(const AvlSnapshotFile &) = delete;
+
+  bool Open(const char *path);
+  void Close();
+
+  const AvlSnapshotHeader *header() const {
+    return static_cast<const AvlSnapshotHeader *>(base_);
+  }
+  const AvlSnapshotNode *nodes() const {
+    return reinterpret_cast<const AvlSnapshotNode *>(
+        static_cast<const char *>(base_) +
+        AvlSnapshotHeaderSize(header()->version));
+  }
+  uint64_t epoch() const {
+    return (header()->version == 1) ? 0 : header()->epoch;
   }
-  int lh = (x->left) ? x->left->height : 0;   // x의 왼쪽 자식 높이
-  int rh = (x->right) ? x->right->height : 0; // x의 오른쪽 자식 높이
-  x->height = 1 + ((lh > rh) ? lh : rh);
 
-  int ls = (x->left) ? x->left->size : 0;   // x의 왼쪽 자식 사이즈
-  int rs = (x->right) ? x->right->size : 0; // x의 오른쪽 자식 사이즈
-  x->size = 1 + ls + rs;
+private:
+  void *base_;
+  size_t len_;
+};
+
+bool AvlSnapshotFile::Open(const char *path) {
+  Close();
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < AvlSnapshotHeaderSize(1)) {
+    close(fd);
+    return false;
+  }
+  void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+  base_ = base;
+  len_ = st.st_size;
+
+  const AvlSnapshotHeader *h = header();
+  size_t body = (size_t)h->count * sizeof(AvlSnapshotNode);
+  bool ok = memcmp(h->magic, kAvlSnapshotMagic, 4) == 0 &&
+            h->version >= 1 && h->version <= kAvlSnapshotVersion &&
+            len_ == AvlSnapshotHeaderSize(h->version) + body &&
+            (h->count == 0 ? h->root == -1
+                           : (h->root >= 0 && (uint32_t)h->root < h->count)) &&
+            AvlChecksum(nodes(), body) == h->checksum;
+  // 잘못된 인덱스로 인해 범위 밖을 읽지 않도록 확인
+  for (uint32_t i = 0; ok && i < h->count; ++i) {
+    const AvlSnapshotNode &n = nodes()[i];
+    ok = n.left >= -1 && n.left < (int32_t)h->count && n.right >= -1 &&
+         n.right < (int32_t)h->count;
+  }
+  // 순환이나 공유 자식이 있으면 순회가 끝나지 않으므로 트리 모양을 확인:
+  // 루트 외의 노드는 정확히 한 번 참조되고, 루트에서 모든 노드에 닿아야 함
+  if (ok && h->count > 0) {
+    vector<uint8_t> refs(h->count, 0);
+    for (uint32_t i = 0; ok && i < h->count; ++i) {
+      for (int32_t c : {nodes()[i].left, nodes()[i].right}) {
+        ok = ok && (c < 0 || refs[c]++ == 0);
+      }
+    }
+    ok = ok && refs[h->root] == 0;
+    // 참조가 한 번뿐이므로 루트에서의 순회는 각 노드를 한 번만 방문한다
+    vector<int32_t> stack;
+    size_t reached = 0;
+    if (ok) {
+      stack.push_back(h->root);
+    }
+    while (!stack.empty()) {
+      const AvlSnapshotNode &n = nodes()[stack.back()];
+      stack.pop_back();
+      ++reached;
+      for (int32_t c : {n.left, n.right}) {
+        if (c >= 0) {
+          stack.push_back(c);
+        }
+      }
+    }
+    ok = ok && reached == h->count;
+  }
+  if (!ok) {
+    Close();
+  }
+  return ok;
 }
 
-AvlSet::Node *AvlSet::RotateLeft(Node *x) {
-  if (!x || !x->right) {
-    return x;
+void AvlSnapshotFile::Close() {
+  if (base_ != nullptr) {
+    munmap(base_, len_);
   }
-  Node *y = x->right;
-  Node *B = y->left;
+  base_ = nullptr;
+  len_ = 0;
+}
+
+// mmap 한 스냅샷을 복사 없이 그대로 사용하는 읽기 전용 트리.
+// 출력 형식은 AvlSet 과 같다
+class AvlSetView {
+public:
+  bool Open(const char *path) { return file_.Open(path); }
+
+  void Find(int x);
+  void Empty();
+  void Size();
+  void Prev(int x);
+  void Next(int x);
+  void UpperBound(int x);
+  void Rank(int x);
 
-  // x, y, B 재배치
-  y->left = x;
-  x->right = B;
+private:
+  AvlSnapshotFile file_;
 
-  // parent 갱신
-  y->parent = x->parent;
-  if (B) {
-    B->parent = x;
+  int Count() { return file_.header() ? (int)file_.header()->count : 0; }
+  int Root() { return file_.header() ? file_.header()->root : -1; }
+  const AvlSnapshotNode &At(int i) { return file_.nodes()[i]; }
+  void PrintResult(int idx, int depth); // key 와 깊이*높이 출력
+};
+
+// 컴파일 시간에 만드는 읽기 전용 집합. 정렬된 키 배열 위의 암시적 트리로,
+// 구간 [lo, hi) 의 루트는 가운데 원소 (lo + hi) / 2 이다. 양쪽 부분트리의
+// 크기 차가 1 이하이므로 AVL 트리이며, 이 모양의 AvlSet 과 같은 결과
+// (깊이*높이 포함)를 낸다. Prev/Next 는 x 가 없어도 x 보다 작은/큰 키를 찾는다.
+//   constexpr int kAllow[] = {3, 1, 4};
+//   constexpr StaticAvlSet allow(kAllow); // 중복 키는 하나만 남긴다
+template <size_t N> class StaticAvlSet {
+public:
+  constexpr explicit StaticAvlSet(const int (&keys)[N]);
+
+  constexpr int Size() const { return n_; }
+  constexpr bool Empty() const { return n_ == 0; }
+  constexpr AvlReply Find(int x) const;
+  constexpr AvlReply Rank(int x) const;
+  constexpr AvlReply UpperBound(int x) const;
+  constexpr AvlReply Prev(int x) const;
+  constexpr AvlReply Next(int x) const { return UpperBound(x); }
+  // 읽기 명령 하나를 실행 (Insert/Erase 는 지원하지 않으므로 -1)
+  constexpr AvlReply Execute(AvlOp op, int x) const;
+
+private:
+  static constexpr size_t kCap = N ? N : 1;
+  int keys_[kCap];        // 정렬된 키 (중위 순서 = 배열 순서)
+  uint8_t height_[kCap];  // 노드 높이
+  uint8_t depth_[kCap];   // 노드 깊이 (루트는 0)
+  int n_;
+
+  // [lo, hi) 구간의 부분트리를 만들고 높이를 돌려준다
+  constexpr int Build(int lo, int hi, int depth);
+  // x 보다 작은 키의 개수 (inclusive 면 x 이하), 탐색 경로를 따라 센다
+  constexpr int CountLess(int x, bool inclusive) const;
+  constexpr AvlReply Reply(int idx) const {
+    return MakeReply(keys_[idx], depth_[idx] * height_[idx]);
   }
-  x->parent = y;
+};
 
-  // x가 x의 부모의 어디에서 왔는지에 따른 재배치
-  if (!y->parent)
-    root_ = y;
-  else if (y->parent->left == x) {
-    y->parent->left = y;
-  } else {
-    y->parent->right = y;
+template <size_t N>
+constexpr StaticAvlSet<N>::StaticAvlSet(const int (&keys)[N])
+    : keys_{}, height_{}, depth_{}, n_(0) {
+  for (size_t i = 0; i < N; ++i) { // 삽입 정렬 (std::sort 는 constexpr 가 아님)
+    int key = keys[i];
+    int j = n_;
+    while (j > 0 && keys_[j - 1] > key) {
+      j--;
+    }
+    if (j > 0 && keys_[j - 1] == key) {
+      continue; // 중복
+    }
+    for (int k = n_; k > j; --k) {
+      keys_[k] = keys_[k - 1];
+    }
+    keys_[j] = key;
+    n_++;
   }
+  Build(0, n_, 0);
+}
 
-  ResizeHs(x);
-  ResizeHs(y);
+template <size_t N>
+constexpr int StaticAvlSet<N>::Build(int lo, int hi, int depth) {
+  if (lo >= hi) {
+    return 0;
+  }
+  int mid = (lo + hi) / 2;
+  int left = Build(lo, mid, depth + 1);
+  int right = Build(mid + 1, hi, depth + 1);
+  height_[mid] = (uint8_t)(1 + (left > right ? left : right));
+  depth_[mid] = (uint8_t)depth;
+  return height_[mid];
+}
 
-  return y;
+template <size_t N>
+constexpr int StaticAvlSet<N>::CountLess(int x, bool inclusive) const {
+  int lo = 0, hi = n_;
+  while (lo < hi) { // 루트부터 내려가는 경로와 같은 순서로 비교한다
+    int mid = (lo + hi) / 2;
+    if (keys_[mid] < x || (inclusive && keys_[mid] == x)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
 }
 
-AvlSet::Node *AvlSet::RotateRight(Node *y) {
-  if (!y || !y->left) {
-    return y;
+template <size_t N> constexpr AvlReply StaticAvlSet<N>::Find(int x) const {
+  int lo = 0, hi = n_;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (keys_[mid] == x) {
+      return MakeReply(depth_[mid] * height_[mid]);
+    }
+    if (keys_[mid] > x) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return MakeReply(-1);
+}
+
+template <size_t N> constexpr AvlReply StaticAvlSet<N>::Rank(int x) const {
+  int idx = CountLess(x, false);
+  if (idx == n_ || keys_[idx] != x) {
+    return MakeReply(-1);
   }
-  Node *x = y->left;
-  Node *B = x->right;
+  return MakeReply(depth_[idx] * height_[idx], idx + 1); // 중위 순서 = 순위
+}
 
-  x->right = y;
-  y->left = B;
+template <size_t N>
+constexpr AvlReply StaticAvlSet<N>::UpperBound(int x) const {
+  int idx = CountLess(x, true);
+  return idx == n_ ? MakeReply(-1) : Reply(idx);
+}
 
-  x->parent = y->parent;
-  if (B)
-    B->parent = y;
-  y->parent = x;
+template <size_t N> constexpr AvlReply StaticAvlSet<N>::Prev(int x) const {
+  int idx = CountLess(x, false);
+  return idx == 0 ? MakeReply(-1) : Reply(idx - 1);
+}
 
-  if (!x->parent)
-    root_ = x;
-  else if (x->parent->left == y) {
-    x->parent->left = x;
-  } else {
-    x->parent->right = x;
+template <size_t N>
+constexpr AvlReply StaticAvlSet<N>::Execute(AvlOp op, int x) const {
+  switch (op) {
+  case kOpFind:
+    return Find(x);
+  case kOpEmpty:
+    return MakeReply(Empty() ? 1 : 0);
+  case kOpSize:
+    return MakeReply(Size());
+  case kOpPrev:
+    return Prev(x);
+  case kOpNext:
+  case kOpUpperBound:
+    return UpperBound(x);
+  case kOpRank:
+    return Rank(x);
+  default:
+    return MakeReply(-1);
   }
+}
 
-  ResizeHs(y);
-  ResizeHs(x);
+// 작업 로그 파일 형식: 헤더 + 고정 길이 기록의 나열
+struct AvlLogHeader {
+  char magic[4];    // "AVLW"
+  uint32_t version; // 파일 형식 버전
+  uint64_t epoch;   // 이 로그가 이어지는 스냅샷의 세대 번호
+};
 
-  return x;
-}
+struct AvlLogRecord {
+  int32_t key;
+  uint16_t op;    // AvlSetLog::Op
+  uint16_t check; // key, op 로 계산한 검증 값 (중간에 끊긴 기록 감지)
+};
 
-void AvlSet::ReBalance(Node *start_node) {
-  Node *cur_node = start_node;
+// Insert/Erase 를 순서대로 덧붙이는 작업 로그.
+// group_size 개의 기록을 모아 한 번에 write 하고(그룹 커밋),
+// sync 가 켜져 있으면 커밋마다 fdatasync 로 디스크에 내린다
+class AvlSetLog {
+public:
+  enum Op : uint16_t { kInsert = 1, kErase = 2 };
 
-  while (cur_node) {
-    // 현재 노드의 height, size 재측정
-    ResizeHs(cur_node);
+  explicit AvlSetLog(int group_size = 64, bool sync = false)
+      : fd_(-1), epoch_(0), group_size_(group_size < 1 ? 1 : group_size),
+        sync_(sync), broken_(false) {}
+  ~AvlSetLog() { Close(); }
+  AvlSetLog(const AvlSetLog &) = delete;
+  AvlSetLog &operator=(const AvlSetLog &) = delete;
+
+  // 같은 세대의 로그면 이어 쓰고, 아니면 비우고 새로 시작한다
+  bool Open(const char *path, uint64_t epoch);
+  void Close();
+  // 기록 추가 (그룹이 차면 커밋). 로그가 깨졌으면 기록하지 않고 false
+  bool Append(Op op, int key);
+  bool Commit();               // 모아둔 기록을 파일에 기록
+  bool Reset(uint64_t epoch);  // 로그를 비우고 새 세대로 시작
+  uint64_t epoch() const { return epoch_; }
+  // 쓰기나 Reset 이 실패하여 이후 기록이 재생되지 않을 수 있는 상태.
+  // 다음에 Reset (Checkpoint) 이 성공할 때까지 Append/Commit 은 실패한다
+  bool broken() const { return broken_; }
+
+  // 로그 파일의 세대 번호와 온전한 기록들을 읽는다
+  static bool Read(const char *path, uint64_t *epoch,
+                   vector<AvlLogRecord> *records);
+
+private:
+  int fd_;
+  uint64_t epoch_;
+  int group_size_;
+  bool sync_;
+  bool broken_;
+  vector<AvlLogRecord> pending_; // 아직 커밋되지 않은 기록
+
+  static uint16_t Check(int32_t key, uint16_t op);
+  bool WriteAll(const void *data, size_t len);
+};
+
+static const char kAvlLogMagic[4] = {'A', 'V', 'L', 'W'};
+static const uint32_t kAvlLogVersion = 1;
+
+int AvlSet::BalanceDegree(Node *x) { return AvlBalanceOf(this, x); }
+
+void AvlSet::ResizeHs(Node *x) {
+  if (!x) {
+    return;
+  }
+  int lh = (x->left) ? x->left->height : 0;   // x의 왼쪽 자식 높이
+  int rh = (x->right) ? x->right->height : 0; // x의 오른쪽 자식 높이
+  x->height = 1 + ((lh > rh) ? lh : rh);
+
+  int ls = (x->left) ? x->left->size : 0;   // x의 왼쪽 자식 사이즈
+  int rs = (x->right) ? x->right->size : 0; // x의 오른쪽 자식 사이즈
+  x->size = 1 + ls + rs;
+
+  Augment(x);
+}
+
+AvlSet::Node *AvlSet::RotateLeft(Node *x) {
+  if (!x || !x->right) {
+    return x;
+  }
+  ++shape_epoch_; // 부분트리 전체의 깊이가 바뀐다
+  return AvlRotateLeft(this, x);
+}
+
+AvlSet::Node *AvlSet::RotateRight(Node *y) {
+  if (!y || !y->left) {
+    return y;
+  }
+  ++shape_epoch_;
+  return AvlRotateRight(this, y);
+}
+
+void AvlSet::ReBalance(Node *start_node) { AvlReBalance(this, start_node); }
+
+AvlSet::Node *AvlSet::FindNode(int x) {
+  Node *cur_node = root_;
+  while (cur_node != nullptr) {
+    if (cur_node->key == x) {
+      return cur_node;
+    }
+    if (cur_node->key > x) { // 왼쪽 자식으로 이동
+      cur_node = cur_node->left;
+    } else { // 오른쪽 자식으로 이동
+      cur_node = cur_node->right;
+    }
+  }
+  return nullptr;
+}
+
+void AvlSet::Find(int x) { PrintReply(FindKey(x)); }
+
+AvlReply AvlSet::FindKey(int x) {
+  int depth = 0;
+  Node *node = LookupNode(x, &depth);
+  if (node == nullptr) {
+    return MakeReply(-1); // 찾지 못함
+  }
+  return MakeReply(depth * node->height);
+}
+
+void AvlSet::EnableLookupFilter(bool on) {
+  filter_on_ = on;
+  stats_ = AvlLookupStats();
+  if (on) {
+    cache_.assign(kCacheSize, CacheEntry{nullptr, 0, 0});
+    RebuildFilter();
+  } else {
+    cache_ = vector<CacheEntry>();
+    filter_ = AvlBloomFilter();
+  }
+}
+
+void AvlSet::RebuildFilter() {
+  filter_.Reset(max<size_t>(1024, 2 * (size_t)n_)); // 다음 재구성까지 여유
+  filter_stale_ = 0;
+  vector<Node *> stack;
+  if (root_) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
+    filter_.Add(node->key);
+    if (node->left) {
+      stack.push_back(node->left);
+    }
+    if (node->right) {
+      stack.push_back(node->right);
+    }
+  }
+}
+
+AvlSet::Node *AvlSet::LookupNode(int x, int *depth) {
+  if (!filter_on_) {
+    return FindNodeFrom(x, depth);
+  }
+  ++stats_.lookups;
+  if (!filter_.MayContain(x)) {
+    ++stats_.filter_rejects;
+    return nullptr;
+  }
+
+  // 회전이나 삭제가 없었다면 저장해 둔 노드와 깊이가 그대로 유효하다
+  CacheEntry &entry = cache_[CacheSlot(x)];
+  if (entry.epoch == shape_epoch_ && entry.node->key == x) {
+    ++stats_.cache_hits;
+    *depth = entry.depth;
+    SetFinger(entry.node, entry.depth);
+    return entry.node;
+  }
+
+  Node *node = FindNodeFrom(x, depth);
+  if (node == nullptr) {
+    ++stats_.false_positives;
+  } else {
+    entry = CacheEntry{node, *depth, shape_epoch_};
+  }
+  return node;
+}
+
+void AvlSet::EnableFinger(bool on) {
+  finger_on_ = on;
+  finger_ = nullptr;
+}
+
+void AvlSet::SetFinger(Node *x, int depth) {
+  if (finger_on_) {
+    finger_ = x;
+    finger_depth_ = depth;
+  }
+}
+
+// 반환한 노드에서 내려가면 루트에서 내려간 것과 같은 노드에 도달한다.
+// *bound 에는 반환한 부분트리의 모든 키보다 큰 가장 가까운 조상이 담긴다
+// (알 수 없으면 nullptr)
+AvlSet::Node *AvlSet::FingerStart(int x, int *depth, Node **bound) {
+  *bound = nullptr;
+  if (!finger_on_ || finger_ == nullptr) {
+    *depth = 0;
+    return root_;
+  }
+
+  Node *cur_node = finger_;
+  int d = finger_depth_;
+  if (x > cur_node->key) {
+    // 왼쪽 자식에서 올라왔는데 부모가 x 보다 크면 x 는 현재 부분트리 범위 안
+    while (cur_node->parent) {
+      Node *p_node = cur_node->parent;
+      if (p_node->left == cur_node && x <= p_node->key) {
+        if (x == p_node->key) {
+          cur_node = p_node;
+          d--;
+        } else {
+          *bound = p_node;
+        }
+        break;
+      }
+      cur_node = p_node;
+      d--;
+    }
+  } else if (x < cur_node->key) {
+    while (cur_node->parent) {
+      Node *p_node = cur_node->parent;
+      if (p_node->right == cur_node && x >= p_node->key) {
+        if (x == p_node->key) {
+          cur_node = p_node;
+          d--;
+        }
+        break;
+      }
+      cur_node = p_node;
+      d--;
+    }
+  }
+  *depth = d;
+  return cur_node;
+}
+
+AvlSet::Node *AvlSet::FindNodeFrom(int x, int *depth) {
+  Node *bound;
+  Node *cur_node = FingerStart(x, depth, &bound);
+  Node *last_node = nullptr;
+  int last_depth = 0;
+
+  while (cur_node != nullptr) {
+    if (cur_node->key == x) {
+      SetFinger(cur_node, *depth);
+      return cur_node;
+    }
+    last_node = cur_node;
+    last_depth = *depth;
+
+    if (cur_node->key > x) { // 왼쪽 자식으로 이동
+      cur_node = cur_node->left;
+    } else {
+      cur_node = cur_node->right;
+    }
+    (*depth)++;
+  }
+
+  // 찾지 못해도 마지막으로 방문한 노드를 다음 탐색의 시작점으로 둔다
+  if (last_node != nullptr) {
+    SetFinger(last_node, last_depth);
+  }
+  return nullptr;
+}
+
+void AvlSet::Empty() { PrintReply(MakeReply(n_ == 0 ? 1 : 0)); }
+
+void AvlSet::Size() { PrintReply(MakeReply(n_)); }
+
+void AvlSet::Insert(int x) { PrintReply(MakeReply(InsertKey(x))); }
+
+int AvlSet::InsertKey(int x) {
+  Node *new_node = NewNode(x);
+  if (log_ != nullptr) {
+    log_->Append(AvlSetLog::kInsert, x);
+  }
+  if (filter_on_) {
+    if (filter_.count() >= filter_.capacity()) { // 오탐률이 오르기 전에 키움
+      RebuildFilter();
+    }
+    filter_.Add(x);
+  }
+
+  if (root_ == nullptr) { // 빈 트리일 경우
+    root_ = leftmost_ = rightmost_ = new_node;
+    ++n_;
+    SetFinger(new_node, 0);
+    return 0;
+  }
+
+  Node *p_node = nullptr;
+  int start_depth;
+  Node *bound;
+  Node *cur_node = FingerStart(x, &start_depth, &bound);
+
+  while (cur_node != nullptr) {
+    p_node = cur_node;
+
+    if (cur_node->key > x) { // 왼쪽 자식으로 이동
+      cur_node = cur_node->left;
+    } else { // 오른쪽 자식으로 이동
+      cur_node = cur_node->right;
+    }
+  }
+
+  new_node->parent = p_node;
+  if (p_node->key > x) {
+    p_node->left = new_node;
+  } else {
+    p_node->right = new_node;
+  }
+  if (x < leftmost_->key) {
+    leftmost_ = new_node;
+  } else if (x > rightmost_->key) {
+    rightmost_ = new_node;
+  }
+
+  ++n_;
+
+  // 삽입 후 재정렬
+  ReBalance(p_node);
+
+  if (finger_on_) { // 회전으로 깊이가 바뀌었으므로 부모를 따라 다시 센다
+    int depth = 0;
+    for (Node *t = new_node; t->parent != nullptr; t = t->parent) {
+      depth++;
+    }
+    SetFinger(new_node, depth);
+    return depth * new_node->height;
+  }
+
+  // 깊이 * 높이 출력
+  Node *result_node = root_;
+  int depth = 0;
+  while (result_node != nullptr && result_node->key != x) {
+    if (result_node->key > x) {
+      result_node = result_node->left;
+    } else {
+      result_node = result_node->right;
+    }
+    depth++;
+  }
+
+  return depth * result_node->height;
+}
+
+void AvlSet::Prev(int x) { PrintReply(PrevKey(x)); }
+
+AvlReply AvlSet::PrevKey(int x) {
+  int x_depth;
+  Node *x_node = FindNodeFrom(x, &x_depth);
+  Node *y_node = nullptr;
+
+  if (x_node->left) { // 왼쪽 자식이 있는 경우
+    y_node = x_node->left;
+    while (y_node->right) {
+      y_node = y_node->right;
+    }
+  } else { // 왼쪽 자식이 없는 경우
+    Node *cur_node = x_node;
+    Node *p_node = cur_node->parent;
+    while (p_node && p_node->left == cur_node) {
+      cur_node = p_node;
+      p_node = p_node->parent;
+    }
+    y_node = p_node;
+  }
+
+  // y_node가 없는 경우
+  if (y_node == nullptr) {
+    return MakeReply(-1);
+  }
+
+  // key값과 깊이 * 높이를 공백으로 구분하여 출력
+  int depth = 0;
+  for (Node *t = y_node; t && t->parent; t = t->parent) {
+    depth++;
+  }
+  SetFinger(y_node, depth);
+  return MakeReply(y_node->key, depth * y_node->height);
+}
+
+void AvlSet::Next(int x) { PrintReply(NextKey(x)); }
+
+AvlReply AvlSet::NextKey(int x) {
+  int x_depth;
+  Node *x_node = FindNodeFrom(x, &x_depth);
+  Node *y_node = nullptr;
+
+  if (x_node->right) { // 오른쪽 자식이 있는 경우
+    y_node = x_node->right;
+    while (y_node->left) {
+      y_node = y_node->left;
+    }
+  } else { // 오른쪽 자식이 없는 경우
+    Node *cur_node = x_node;
+    Node *p_node = cur_node->parent;
+    while (p_node && p_node->right == cur_node) {
+      cur_node = p_node;
+      p_node = p_node->parent;
+    }
+    y_node = p_node;
+  }
+  // y_node가 없는 경우
+  if (y_node == nullptr) {
+    return MakeReply(-1);
+  }
+
+  // key값과 깊이 * 높이를 공백으로 나눠서 출력
+  int depth = 0;
+  for (Node *t = y_node; t && t->parent; t = t->parent) {
+    depth++;
+  }
+
+  SetFinger(y_node, depth);
+  return MakeReply(y_node->key, depth * y_node->height);
+}
+
+void AvlSet::UpperBound(int x) { PrintReply(UpperBoundKey(x)); }
+
+AvlReply AvlSet::UpperBoundKey(int x) {
+  int start_depth;
+  Node *result_node = nullptr; // 부분트리에 답이 없으면 bound 가 답
+  Node *start_node = FingerStart(x, &start_depth, &result_node);
+  Node *cur_node = start_node;
+
+  while (cur_node) {
+    if (cur_node->key > x) {
+      result_node = cur_node;
+      cur_node = cur_node->left;
+    } else {
+      cur_node = cur_node->right;
+    }
+  }
+
+  if (!result_node && start_node != root_) { // 범위를 알 수 없으면 루트부터
+    for (cur_node = root_; cur_node;) {
+      if (cur_node->key > x) {
+        result_node = cur_node;
+        cur_node = cur_node->left;
+      } else {
+        cur_node = cur_node->right;
+      }
+    }
+  }
+
+  if (!result_node) {
+    return MakeReply(-1);
+  }
+
+  int depth = 0;
+
+  Node *t = result_node;
+  while (t != nullptr) {
+    if (t->parent != nullptr) {
+      depth++;
+      t = t->parent;
+    } else {
+      break;
+    }
+  }
+
+  SetFinger(result_node, depth);
+  return MakeReply(result_node->key, depth * result_node->height);
+}
+
+void AvlSet::Rank(int x) { PrintReply(RankKey(x)); }
+
+AvlReply AvlSet::RankKey(int x) {
+  if (filter_on_) { // 노드를 먼저 찾고 부모를 따라 올라가며 순위를 센다
+    int depth = 0;
+    Node *node = LookupNode(x, &depth);
+    if (node == nullptr) {
+      return MakeReply(-1);
+    }
+    int rank = (node->left ? node->left->size : 0) + 1;
+    for (Node *t = node; t->parent; t = t->parent) {
+      if (t->parent->right == t) {
+        Node *p = t->parent;
+        rank += (p->left ? p->left->size : 0) + 1;
+      }
+    }
+    return MakeReply(depth * node->height, rank);
+  }
+
+  Node *current = root_; // root부터 내려가며 탐색
+  int rank = 0;
+  int depth = 0;
+
+  while (current != nullptr) {
+    if (x < current->key) {
+      current = current->left;
+      depth++;
+    } else if (x > current->key) {
+      int leftsize = (current->left != nullptr) ? current->left->size
+                                                : 0; // 왼쪽 서브트리 크기
+      rank += leftsize + 1;                          // 왼쪽 + 현재 노드
+      current = current->right;
+      depth++;
+    } else { // x == cur->key (찾음)
+      int leftsize = (current->left != nullptr) ? current->left->size : 0;
+      rank += leftsize + 1;
+      return MakeReply(depth * current->height, rank);
+    }
+  }
+
+  return MakeReply(-1); // 못 찾은 경우
+}
+
+// kBatchGroup개의 탐색을 한 레벨씩 번갈아 진행한다.
+// 한 경로가 다음 자식을 prefetch 하는 동안 다른 경로들이 진행되므로
+// 레벨마다 발생하는 캐시 미스가 여러 질의에 걸쳐 겹쳐진다.
+vector<int> AvlSet::FindBatch(const vector<int> &xs) {
+  vector<int> result(xs.size(), -1);
+  Node *cur[kBatchGroup];
+  int depth[kBatchGroup];
+
+  for (size_t base = 0; base < xs.size(); base += kBatchGroup) {
+    int group = (int)min<size_t>(kBatchGroup, xs.size() - base);
+    for (int i = 0; i < group; ++i) {
+      cur[i] = root_;
+      depth[i] = 0;
+    }
+
+    int active = group;
+    while (active > 0) {
+      active = 0;
+      for (int i = 0; i < group; ++i) {
+        Node *node = cur[i];
+        if (node == nullptr) {
+          continue;
+        }
+        int x = xs[base + i];
+        if (node->key == x) { // 찾음: 이 경로는 종료
+          result[base + i] = depth[i] * node->height;
+          cur[i] = nullptr;
+          continue;
+        }
+        node = (node->key > x) ? node->left : node->right;
+        AVLSET_PREFETCH(node);
+        cur[i] = node;
+        depth[i]++;
+        if (node != nullptr) {
+          active++;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+vector<pair<int, int>> AvlSet::RankBatch(const vector<int> &xs) {
+  vector<pair<int, int>> result(xs.size(), make_pair(-1, 0));
+  Node *cur[kBatchGroup];
+  int depth[kBatchGroup];
+  int rank[kBatchGroup];
+
+  for (size_t base = 0; base < xs.size(); base += kBatchGroup) {
+    int group = (int)min<size_t>(kBatchGroup, xs.size() - base);
+    for (int i = 0; i < group; ++i) {
+      cur[i] = root_;
+      depth[i] = 0;
+      rank[i] = 0;
+    }
+
+    int active = group;
+    while (active > 0) {
+      active = 0;
+      for (int i = 0; i < group; ++i) {
+        Node *node = cur[i];
+        if (node == nullptr) {
+          continue;
+        }
+        int x = xs[base + i];
+        if (x < node->key) {
+          node = node->left;
+        } else {
+          int leftsize = (node->left != nullptr) ? node->left->size : 0;
+          rank[i] += leftsize + 1;
+          if (x == node->key) { // 찾음: 이 경로는 종료
+            result[base + i] = make_pair(depth[i] * node->height, rank[i]);
+            cur[i] = nullptr;
+            continue;
+          }
+          node = node->right;
+        }
+        AVLSET_PREFETCH(node);
+        cur[i] = node;
+        depth[i]++;
+        if (node != nullptr) {
+          active++;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+size_t AvlSet::WorkerCount(size_t items) {
+  size_t hw = max(1u, std::thread::hardware_concurrency());
+  return max<size_t>(1, min(hw, items / kParallelGrain));
+}
+
+void AvlSet::RunParallel(size_t count, size_t threads,
+                         const function<void(size_t)> &work) {
+  if (threads > 1 && count > 1) { // 호출마다 스레드를 만들지 않는다
+    AvlWorkPool::Default().ParallelFor(count, work);
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    work(i);
+  }
+}
+
+void AvlSet::PartitionSubtrees(Node *x, size_t chunk, size_t *offset,
+                               vector<FlattenTask> *tasks) {
+  if (!x) {
+    return;
+  }
+  if ((size_t)x->size <= chunk) { // 충분히 작은 부분트리는 통째로
+    tasks->push_back(FlattenTask{x, *offset, true});
+    *offset += x->size;
+    return;
+  }
+  PartitionSubtrees(x->left, chunk, offset, tasks);
+  tasks->push_back(FlattenTask{x, (*offset)++, false});
+  PartitionSubtrees(x->right, chunk, offset, tasks);
+}
+
+void AvlSet::FlattenSubtree(Node *x, Node **out) {
+  vector<Node *> stack;
+  while (x || !stack.empty()) {
+    while (x) {
+      stack.push_back(x);
+      x = x->left;
+    }
+    x = stack.back();
+    stack.pop_back();
+    *out++ = x;
+    x = x->right;
+  }
+}
+
+AvlSet::Node *AvlSet::BuildBalanced(Node **nodes, size_t count, Node *parent,
+                                    size_t threads) {
+  if (count == 0) {
+    return nullptr;
+  }
+  size_t mid = count / 2;
+  Node *x = nodes[mid];
+  x->parent = parent;
+  if (threads > 1 && count > 2 * kParallelGrain) {
+    // 작업 안에서 다시 ParallelFor 를 불러도 풀은 멈추지 않는다
+    RunParallel(2, threads, [&](size_t side) {
+      if (side == 0) {
+        x->left = BuildBalanced(nodes, mid, x, threads / 2);
+      } else {
+        x->right = BuildBalanced(nodes + mid + 1, count - mid - 1, x,
+                                 threads - threads / 2);
+      }
+    });
+  } else {
+    x->left = BuildBalanced(nodes, mid, x, 1);
+    x->right = BuildBalanced(nodes + mid + 1, count - mid - 1, x, 1);
+  }
+  ResizeHs(x); // 양쪽 크기 차가 1 이하이므로 AVL 조건을 만족한다
+  return x;
+}
+
+template <typename Pred>
+size_t AvlSet::EraseIf(Pred pred, double rebuild_fraction) {
+  if (root_ == nullptr) {
+    return 0;
+  }
+  // 부분트리 크기로 중위 순서의 위치를 알 수 있으므로 각 조각을 독립적으로
+  // 배열의 제자리에 펼칠 수 있다
+  size_t threads = WorkerCount(n_);
+  vector<FlattenTask> tasks;
+  size_t offset = 0;
+  PartitionSubtrees(root_, max<size_t>(kParallelGrain / 4, n_ / (4 * threads)),
+                    &offset, &tasks);
+
+  vector<Node *> nodes(n_);
+  vector<char> erase(n_);
+  RunParallel(tasks.size(), threads, [&](size_t i) {
+    const FlattenTask &task = tasks[i];
+    size_t count = task.whole ? task.node->size : 1;
+    if (task.whole) {
+      FlattenSubtree(task.node, &nodes[task.offset]);
+    } else {
+      nodes[task.offset] = task.node;
+    }
+    for (size_t j = task.offset; j < task.offset + count; ++j) {
+      erase[j] = pred(nodes[j]->key) ? 1 : 0;
+    }
+  });
+  return EraseFlagged(nodes, erase, rebuild_fraction);
+}
+
+size_t AvlSet::EraseFlagged(const vector<Node *> &nodes,
+                            const vector<char> &erase,
+                            double rebuild_fraction) {
+  vector<int> erased_keys;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (erase[i]) {
+      erased_keys.push_back(nodes[i]->key);
+    }
+  }
+  size_t k = erased_keys.size();
+  if (k == 0) {
+    return 0;
+  }
+  if (k < rebuild_fraction * nodes.size()) { // 적게 지울 때는 하나씩
+    for (int key : erased_keys) {
+      EraseKey(key);
+    }
+    return k;
+  }
+
+  // 남길 노드를 모으고 지울 노드는 해제한 뒤 다시 짓는다
+  if (log_ != nullptr) {
+    for (int key : erased_keys) {
+      log_->Append(AvlSetLog::kErase, key);
+    }
+  }
+  vector<Node *> kept;
+  kept.reserve(nodes.size() - k);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (erase[i]) {
+      DeleteNode(nodes[i]);
+    } else {
+      Node *node = nodes[i];
+      node->left = node->right = nullptr;
+      kept.push_back(node);
+    }
+  }
+  root_ = BuildBalanced(kept.data(), kept.size(), nullptr,
+                        WorkerCount(kept.size()));
+  ResetBounds();
+  n_ = (int)kept.size();
+  finger_ = nullptr;
+  ++shape_epoch_;
+  if (filter_on_) {
+    RebuildFilter();
+  }
+  return k;
+}
+
+AvlSet::Node *AvlSet::Join(Node *l, Node *m, Node *r) {
+  int lh = l ? l->height : 0;
+  int rh = r ? r->height : 0;
+  Node *p = nullptr; // m 을 매달 곳 (높이가 비슷하면 m 이 꼭대기)
+  if (lh > rh + 1) { // l 의 오른쪽 끝을 따라 높이가 rh + 1 이하인 곳까지
+    Node *c = l;
+    while (c && c->height > rh + 1) {
+      p = c;
+      c = c->right;
+    }
+    p->right = m;
+    l = c;
+  } else if (rh > lh + 1) {
+    Node *c = r;
+    while (c && c->height > lh + 1) {
+      p = c;
+      c = c->left;
+    }
+    p->left = m;
+    r = c;
+  }
+  m->parent = p;
+  m->left = l;
+  m->right = r;
+  if (l) {
+    l->parent = m;
+  }
+  if (r) {
+    r->parent = m;
+  }
+  ReBalance(m); // m 위의 경로만 높이가 바뀐다
+  while (m->parent) {
+    m = m->parent;
+  }
+  return m;
+}
+
+AvlSet::Node *AvlSet::Join(Node *l, Node *r) {
+  if (!l || !r) {
+    return l ? l : r;
+  }
+  Node *m = r; // r 의 최소 노드를 떼어 가운데로 쓴다
+  while (m->left) {
+    m = m->left;
+  }
+  Node *p = m->parent;
+  if (m->right) {
+    m->right->parent = p;
+  }
+  if (p) {
+    p->left = m->right;
+    ReBalance(p);
+    while (p->parent) {
+      p = p->parent;
+    }
+    r = p;
+  } else {
+    r = m->right;
+  }
+  return Join(l, m, r);
+}
+
+void AvlSet::Split(Node *t, int x, bool include, Node **less, Node **rest) {
+  if (!t) {
+    *less = *rest = nullptr;
+    return;
+  }
+  Node *l = t->left;
+  Node *r = t->right;
+  if (l) {
+    l->parent = nullptr;
+  }
+  if (r) {
+    r->parent = nullptr;
+  }
+  if (t->key < x || (include && t->key == x)) {
+    Node *r_less;
+    Split(r, x, include, &r_less, rest);
+    *less = Join(l, t, r_less);
+  } else {
+    Node *l_rest;
+    Split(l, x, include, less, &l_rest);
+    *rest = Join(l_rest, t, r);
+  }
+}
+
+void AvlSet::CutRange(int lo, int hi, vector<Node *> *nodes) {
+  nodes->clear();
+  if (root_ == nullptr || lo > hi) {
+    return;
+  }
+  Node *less, *rest, *cut, *greater;
+  Split(root_, lo, false, &less, &rest);
+  Split(rest, hi, true, &cut, &greater);
+  root_ = Join(less, greater);
+  ResetBounds();
+  // 지운 키가 없어도 자르고 다시 이으며 모양이 바뀌었으므로 핑거와 캐시의
+  // 깊이는 더 이상 맞지 않는다
+  finger_ = nullptr;
+  ++shape_epoch_;
+  if (cut == nullptr) {
+    return;
+  }
+
+  nodes->resize(cut->size);
+  FlattenSubtree(cut, nodes->data());
+  n_ -= cut->size;
+  if (log_ != nullptr) {
+    for (Node *node : *nodes) {
+      log_->Append(AvlSetLog::kErase, node->key);
+    }
+  }
+  filter_stale_ += nodes->size();
+  if (filter_on_ && filter_stale_ > filter_.capacity() / 4) {
+    RebuildFilter();
+  }
+}
+
+size_t AvlSet::EraseRange(int lo, int hi) {
+  vector<Node *> nodes;
+  CutRange(lo, hi, &nodes);
+  for (Node *node : nodes) {
+    DeleteNode(node);
+  }
+  return nodes.size();
+}
+
+unique_ptr<AvlSet> AvlSet::ExtractRange(int lo, int hi) {
+  unique_ptr<AvlSet> out(new AvlSet());
+  vector<Node *> nodes;
+  CutRange(lo, hi, &nodes);
+  if (nodes.empty()) {
+    return out;
+  }
+  if (!slabs_.empty() || arena_) { // 이 집합만 해제할 수 있는 노드가 있다
+    for (Node *&node : nodes) {
+      Node *copy = out->NewNode(node->key);
+      DeleteNode(node);
+      node = copy;
+    }
+  }
+  out->root_ = out->BuildBalanced(nodes.data(), nodes.size(), nullptr, 1);
+  out->ResetBounds();
+  out->n_ = (int)nodes.size();
+  return out;
+}
+
+AvlSet::Node *AvlSet::SelectNode(int k) {
+  Node *cur_node = root_;
+  while (cur_node) {
+    int left = cur_node->left ? cur_node->left->size : 0;
+    if (k <= left) {
+      cur_node = cur_node->left;
+    } else if (k == left + 1) {
+      return cur_node;
+    } else {
+      k -= left + 1;
+      cur_node = cur_node->right;
+    }
+  }
+  return nullptr;
+}
+
+AvlSet::Node *AvlSet::Successor(Node *x) {
+  if (x->right) {
+    x = x->right;
+    while (x->left) {
+      x = x->left;
+    }
+    return x;
+  }
+  while (x->parent && x->parent->right == x) {
+    x = x->parent;
+  }
+  return x->parent;
+}
+
+size_t AvlSet::RangeCount(const AvlWorkPool &pool) const {
+  // 스레드당 4 구간: 느린 구간이 있어도 남은 구간을 훔쳐 간다
+  return min<size_t>(n_, pool.size() * 4);
+}
+
+void AvlSet::ForEachRange(AvlWorkPool &pool,
+                          const function<void(Node *, int, size_t)> &body) {
+  size_t ranges = RangeCount(pool);
+  pool.ParallelFor(ranges, [&](size_t i) {
+    int begin = (int)(i * n_ / ranges), end = (int)((i + 1) * n_ / ranges);
+    body(SelectNode(begin + 1), end - begin, i);
+  });
+}
+
+template <typename Fn> void AvlSet::ParallelForEach(Fn fn, AvlWorkPool &pool) {
+  ForEachRange(pool, [&](Node *x, int count, size_t) {
+    for (int j = 0; j < count; ++j, x = Successor(x)) {
+      fn(x->key);
+    }
+  });
+}
+
+template <typename T, typename Map, typename Combine>
+T AvlSet::ParallelReduce(T identity, Map map, Combine combine,
+                         AvlWorkPool &pool) {
+  struct Slot { // vector<bool> 처럼 원소를 비트로 묶지 않도록 감싼다
+    T value;
+  };
+  vector<Slot> partial(RangeCount(pool), Slot{identity});
+  ForEachRange(pool, [&](Node *x, int count, size_t i) {
+    T acc = identity;
+    for (int j = 0; j < count; ++j, x = Successor(x)) {
+      acc = combine(acc, map(x->key));
+    }
+    partial[i].value = acc;
+  });
+  T result = identity;
+  for (const Slot &slot : partial) {
+    result = combine(result, slot.value);
+  }
+  return result;
+}
+
+void AvlSet::Erase(int x) { PrintReply(MakeReply(EraseKey(x))); }
+
+int AvlSet::EraseKey(int x) {
+  Node *node = FindNode(x);
+  if (node == nullptr) {
+    return -1;
+  }
+
+  // 노드의 깊이*높이 (삭제 전에 계산)
+  int depth = 0;
+  for (Node *t = node; (t != nullptr && t->parent != nullptr); t = t->parent)
+    depth++;
+  int result = depth * node->height;
+  EraseNode(node);
+  return result;
+}
+
+void AvlSet::EraseNode(Node *node) {
+  if (log_ != nullptr) {
+    log_->Append(AvlSetLog::kErase, node->key);
+  }
+  finger_ = nullptr; // 삭제와 회전으로 깊이가 바뀌므로 핑거를 버린다
+  ++shape_epoch_;
+  if (filter_on_ && ++filter_stale_ > filter_.capacity() / 4) {
+    // 필터에서는 지울 수 없으므로 삭제된 키가 많아지면 다시 만든다.
+    // 아직 트리에 남아 있는 이 키가 포함되지만 오탐 하나일 뿐이다
+    RebuildFilter();
+  }
+
+  // 양 끝 노드는 한쪽 자식이 없으므로 이웃 노드가 자식 아니면 부모다
+  if (node == leftmost_) {
+    leftmost_ = Successor(node);
+  }
+  if (node == rightmost_) {
+    rightmost_ = node->left;
+    if (rightmost_ == nullptr) {
+      rightmost_ = node->parent;
+    } else {
+      while (rightmost_->right != nullptr) {
+        rightmost_ = rightmost_->right;
+      }
+    }
+  }
+
+  Node *rebalance_from; // 높이와 크기가 바뀌는 가장 아래 노드
+
+  // 자식이 2개인 경우: 후임자를 떼어 node 자리에 옮겨 단다. 키와 부가 값을
+  // 복사하지 않으므로 남는 노드들의 주소는 바뀌지 않는다
+  if (node->left != nullptr && node->right != nullptr) {
+    Node *successor = node->right;
+    while (successor->left != nullptr) {
+      successor = successor->left;
+    }
+    if (successor->parent == node) {
+      rebalance_from = successor;
+    } else {
+      rebalance_from = successor->parent;
+      Replace(successor, successor->right);
+      successor->right = node->right;
+      successor->right->parent = successor;
+    }
+    Replace(node, successor);
+    successor->left = node->left;
+    successor->left->parent = successor;
+  } else { // 자식이 0개 또는 1개: 자식을 부모에 바로 연결
+    rebalance_from = node->parent;
+    Replace(node, (node->left != nullptr) ? node->left : node->right);
+  }
+
+  DeleteNode(node);
+  n_--;
+
+  if (rebalance_from != nullptr) {
+    ReBalance(rebalance_from); // 균형 재조정
+  }
+}
+
+void AvlSet::ResetBounds() {
+  leftmost_ = rightmost_ = root_;
+  if (root_ == nullptr) {
+    return;
+  }
+  while (leftmost_->left != nullptr) {
+    leftmost_ = leftmost_->left;
+  }
+  while (rightmost_->right != nullptr) {
+    rightmost_ = rightmost_->right;
+  }
+}
+
+bool AvlSet::Min(int *x) const {
+  if (leftmost_ == nullptr) {
+    return false;
+  }
+  *x = leftmost_->key;
+  return true;
+}
+
+bool AvlSet::Max(int *x) const {
+  if (rightmost_ == nullptr) {
+    return false;
+  }
+  *x = rightmost_->key;
+  return true;
+}
+
+bool AvlSet::PopMin(int *x) {
+  if (!Min(x)) {
+    return false;
+  }
+  EraseNode(leftmost_);
+  return true;
+}
+
+bool AvlSet::PopMax(int *x) {
+  if (!Max(x)) {
+    return false;
+  }
+  EraseNode(rightmost_);
+  return true;
+}
+
+AvlReply AvlSet::Execute(AvlOp op, int x) {
+  switch (op) {
+  case kOpFind:
+    return FindKey(x);
+  case kOpInsert:
+    return MakeReply(InsertKey(x));
+  case kOpEmpty:
+    return MakeReply(n_ == 0 ? 1 : 0);
+  case kOpSize:
+    return MakeReply(n_);
+  case kOpPrev:
+    return PrevKey(x);
+  case kOpNext:
+    return NextKey(x);
+  case kOpUpperBound:
+    return UpperBoundKey(x);
+  case kOpRank:
+    return RankKey(x);
+  case kOpErase:
+    return MakeReply(EraseKey(x));
+  default:
+    return MakeReply(-1);
+  }
+}
+
+AvlSet::~AvlSet() { Clear(); }
+
+AvlSet::Node *AvlSet::NewNode(int x, Node *p) {
+  if (free_list_ != nullptr) { // 반환된 slab 노드 재사용
+    Node *node = free_list_;
+    free_list_ = free_list_->left;
+    return new (node) Node(x, p);
+  }
+  if (arena_) {
+    return new (arena_->Allocate()) Node(x, p);
+  }
+  return new Node(x, p);
+}
+
+void AvlSet::DeleteNode(Node *x) {
+  for (const auto &slab : slabs_) {
+    if (x >= slab.first && x < slab.first + slab.second) {
+      x->left = free_list_; // slab 노드는 개별 해제하지 않고 목록에 보관
+      free_list_ = x;
+      return;
+    }
+  }
+  if (arena_) { // arena 를 켠 뒤의 slab 밖 노드는 모두 arena 노드
+    x->~Node();
+    arena_->Free(x);
+    return;
+  }
+  delete x;
+}
+
+bool AvlSet::EnableArena(const AvlArenaOptions &options) {
+  if (root_ != nullptr) {
+    return false;
+  }
+  arena_.reset(new AvlNodeArena(sizeof(Node), options));
+  return true;
+}
+
+size_t AvlSet::NodeBytes() const { return sizeof(Node); }
+
+AvlMemoryUsage AvlSet::MemoryUsage() const {
+  size_t slab_nodes = 0, free_nodes = 0;
+  for (const auto &slab : slabs_) {
+    slab_nodes += slab.second;
+  }
+  for (Node *t = free_list_; t != nullptr; t = t->left) {
+    free_nodes++;
+  }
+  // slab 과 arena 에 있지 않은 노드는 하나씩 new 로 할당되었다
+  size_t arena_nodes = arena_ ? arena_->live() : 0;
+  size_t heap_nodes = n_ - (slab_nodes - free_nodes) - arena_nodes;
+  size_t reserved = slab_nodes * sizeof(Node) +
+                    (arena_ ? arena_->reserved_bytes() : 0) +
+                    heap_nodes * AvlHeapChunkBytes(NodeBytes()) +
+                    filter_.bytes() + cache_.capacity() * sizeof(CacheEntry);
+  return MakeMemoryUsage(n_, n_ * NodeBytes(), reserved);
+}
+
+void AvlSet::Clear() {
+  // 재귀 없이 후위 순서로 해제
+  vector<Node *> stack;
+  if (root_) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
+    if (node->left) {
+      stack.push_back(node->left);
+    }
+    if (node->right) {
+      stack.push_back(node->right);
+    }
+    DeleteNode(node);
+  }
+  for (const auto &slab : slabs_) {
+    ::operator delete(slab.first);
+  }
+  slabs_.clear();
+  free_list_ = nullptr;
+  finger_ = nullptr;
+  ++shape_epoch_;
+  root_ = leftmost_ = rightmost_ = nullptr;
+  n_ = 0;
+  if (filter_on_) {
+    RebuildFilter();
+  }
+}
+
+bool AvlSet::Save(const char *path) {
+  // 전위 순회로 인덱스를 매기고 자식 인덱스를 채운다
+  vector<AvlSnapshotNode> nodes;
+  nodes.reserve(n_);
+  vector<pair<Node *, int>> stack; // (노드, 부모에서 채울 위치)
+  if (root_) {
+    stack.push_back(make_pair(root_, -1));
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back().first;
+    int slot = stack.back().second;
+    stack.pop_back();
+
+    int idx = (int)nodes.size();
+    if (slot >= 0) {
+      AvlSnapshotNode &parent = nodes[slot >> 1];
+      ((slot & 1) ? parent.right : parent.left) = idx;
+    }
+    nodes.push_back(
+        AvlSnapshotNode{node->key, node->height, node->size, -1, -1});
+    if (node->right) {
+      stack.push_back(make_pair(node->right, idx << 1 | 1));
+    }
+    if (node->left) {
+      stack.push_back(make_pair(node->left, idx << 1));
+    }
+  }
+
+  AvlSnapshotHeader header;
+  memcpy(header.magic, kAvlSnapshotMagic, 4);
+  header.version = kAvlSnapshotVersion;
+  header.count = (uint32_t)nodes.size();
+  header.root = nodes.empty() ? -1 : 0;
+  header.checksum =
+      AvlChecksum(nodes.data(), nodes.size() * sizeof(AvlSnapshotNode));
+  header.epoch = epoch_;
+
+  FILE *fp = fopen(path, "wb");
+  if (fp == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(nodes.data(), sizeof(AvlSnapshotNode), nodes.size(), fp) ==
+                nodes.size();
+  return (fclose(fp) == 0) && ok;
+}
+
+bool AvlSet::Load(const char *path) {
+  AvlSnapshotFile file;
+  if (!file.Open(path)) {
+    return false;
+  }
+  Clear();
+  epoch_ = file.epoch();
+
+  const AvlSnapshotHeader *h = file.header();
+  const AvlSnapshotNode *src = file.nodes();
+  int count = (int)h->count;
+  if (count == 0) {
+    return true;
+  }
+
+  // 모든 노드를 한 블록에 할당하고 한 번의 선형 순회로 연결
+  Node *slab = static_cast<Node *>(::operator new(sizeof(Node) * count));
+  slabs_.push_back(make_pair(slab, count));
+  for (int i = 0; i < count; ++i) {
+    new (&slab[i]) Node(src[i].key);
+  }
+  for (int i = 0; i < count; ++i) {
+    Node *node = &slab[i];
+    node->height = src[i].height;
+    node->size = src[i].size;
+    if (src[i].left >= 0) {
+      node->left = &slab[src[i].left];
+      node->left->parent = node;
+    }
+    if (src[i].right >= 0) {
+      node->right = &slab[src[i].right];
+      node->right->parent = node;
+    }
+  }
+  root_ = &slab[h->root];
+  n_ = count;
+  ResetBounds();
+  if (filter_on_) {
+    RebuildFilter();
+  }
+  return true;
+}
+
+void AvlSetView::PrintResult(int idx, int depth) {
+  cout << At(idx).key << ' ' << depth * At(idx).height << '\n';
+}
+
+void AvlSetView::Find(int x) {
+  int depth = 0;
+  for (int cur = Root(); cur >= 0; depth++) {
+    if (At(cur).key == x) {
+      cout << depth * At(cur).height << '\n';
+      return;
+    }
+    cur = (At(cur).key > x) ? At(cur).left : At(cur).right;
+  }
+  cout << -1 << '\n';
+}
+
+void AvlSetView::Empty() { cout << (Count() == 0 ? 1 : 0) << '\n'; }
+
+void AvlSetView::Size() { cout << Count() << '\n'; }
+
+// 부모 포인터가 없으므로 루트에서 내려가며 후보와 그 깊이를 기억한다
+void AvlSetView::Prev(int x) {
+  int result = -1, result_depth = 0;
+  int depth = 0;
+  for (int cur = Root(); cur >= 0; depth++) {
+    if (At(cur).key < x) {
+      result = cur;
+      result_depth = depth;
+      cur = At(cur).right;
+    } else {
+      cur = At(cur).left;
+    }
+  }
+  if (result < 0) {
+    cout << -1 << '\n';
+    return;
+  }
+  PrintResult(result, result_depth);
+}
+
+void AvlSetView::Next(int x) { UpperBound(x); }
+
+void AvlSetView::UpperBound(int x) {
+  int result = -1, result_depth = 0;
+  int depth = 0;
+  for (int cur = Root(); cur >= 0; depth++) {
+    if (At(cur).key > x) {
+      result = cur;
+      result_depth = depth;
+      cur = At(cur).left;
+    } else {
+      cur = At(cur).right;
+    }
+  }
+  if (result < 0) {
+    cout << -1 << '\n';
+    return;
+  }
+  PrintResult(result, result_depth);
+}
+
+void AvlSetView::Rank(int x) {
+  int rank = 0;
+  int depth = 0;
+  for (int cur = Root(); cur >= 0; depth++) {
+    const AvlSnapshotNode &node = At(cur);
+    int leftsize = (node.left >= 0) ? At(node.left).size : 0;
+    if (x < node.key) {
+      cur = node.left;
+    } else if (x > node.key) {
+      rank += leftsize + 1;
+      cur = node.right;
+    } else {
+      cout << depth * node.height << ' ' << rank + leftsize + 1 << '\n';
+      return;
+    }
+  }
+  cout << -1 << '\n';
+}
+
+void AvlSet::AttachLog(AvlSetLog *log) { log_ = log; }
+
+bool AvlSet::Checkpoint(const char *snapshot_path) {
+  // 커밋에 실패했거나 이미 깨진 로그라도 새 스냅샷이 모든 변경을 담으므로
+  // 계속 진행하고, 끝의 Reset 이 로그를 다시 쓸 수 있게 만든다
+  if (log_ != nullptr) {
+    log_->Commit();
+  }
+
+  // 임시 파일에 저장, fsync 후 rename 하여 스냅샷을 원자적으로 교체
+  string tmp = string(snapshot_path) + ".tmp";
+  ++epoch_;
+  bool ok = Save(tmp.c_str());
+  if (ok) {
+    int fd = open(tmp.c_str(), O_RDONLY);
+    ok = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  if (!ok || rename(tmp.c_str(), snapshot_path) != 0) {
+    --epoch_;
+    return false;
+  }
+  // rename 이 디스크에 남아야 로그를 비울 수 있다. 실패하면 로그를 그대로
+  // 두므로 예전 스냅샷이 되살아나도 그 세대의 로그가 재생된다
+  string dir(snapshot_path);
+  size_t slash = dir.find_last_of('/');
+  dir = slash == string::npos ? "." : slash == 0 ? "/" : dir.substr(0, slash);
+  int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  ok = dir_fd >= 0 && fsync(dir_fd) == 0;
+  if (dir_fd >= 0) {
+    close(dir_fd);
+  }
+  if (!ok) {
+    return false;
+  }
+
+  // 여기서 중단되어도 로그의 세대가 스냅샷보다 오래되었으므로 재생되지 않는다.
+  // Reset 이 실패하면 로그는 깨진 상태로 남아 이후 기록이 실패를 알린다.
+  // 세대는 로그와 맞춰 되돌리고, 다음 Checkpoint 가 같은 세대로 다시 쓴다
+  if (log_ != nullptr && !log_->Reset(epoch_)) {
+    --epoch_;
+    return false;
+  }
+  return true;
+}
+
+bool AvlSet::Recover(const char *snapshot_path, const char *log_path) {
+  AvlSetLog *log = log_;
+  log_ = nullptr; // 재생하는 작업은 다시 기록하지 않음
+
+  bool ok = true;
+  if (access(snapshot_path, F_OK) == 0) {
+    ok = Load(snapshot_path);
+  } else { // 스냅샷이 아직 없으면 빈 트리에서 로그 전체를 재생
+    Clear();
+    epoch_ = 0;
+  }
+
+  uint64_t log_epoch = 0;
+  vector<AvlLogRecord> records;
+  if (ok && AvlSetLog::Read(log_path, &log_epoch, &records) &&
+      log_epoch == epoch_) {
+    for (const AvlLogRecord &r : records) {
+      if (r.op == AvlSetLog::kInsert) {
+        InsertKey(r.key);
+      } else {
+        EraseKey(r.key);
+      }
+    }
+  }
+
+  log_ = log;
+  return ok;
+}
+
+uint16_t AvlSetLog::Check(int32_t key, uint16_t op) {
+  unsigned char buf[6];
+  memcpy(buf, &key, 4);
+  memcpy(buf + 4, &op, 2);
+  uint64_t h = AvlChecksum(buf, sizeof(buf));
+  return (uint16_t)(h ^ (h >> 16) ^ (h >> 32) ^ (h >> 48));
+}
+
+bool AvlSetLog::WriteAll(const void *data, size_t len) {
+  const char *p = static_cast<const char *>(data);
+  while (len > 0) {
+    ssize_t written = write(fd_, p, len);
+    if (written < 0) {
+      return false;
+    }
+    p += written;
+    len -= written;
+  }
+  return true;
+}
+
+bool AvlSetLog::Read(const char *path, uint64_t *epoch,
+                     vector<AvlLogRecord> *records) {
+  records->clear();
+  FILE *fp = fopen(path, "rb");
+  if (fp == nullptr) {
+    return false;
+  }
+  AvlLogHeader header;
+  bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+            memcmp(header.magic, kAvlLogMagic, 4) == 0 &&
+            header.version == kAvlLogVersion;
+  if (ok) {
+    *epoch = header.epoch;
+    // 마지막 기록이 중간에 끊겼거나 손상되었으면 그 앞까지만 사용
+    AvlLogRecord r;
+    while (fread(&r, sizeof(r), 1, fp) == 1 &&
+           (r.op == kInsert || r.op == kErase) &&
+           r.check == Check(r.key, r.op)) {
+      records->push_back(r);
+    }
+  }
+  fclose(fp);
+  return ok;
+}
+
+bool AvlSetLog::Open(const char *path, uint64_t epoch) {
+  Close();
+  broken_ = false;
+  uint64_t file_epoch = 0;
+  vector<AvlLogRecord> records;
+  bool resume = Read(path, &file_epoch, &records) && file_epoch == epoch;
+
+  fd_ = open(path, O_WRONLY | O_CREAT, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+  if (!resume) {
+    return Reset(epoch);
+  }
+
+  // 온전한 기록 뒤의 끊긴 부분을 잘라내고 이어쓴다
+  off_t end = sizeof(AvlLogHeader) + records.size() * sizeof(AvlLogRecord);
+  epoch_ = epoch;
+  broken_ = !(ftruncate(fd_, end) == 0 && lseek(fd_, end, SEEK_SET) == end);
+  return !broken_;
+}
+
+void AvlSetLog::Close() {
+  if (fd_ >= 0) {
+    Commit();
+    close(fd_);
+  }
+  fd_ = -1;
+  pending_.clear();
+}
+
+bool AvlSetLog::Append(Op op, int key) {
+  if (broken_) {
+    return false;
+  }
+  pending_.push_back(AvlLogRecord{key, op, Check(key, op)});
+  return (int)pending_.size() < group_size_ || Commit();
+}
+
+bool AvlSetLog::Commit() {
+  if (fd_ < 0 || broken_) {
+    return false;
+  }
+  if (pending_.empty()) {
+    return true;
+  }
+  bool ok = WriteAll(pending_.data(), pending_.size() * sizeof(AvlLogRecord));
+  pending_.clear();
+  // 반쯤 쓰인 기록 뒤의 기록은 읽히지 않으므로 더 이어 쓰지 않는다
+  broken_ = !(ok && (!sync_ || fdatasync(fd_) == 0));
+  return !broken_;
+}
+
+bool AvlSetLog::Reset(uint64_t epoch) {
+  if (fd_ < 0) {
+    return false;
+  }
+  pending_.clear();
+
+  AvlLogHeader header;
+  memcpy(header.magic, kAvlLogMagic, 4);
+  header.version = kAvlLogVersion;
+  header.epoch = epoch;
+  broken_ = !(ftruncate(fd_, 0) == 0 && lseek(fd_, 0, SEEK_SET) == 0 &&
+              WriteAll(&header, sizeof(header)) &&
+              (!sync_ || fdatasync(fd_) == 0));
+  if (!broken_) {
+    epoch_ = epoch;
+  }
+  return !broken_;
+}
+
+// 부분트리 합성값을 size 와 함께 유지하는 AvlSet.
+// Monoid 는 다음을 제공한다:
+//   using Value;                              노드에 붙는 값과 합성값의 타입
+//   static Value Identity();                  항등원
+//   static Value Combine(const Value &a, const Value &b);  결합 (키 순서대로)
+//   static Value FromKey(int key);            값 없이 삽입된 노드의 기본값
+// 합성값은 ResizeHs 에서 갱신되므로 RotateLeft/RotateRight 후에도 유지된다.
+// 노드 값을 담지 않는 스냅샷이나 AggNode 를 모르는 arena 할당이 AvlSet& 로도
+// 불리지 않도록 private 으로 상속하고 지원하는 기능만 다시 공개한다
+template <typename Monoid> class AvlAggSet : private AvlSet {
+public:
+  using Value = typename Monoid::Value;
+  using AvlSet::Node;
+
+  struct AggNode : Node {
+    AggNode(int k, Node *p)
+        : Node(k, p), value(Monoid::FromKey(k)), agg(value) {}
+    Value value; // 노드에 붙은 값
+    Value agg;   // 부분트리 값들을 키 순서대로 합성한 값
+  };
+
+  ~AvlAggSet() override { Clear(); } // 파생 노드 타입으로 해제
+
+  int InsertKey(int x, const Value &v); // 값과 함께 삽입
+  using AvlSet::InsertKey;
+  bool SetValue(int x, const Value &v); // 키 x 의 값 변경 (없으면 false)
+
+  Value Aggregate(int lo, int hi); // [lo, hi] 구간의 합성값, O(log n)
+  // 누적 가중치가 처음으로 w 이상이 되는 키 (없으면 -1).
+  // 값이 음수가 아닌 덧셈 모노이드에서만 의미가 있다
+  int KthByWeight(Value w);
+
+  // 키 단위 기능은 AvlSet 과 같다. 떼어낸 노드를 AvlSet 이 해제할 수 없는
+  // ExtractRange 와 노드 값을 잃는 스냅샷/로그, arena 는 공개하지 않는다
+  using AvlSet::Find;
+  using AvlSet::Insert;
+  using AvlSet::Empty;
+  using AvlSet::Size;
+  using AvlSet::Prev;
+  using AvlSet::Next;
+  using AvlSet::UpperBound;
+  using AvlSet::Rank;
+  using AvlSet::Erase;
+  using AvlSet::Execute;
+  using AvlSet::FindBatch;
+  using AvlSet::RankBatch;
+  using AvlSet::EraseIf;
+  using AvlSet::EraseRange;
+  using AvlSet::Min;
+  using AvlSet::Max;
+  using AvlSet::PopMin;
+  using AvlSet::PopMax;
+  using AvlSet::ParallelForEach;
+  using AvlSet::ParallelReduce;
+  using AvlSet::EnableFinger;
+  using AvlSet::EnableLookupFilter;
+  using AvlSet::lookup_stats;
+  using AvlSet::MemoryUsage;
+
+//private:  //for test code
+  using AvlSet::root_;
+  using AvlSet::n_;
+  using AvlSet::EraseKey;
+  using AvlSet::FindKey;
+  using AvlSet::PrevKey;
+  using AvlSet::NextKey;
+  using AvlSet::UpperBoundKey;
+  using AvlSet::RankKey;
+  using AvlSet::Clear;
+
+  static AggNode *Cast(Node *x) { return static_cast<AggNode *>(x); }
+  static Value AggOf(Node *x) { return x ? Cast(x)->agg : Monoid::Identity(); }
+
+  // arena 와 Load 의 slab 을 쓸 수 없으므로 모든 노드는 NewNode 가 만든다
+  Node *NewNode(int x, Node *p = nullptr) override { return new AggNode(x, p); }
+  void DeleteNode(Node *x) override { delete Cast(x); }
+  size_t NodeBytes() const override { return sizeof(AggNode); }
+  void Augment(Node *x) override {
+    Cast(x)->agg = Monoid::Combine(
+        Monoid::Combine(AggOf(x->left), Cast(x)->value), AggOf(x->right));
+  }
+};
+
+template <typename Monoid>
+int AvlAggSet<Monoid>::InsertKey(int x, const Value &v) {
+  int result = InsertKey(x);
+  SetValue(x, v);
+  return result;
+}
+
+template <typename Monoid>
+bool AvlAggSet<Monoid>::SetValue(int x, const Value &v) {
+  Node *node = FindNode(x);
+  if (node == nullptr) {
+    return false;
+  }
+  Cast(node)->value = v;
+  for (Node *t = node; t != nullptr; t = t->parent) { // 루트까지 합성값 갱신
+    Augment(t);
+  }
+  return true;
+}
+
+template <typename Monoid>
+typename AvlAggSet<Monoid>::Value AvlAggSet<Monoid>::Aggregate(int lo, int hi) {
+  // 두 경계의 탐색 경로가 갈라지는 노드를 찾는다
+  Node *split = root_;
+  while (split && (split->key < lo || split->key > hi)) {
+    split = (split->key < lo) ? split->right : split->left;
+  }
+  if (split == nullptr) {
+    return Monoid::Identity();
+  }
+
+  // 왼쪽 경로: lo 이상인 노드와 그 오른쪽 부분트리를 앞쪽에 덧붙인다
+  Value left = Monoid::Identity();
+  for (Node *t = split->left; t;) {
+    if (t->key >= lo) {
+      left = Monoid::Combine(
+          Monoid::Combine(Cast(t)->value, AggOf(t->right)), left);
+      t = t->left;
+    } else {
+      t = t->right;
+    }
+  }
+  // 오른쪽 경로: hi 이하인 노드와 그 왼쪽 부분트리를 뒤쪽에 덧붙인다
+  Value right = Monoid::Identity();
+  for (Node *t = split->right; t;) {
+    if (t->key <= hi) {
+      right = Monoid::Combine(
+          right, Monoid::Combine(AggOf(t->left), Cast(t)->value));
+      t = t->right;
+    } else {
+      t = t->left;
+    }
+  }
+  return Monoid::Combine(Monoid::Combine(left, Cast(split)->value), right);
+}
+
+template <typename Monoid> int AvlAggSet<Monoid>::KthByWeight(Value w) {
+  Node *t = root_;
+  while (t) {
+    Value left = AggOf(t->left);
+    if (w <= left) {
+      t = t->left;
+      continue;
+    }
+    w = w - left;
+    if (w <= Cast(t)->value) {
+      return t->key;
+    }
+    w = w - Cast(t)->value;
+    t = t->right;
+  }
+  return -1;
+}
+
+// 자주 쓰는 모노이드
+struct AvlSumMonoid { // 합 (기본값: 키)
+  using Value = long long;
+  static Value Identity() { return 0; }
+  static Value Combine(const Value &a, const Value &b) { return a + b; }
+  static Value FromKey(int key) { return key; }
+};
+
+struct AvlMinMonoid { // 최솟값 (기본값: 키)
+  using Value = long long;
+  static Value Identity() { return LLONG_MAX; }
+  static Value Combine(const Value &a, const Value &b) { return a < b ? a : b; }
+  static Value FromKey(int key) { return key; }
+};
+
+struct AvlMaxMonoid { // 최댓값 (기본값: 키)
+  using Value = long long;
+  static Value Identity() { return LLONG_MIN; }
+  static Value Combine(const Value &a, const Value &b) { return a > b ? a : b; }
+  static Value FromKey(int key) { return key; }
+};
+
+// 닫힌 구간 [low, high] 들의 집합 (구간 트리).
+// AvlSet 의 키는 구간의 시작점이고, 같은 시작점의 끝점들은 한 노드에
+// 내림차순으로 모아 둔다. 노드마다 부분트리의 가장 큰 끝점(max_high)을
+// Augment 로 유지하므로 ResizeHs 를 부르는 RotateLeft/RotateRight 후에도 맞다.
+// Stab/Overlap 은 max_high 로 겹칠 수 없는 부분트리를 건너뛰므로 결과 k 개에
+// 대해 O(min(n, (k + 1) log n)) 이다 (결과가 모여 있으면 O(log n + k) 에 가깝다).
+// 시작점 단위의 Insert/Erase 나 끝점을 담지 않는 스냅샷이 구간 수를 어긋나게
+// 하지 않도록 AvlSet 을 private 으로 상속하고 구간 API 만 공개한다
+class AvlIntervalSet : private AvlSet {
+public:
+  using Interval = pair<int, int>; // (low, high)
+  using AvlSet::Node;
+
+  struct IntervalNode : Node {
+    IntervalNode(int k, Node *p) : Node(k, p), max_high(INT_MIN) {}
+    vector<int> highs; // 이 시작점을 가진 구간들의 끝점 (내림차순)
+    int max_high;      // 부분트리 전체에서 가장 큰 끝점
+  };
+
+  ~AvlIntervalSet() override { Clear(); } // 파생 노드 타입으로 해제
+
+  bool InsertInterval(int low, int high); // 이미 있거나 low > high 면 false
+  bool EraseInterval(int low, int high);  // 없으면 false
+  size_t IntervalCount() const { return intervals_; }
+
+  vector<Interval> Stab(int x);               // x 를 포함하는 구간들
+  vector<Interval> Overlap(int low, int high); // [low, high] 와 겹치는 구간들
+  // 질의를 low 순으로 정렬해 트리를 한 번만 내려간다. 각 노드는 그 부분트리와
+  // 겹칠 수 있는 질의들과 함께 한 번 방문하므로 공통 경로를 다시 걷지 않는다.
+  // 결과는 입력 순서대로 돌려준다
+  vector<vector<Interval>> StabBatch(const vector<int> &xs);
+  vector<vector<Interval>> OverlapBatch(const vector<Interval> &ranges);
+
+  void Clear() {
+    AvlSet::Clear();
+    intervals_ = 0;
+  }
+  using AvlSet::MemoryUsage;
+
+//private:  //for test code
+  using AvlSet::root_;
+  size_t intervals_ = 0;
+
+  static IntervalNode *Cast(Node *x) { return static_cast<IntervalNode *>(x); }
+  static int MaxHighOf(Node *x) { return x ? Cast(x)->max_high : INT_MIN; }
+  void OverlapInto(int low, int high, vector<Interval> *out);
+  // x 의 부분트리를 중위 순서로 방문하며 (*active)[begin, end) 의 질의에 결과를
+  // 더한다. 자식에게 넘길 질의는 active 뒤에 이어 붙였다가 되돌린다
+  void OverlapBatchInto(Node *x, const vector<Interval> &ranges,
+                        vector<int> *active, size_t begin, size_t end,
+                        vector<vector<Interval>> *out);
+  void AugmentToRoot(Node *x); // x 부터 루트까지 max_high 갱신
+
+  Node *NewNode(int x, Node *p = nullptr) override {
+    return new IntervalNode(x, p);
+  }
+  void DeleteNode(Node *x) override { delete Cast(x); }
+  size_t NodeBytes() const override { return sizeof(IntervalNode); }
+  void Augment(Node *x) override {
+    int own = Cast(x)->highs.empty() ? INT_MIN : Cast(x)->highs[0];
+    Cast(x)->max_high = max(own, max(MaxHighOf(x->left), MaxHighOf(x->right)));
+  }
+};
+
+void AvlIntervalSet::AugmentToRoot(Node *x) {
+  for (Node *t = x; t != nullptr; t = t->parent) {
+    Augment(t);
+  }
+}
+
+bool AvlIntervalSet::InsertInterval(int low, int high) {
+  if (low > high) {
+    return false;
+  }
+  Node *node = FindNode(low);
+  if (node == nullptr) {
+    InsertKey(low);
+    node = FindNode(low);
+  }
+  vector<int> &highs = Cast(node)->highs;
+  auto pos = lower_bound(highs.begin(), highs.end(), high, greater<int>());
+  if (pos != highs.end() && *pos == high) {
+    return false;
+  }
+  highs.insert(pos, high);
+  AugmentToRoot(node);
+  intervals_++;
+  return true;
+}
+
+bool AvlIntervalSet::EraseInterval(int low, int high) {
+  Node *node = FindNode(low);
+  if (node == nullptr) {
+    return false;
+  }
+  vector<int> &highs = Cast(node)->highs;
+  auto pos = lower_bound(highs.begin(), highs.end(), high, greater<int>());
+  if (pos == highs.end() || *pos != high) {
+    return false;
+  }
+  highs.erase(pos);
+  intervals_--;
+  if (highs.empty()) {
+    EraseKey(low); // 재균형 경로에서 max_high 도 다시 계산된다
+  } else {
+    AugmentToRoot(node);
+  }
+  return true;
+}
+
+void AvlIntervalSet::OverlapInto(int low, int high, vector<Interval> *out) {
+  // 재귀 없이 중위 순서로 방문한다. max_high < low 인 부분트리는 건너뛴다
+  vector<Node *> stack;
+  Node *cur = root_;
+  while (cur != nullptr || !stack.empty()) {
+    while (cur != nullptr && Cast(cur)->max_high >= low) {
+      stack.push_back(cur);
+      cur = cur->left;
+    }
+    if (stack.empty()) {
+      break;
+    }
+    Node *node = stack.back();
+    stack.pop_back();
+    if (node->key > high) { // 이후 노드의 시작점은 모두 high 보다 크다
+      break;
+    }
+    for (int h : Cast(node)->highs) { // 내림차순이므로 low 미만에서 멈춘다
+      if (h < low) {
+        break;
+      }
+      out->push_back(make_pair(node->key, h));
+    }
+    cur = node->right;
+  }
+}
+
+vector<AvlIntervalSet::Interval> AvlIntervalSet::Stab(int x) {
+  vector<Interval> result;
+  OverlapInto(x, x, &result);
+  return result;
+}
+
+vector<AvlIntervalSet::Interval> AvlIntervalSet::Overlap(int low, int high) {
+  vector<Interval> result;
+  OverlapInto(low, high, &result);
+  return result;
+}
+
+vector<vector<AvlIntervalSet::Interval>>
+AvlIntervalSet::StabBatch(const vector<int> &xs) {
+  vector<Interval> ranges(xs.size());
+  for (size_t i = 0; i < xs.size(); ++i) {
+    ranges[i] = make_pair(xs[i], xs[i]);
+  }
+  return OverlapBatch(ranges);
+}
+
+vector<vector<AvlIntervalSet::Interval>>
+AvlIntervalSet::OverlapBatch(const vector<Interval> &ranges) {
+  vector<int> order(ranges.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = (int)i;
+  }
+  sort(order.begin(), order.end(),
+       [&](int a, int b) { return ranges[a] < ranges[b]; });
+  vector<vector<Interval>> result(ranges.size());
+  // low 순으로 정렬되어 있으므로 max_high 로 거르면 앞부분만 남는다
+  size_t end = 0;
+  while (end < order.size() && ranges[order[end]].first <= MaxHighOf(root_)) {
+    end++;
+  }
+  order.resize(end);
+  if (root_ != nullptr && end > 0) {
+    OverlapBatchInto(root_, ranges, &order, 0, end, &result);
+  }
+  return result;
+}
+
+void AvlIntervalSet::OverlapBatchInto(Node *x, const vector<Interval> &ranges,
+                                      vector<int> *active, size_t begin,
+                                      size_t end,
+                                      vector<vector<Interval>> *out) {
+  // 깊이는 트리 높이(O(log n))로 제한된다
+  size_t mark = active->size();
+  if (x->left != nullptr) { // 왼쪽 키는 모두 x->key 보다 작다
+    int left_high = MaxHighOf(x->left);
+    for (size_t i = begin; i < end; ++i) {
+      int q = (*active)[i];
+      if (ranges[q].first > left_high) { // low 순이므로 나머지도 겹치지 않는다
+        break;
+      }
+      active->push_back(q);
+    }
+    if (active->size() > mark) {
+      OverlapBatchInto(x->left, ranges, active, mark, active->size(), out);
+      active->resize(mark);
+    }
+  }
+  for (size_t i = begin; i < end; ++i) {
+    int q = (*active)[i];
+    if (x->key > ranges[q].second) {
+      continue;
+    }
+    for (int h : Cast(x)->highs) { // 내림차순이므로 low 미만에서 멈춘다
+      if (h < ranges[q].first) {
+        break;
+      }
+      (*out)[q].push_back(make_pair(x->key, h));
+    }
+  }
+  if (x->right != nullptr) { // 오른쪽 키는 모두 x->key 보다 크다
+    int right_high = MaxHighOf(x->right);
+    for (size_t i = begin; i < end; ++i) {
+      int q = (*active)[i];
+      if (ranges[q].first > right_high) {
+        break;
+      }
+      if (ranges[q].second > x->key) {
+        active->push_back(q);
+      }
+    }
+    if (active->size() > mark) {
+      OverlapBatchInto(x->right, ranges, active, mark, active->size(), out);
+      active->resize(mark);
+    }
+  }
+}
+
+// 키-값 정렬 맵. 값은 노드 안에 함께 저장되어 조회 한 번으로 얻는다.
+// 균형 규칙과 Rank/Prev/Next/UpperBound 의 의미는 AvlSet 과 같다 (키 비교는
+// Compare). 자식이 둘인 노드의 삭제는 키/값을 복사하지 않고 후임자 노드를
+// 그 자리로 옮겨 연결하므로, 다른 노드의 키/값 주소는 삭제 후에도 유효하다
+template <typename K, typename V, typename Compare = less<K>> class AvlMap {
+public:
+  struct Node {
+    template <typename KArg, typename... VArgs>
+    Node(Node *p, KArg &&k, VArgs &&...v)
+        : key(std::forward<KArg>(k)), value(std::forward<VArgs>(v)...),
+          height(1), size(1), left(nullptr), right(nullptr), parent(p) {}
+    const K key;
+    V value;
+    int height;
+    int size; // 해당 노드를 루트로 하는 부분트리의 노드 개수
+    Node *left, *right, *parent;
+  };
+
+  AvlMap() : root_(nullptr) {}
+  ~AvlMap() { Clear(); }
+  AvlMap(const AvlMap &) = delete;
+  AvlMap &operator=(const AvlMap &) = delete;
+
+  int Size() const { return root_ ? root_->size : 0; }
+  bool Empty() const { return root_ == nullptr; }
+  void Clear(); // 모든 노드 해제
+
+  // 키 k 와 값 인자로 노드를 먼저 만든 뒤 삽입한다. 이미 있으면 새 노드를
+  // 버린다. 반환값: (키의 값, 삽입 여부)
+  template <typename KArg, typename... VArgs>
+  pair<V *, bool> Emplace(KArg &&k, VArgs &&...v);
+  // 키가 없을 때만 값을 그 자리(노드 안)에서 만든다
+  template <typename... VArgs>
+  pair<V *, bool> TryEmplace(const K &k, VArgs &&...v);
+  bool Erase(const K &k); // 없으면 false
+
+  V *Find(const K &k); // 없으면 nullptr
+  const V *Find(const K &k) const;
+  int Rank(const K &k) const;              // 1부터 센 순위, 없으면 -1
+  Node *Kth(int k) const;                  // k 번째(1부터) 노드
+  Node *UpperBound(const K &k) const;      // k 보다 큰 가장 작은 키의 노드
+  Node *Prev(const K &k) const;            // k 보다 작은 가장 큰 키의 노드
+  Node *Next(const K &k) const { return UpperBound(k); }
+  int DepthHeight(const Node *x) const;    // AvlSet 이 출력하는 깊이*높이
+  template <typename Fn> void ForEach(Fn fn); // 키 순서로 fn(key, value)
+
+//private:  //for test code
+  Node *root_;
+  Compare less_;
+
+  static int HeightOf(Node *x) { return x ? x->height : 0; }
+  static int SizeOf(Node *x) { return x ? x->size : 0; }
+  static void ResizeHs(Node *x);
+  static Node &At(Node *x) { return *x; } // AvlReBalance 등이 쓰는 접근자
+  Node *&RootSlot() { return root_; }
+  void Replace(Node *x, Node *y) { AvlReplace(this, x, y); }
+  void RotateLeft(Node *x) { AvlRotateLeft(this, x); }
+  void RotateRight(Node *y) { AvlRotateRight(this, y); }
+  void ReBalance(Node *start_node) { AvlReBalance(this, start_node); }
+  // k 의 노드 또는 (없으면) 새 노드가 붙을 부모를 찾는다
+  Node *Locate(const K &k, Node **parent) const;
+  void Link(Node *node, Node *parent); // 빈 자리에 연결하고 재균형
+};
+
+template <typename K, typename V, typename C> void AvlMap<K, V, C>::Clear() {
+  vector<Node *> stack; // 재귀 없이 해제
+  if (root_) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
+    if (node->left) {
+      stack.push_back(node->left);
+    }
+    if (node->right) {
+      stack.push_back(node->right);
+    }
+    delete node;
+  }
+  root_ = nullptr;
+}
+
+template <typename K, typename V, typename C>
+void AvlMap<K, V, C>::ResizeHs(Node *x) {
+  x->height = 1 + max(HeightOf(x->left), HeightOf(x->right));
+  x->size = 1 + SizeOf(x->left) + SizeOf(x->right);
+}
+
+template <typename K, typename V, typename C>
+typename AvlMap<K, V, C>::Node *AvlMap<K, V, C>::Locate(const K &k,
+                                                        Node **parent) const {
+  Node *cur_node = root_;
+  *parent = nullptr;
+  while (cur_node) {
+    if (less_(k, cur_node->key)) {
+      *parent = cur_node;
+      cur_node = cur_node->left;
+    } else if (less_(cur_node->key, k)) {
+      *parent = cur_node;
+      cur_node = cur_node->right;
+    } else {
+      return cur_node;
+    }
+  }
+  return nullptr;
+}
+
+template <typename K, typename V, typename C>
+void AvlMap<K, V, C>::Link(Node *node, Node *parent) {
+  node->parent = parent;
+  if (!parent) {
+    root_ = node;
+    return;
+  }
+  if (less_(node->key, parent->key)) {
+    parent->left = node;
+  } else {
+    parent->right = node;
+  }
+  ReBalance(parent);
+}
+
+template <typename K, typename V, typename C>
+template <typename KArg, typename... VArgs>
+pair<V *, bool> AvlMap<K, V, C>::Emplace(KArg &&k, VArgs &&...v) {
+  Node *node = new Node(nullptr, std::forward<KArg>(k),
+                        std::forward<VArgs>(v)...);
+  Node *parent;
+  if (Node *found = Locate(node->key, &parent)) {
+    delete node;
+    return make_pair(&found->value, false);
+  }
+  Link(node, parent);
+  return make_pair(&node->value, true);
+}
+
+template <typename K, typename V, typename C>
+template <typename... VArgs>
+pair<V *, bool> AvlMap<K, V, C>::TryEmplace(const K &k, VArgs &&...v) {
+  Node *parent;
+  if (Node *found = Locate(k, &parent)) {
+    return make_pair(&found->value, false);
+  }
+  Node *node = new Node(parent, k, std::forward<VArgs>(v)...);
+  Link(node, parent);
+  return make_pair(&node->value, true);
+}
+
+template <typename K, typename V, typename C>
+bool AvlMap<K, V, C>::Erase(const K &k) {
+  Node *parent;
+  Node *node = Locate(k, &parent);
+  if (!node) {
+    return false;
+  }
+
+  Node *rebalance_from;
+  if (node->left && node->right) {
+    // 후임자를 떼어 node 자리에 옮겨 단다 (키/값 복사 없음)
+    Node *successor = node->right;
+    while (successor->left) {
+      successor = successor->left;
+    }
+    if (successor->parent == node) {
+      rebalance_from = successor;
+    } else {
+      rebalance_from = successor->parent;
+      Replace(successor, successor->right);
+      successor->right = node->right;
+      successor->right->parent = successor;
+    }
+    Replace(node, successor);
+    successor->left = node->left;
+    successor->left->parent = successor;
+  } else {
+    rebalance_from = node->parent;
+    Replace(node, node->left ? node->left : node->right);
+  }
+
+  delete node;
+  ReBalance(rebalance_from);
+  return true;
+}
+
+template <typename K, typename V, typename C>
+V *AvlMap<K, V, C>::Find(const K &k) {
+  Node *parent;
+  Node *node = Locate(k, &parent);
+  return node ? &node->value : nullptr;
+}
+
+template <typename K, typename V, typename C>
+const V *AvlMap<K, V, C>::Find(const K &k) const {
+  Node *parent;
+  Node *node = Locate(k, &parent);
+  return node ? &node->value : nullptr;
+}
+
+template <typename K, typename V, typename C>
+int AvlMap<K, V, C>::Rank(const K &k) const {
+  int rank = 0;
+  for (Node *cur_node = root_; cur_node;) {
+    if (less_(k, cur_node->key)) {
+      cur_node = cur_node->left;
+    } else {
+      rank += SizeOf(cur_node->left) + 1;
+      if (!less_(cur_node->key, k)) {
+        return rank;
+      }
+      cur_node = cur_node->right;
+    }
+  }
+  return -1;
+}
+
+template <typename K, typename V, typename C>
+typename AvlMap<K, V, C>::Node *AvlMap<K, V, C>::Kth(int k) const {
+  Node *cur_node = root_;
+  while (cur_node) {
+    int left = SizeOf(cur_node->left);
+    if (k <= left) {
+      cur_node = cur_node->left;
+    } else if (k == left + 1) {
+      return cur_node;
+    } else {
+      k -= left + 1;
+      cur_node = cur_node->right;
+    }
+  }
+  return nullptr;
+}
+
+template <typename K, typename V, typename C>
+typename AvlMap<K, V, C>::Node *
+AvlMap<K, V, C>::UpperBound(const K &k) const {
+  Node *result = nullptr;
+  for (Node *cur_node = root_; cur_node;) {
+    if (less_(k, cur_node->key)) {
+      result = cur_node;
+      cur_node = cur_node->left;
+    } else {
+      cur_node = cur_node->right;
+    }
+  }
+  return result;
+}
+
+template <typename K, typename V, typename C>
+typename AvlMap<K, V, C>::Node *AvlMap<K, V, C>::Prev(const K &k) const {
+  Node *result = nullptr;
+  for (Node *cur_node = root_; cur_node;) {
+    if (less_(cur_node->key, k)) {
+      result = cur_node;
+      cur_node = cur_node->right;
+    } else {
+      cur_node = cur_node->left;
+    }
+  }
+  return result;
+}
+
+template <typename K, typename V, typename C>
+int AvlMap<K, V, C>::DepthHeight(const Node *x) const {
+  int depth = 0;
+  for (const Node *t = x; t->parent; t = t->parent) {
+    depth++;
+  }
+  return depth * x->height;
+}
+
+template <typename K, typename V, typename C>
+template <typename Fn>
+void AvlMap<K, V, C>::ForEach(Fn fn) {
+  vector<Node *> stack;
+  Node *cur_node = root_;
+  while (cur_node || !stack.empty()) {
+    while (cur_node) {
+      stack.push_back(cur_node);
+      cur_node = cur_node->left;
+    }
+    cur_node = stack.back();
+    stack.pop_back();
+    fn(cur_node->key, cur_node->value);
+    cur_node = cur_node->right;
+  }
+}
+
+// 지연 삭제(tombstone)를 쓰는 AvlSet.
+// Erase 는 노드를 죽은 것으로 표시하고 부분트리의 살아 있는 키 수(live)만
+// 줄인다. 죽은 노드의 비율이 compact_ratio 를 넘으면 Compact 가 죽은 노드를
+// 한꺼번에 정리한다 (적으면 하나씩 지우고, 많으면 다시 짓는다).
+// 모든 질의는 죽은 노드를 건너뛰며 Size/Rank 는 live 로 계산한다.
+// 깊이*높이는 죽은 노드가 남아 있는 실제 트리 모양의 값이다.
+// 죽은 키를 구별하지 못하는 AvlSet 기능(Save/Load 와 작업 로그, 배치 조회,
+// 구간 삭제, Min/Max 등)이 AvlSet& 로도 불리지 않도록 private 으로 상속하고
+// 지원하는 것만 다시 공개한다
+class AvlLazySet : private AvlSet {
+public:
+  using AvlSet::Node;
+  struct LazyNode : Node {
+    LazyNode(int k, Node *p) : Node(k, p), dead(false), live(1) {}
+    bool dead;
+    int live; // 부분트리의 살아 있는 키 수
+  };
+
+  explicit AvlLazySet(double compact_ratio = 0.25)
+      : compact_ratio_(compact_ratio), tombstones_(0) {}
+  ~AvlLazySet() override { Clear(); } // 파생 노드 타입으로 해제
+
+  void Find(int x) { PrintReply(FindKey(x)); }
+  void Insert(int x) { PrintReply(MakeReply(InsertKey(x))); }
+  void Empty() { PrintReply(MakeReply(LiveSize() == 0 ? 1 : 0)); }
+  void Size() { PrintReply(MakeReply(LiveSize())); }
+  void Prev(int x) { PrintReply(PrevKey(x)); }
+  void Next(int x) { PrintReply(NextKey(x)); }
+  void UpperBound(int x) { PrintReply(UpperBoundKey(x)); }
+  void Rank(int x) { PrintReply(RankKey(x)); }
+  void Erase(int x) { PrintReply(MakeReply(EraseKey(x))); }
+  AvlReply Execute(AvlOp op, int x);
+
+  int LiveSize() const { return LiveOf(root_); }
+  size_t tombstones() const { return tombstones_; }
+  void Clear() {
+    AvlSet::Clear();
+    tombstones_ = 0;
+  }
+  void Compact(); // 죽은 노드를 모두 정리한다
+
+  int InsertKey(int x); // 죽은 노드가 있으면 되살린다
+  int EraseKey(int x);  // 표시만 한다
+  AvlReply FindKey(int x);
+  AvlReply PrevKey(int x);
+  AvlReply NextKey(int x);
+  AvlReply UpperBoundKey(int x);
+  AvlReply RankKey(int x);
+
+  using AvlSet::MemoryUsage;
+
+//private:  //for test code
+  using AvlSet::n_;
+  using AvlSet::root_;
+  double compact_ratio_; // 죽은 노드 / 전체 노드 가 이 비율을 넘으면 정리
+  size_t tombstones_;
+  static constexpr size_t kMinCompact = 64; // 이보다 적으면 정리하지 않는다
+
+  static LazyNode *Cast(Node *x) { return static_cast<LazyNode *>(x); }
+  static int LiveOf(Node *x) { return x ? Cast(x)->live : 0; }
+  static int DepthOf(Node *x);
+  Node *FindDepth(int x, int *depth); // 죽은 노드도 찾는다
+  int CountLive(int x, bool inclusive); // 살아 있는 키 중 x 미만(이하)의 수
+  Node *SelectLive(int k);              // 살아 있는 키 중 k 번째(1부터)
+  AvlReply ReplyOf(Node *x) {
+    return x ? MakeReply(x->key, DepthOf(x) * x->height) : MakeReply(-1);
+  }
+  void AddLiveToRoot(Node *x, int delta); // 경로의 live 만 고친다
+
+  Node *NewNode(int x, Node *p = nullptr) override {
+    return new LazyNode(x, p);
+  }
+  void DeleteNode(Node *x) override { delete Cast(x); }
+  size_t NodeBytes() const override { return sizeof(LazyNode); }
+  void Augment(Node *x) override {
+    Cast(x)->live =
+        (Cast(x)->dead ? 0 : 1) + LiveOf(x->left) + LiveOf(x->right);
+  }
+};
+
+int AvlLazySet::DepthOf(Node *x) {
+  int depth = 0;
+  for (Node *t = x; t->parent; t = t->parent) {
+    depth++;
+  }
+  return depth;
+}
+
+AvlSet::Node *AvlLazySet::FindDepth(int x, int *depth) {
+  *depth = 0;
+  for (Node *cur_node = root_; cur_node; ++*depth) {
+    if (cur_node->key == x) {
+      return cur_node;
+    }
+    cur_node = cur_node->key > x ? cur_node->left : cur_node->right;
+  }
+  return nullptr;
+}
+
+void AvlLazySet::AddLiveToRoot(Node *x, int delta) {
+  for (Node *t = x; t != nullptr; t = t->parent) {
+    Cast(t)->live += delta;
+  }
+}
+
+int AvlLazySet::CountLive(int x, bool inclusive) {
+  int count = 0;
+  for (Node *cur_node = root_; cur_node;) {
+    if (cur_node->key < x || (inclusive && cur_node->key == x)) {
+      count += LiveOf(cur_node->left) + (Cast(cur_node)->dead ? 0 : 1);
+      cur_node = cur_node->right;
+    } else {
+      cur_node = cur_node->left;
+    }
+  }
+  return count;
+}
+
+AvlSet::Node *AvlLazySet::SelectLive(int k) {
+  Node *cur_node = root_;
+  while (cur_node) {
+    int left = LiveOf(cur_node->left);
+    int own = Cast(cur_node)->dead ? 0 : 1;
+    if (k <= left) {
+      cur_node = cur_node->left;
+    } else if (k <= left + own) {
+      return cur_node;
+    } else {
+      k -= left + own;
+      cur_node = cur_node->right;
+    }
+  }
+  return nullptr;
+}
+
+int AvlLazySet::InsertKey(int x) {
+  int depth;
+  Node *node = FindDepth(x, &depth);
+  if (node == nullptr) {
+    return AvlSet::InsertKey(x);
+  }
+  if (!Cast(node)->dead) { // 이미 있는 키는 입력으로 주어지지 않는다
+    return depth * node->height;
+  }
+  Cast(node)->dead = false; // 죽은 노드를 되살린다
+  tombstones_--;
+  AddLiveToRoot(node, 1);
+  return depth * node->height;
+}
+
+int AvlLazySet::EraseKey(int x) {
+  int depth;
+  Node *node = FindDepth(x, &depth);
+  if (node == nullptr || Cast(node)->dead) {
+    return -1;
+  }
+  int result = depth * node->height; // AvlSet 처럼 삭제 전의 값
+  Cast(node)->dead = true;
+  tombstones_++;
+  AddLiveToRoot(node, -1);
+  if (tombstones_ >= kMinCompact && tombstones_ > compact_ratio_ * n_) {
+    Compact();
+  }
+  return result;
+}
+
+void AvlLazySet::Compact() {
+  if (tombstones_ == 0) {
+    return;
+  }
+  vector<Node *> nodes(n_);
+  FlattenSubtree(root_, nodes.data());
+  vector<char> dead(n_);
+  for (int i = 0; i < n_; ++i) {
+    dead[i] = Cast(nodes[i])->dead ? 1 : 0;
+  }
+  EraseFlagged(nodes, dead, kEraseIfRebuildFraction);
+  tombstones_ = 0;
+}
+
+AvlReply AvlLazySet::FindKey(int x) {
+  int depth;
+  Node *node = FindDepth(x, &depth);
+  if (node == nullptr || Cast(node)->dead) {
+    return MakeReply(-1);
+  }
+  return MakeReply(depth * node->height);
+}
+
+// AvlSet 과 같이 x 는 살아 있는 키여야 한다
+AvlReply AvlLazySet::PrevKey(int x) {
+  return ReplyOf(SelectLive(CountLive(x, false)));
+}
+
+AvlReply AvlLazySet::NextKey(int x) { return UpperBoundKey(x); }
+
+AvlReply AvlLazySet::UpperBoundKey(int x) {
+  return ReplyOf(SelectLive(CountLive(x, true) + 1));
+}
+
+AvlReply AvlLazySet::RankKey(int x) {
+  int depth;
+  Node *node = FindDepth(x, &depth);
+  if (node == nullptr || Cast(node)->dead) {
+    return MakeReply(-1);
+  }
+  return MakeReply(depth * node->height, CountLive(x, true));
+}
+
+AvlReply AvlLazySet::Execute(AvlOp op, int x) {
+  switch (op) {
+  case kOpFind:
+    return FindKey(x);
+  case kOpInsert:
+    return MakeReply(InsertKey(x));
+  case kOpEmpty:
+    return MakeReply(LiveSize() == 0 ? 1 : 0);
+  case kOpSize:
+    return MakeReply(LiveSize());
+  case kOpPrev:
+    return PrevKey(x);
+  case kOpNext:
+    return NextKey(x);
+  case kOpUpperBound:
+    return UpperBoundKey(x);
+  case kOpRank:
+    return RankKey(x);
+  case kOpErase:
+    return MakeReply(EraseKey(x));
+  default:
+    return MakeReply(-1);
+  }
+}
+
+// POSIX 공유 메모리에 노드를 두어 여러 프로세스가 함께 쓰는 AvlSet.
+// 링크는 주소 대신 세그먼트 안 노드 배열의 번호(0 은 없음)라서 프로세스마다
+// 다른 주소에 매핑해도 그대로 쓸 수 있다. 쓰기는 프로세스 공유 뮤텍스로
+// 한 번에 하나씩 하고, 바꾸는 동안 버전(seqlock)을 홀수로 둔다. 읽기는
+// 잠그지 않고 읽은 뒤 버전이 그대로인지 확인해 바뀌었으면 다시 읽으므로
+// 읽기 전용으로 매핑해도 된다. 균형 규칙과 명령의 결과는 AvlSet 과 같다
+// (삭제는 AvlMap 처럼 후임자 노드를 옮겨 단다). 노드 수는 Create 할 때
+// 정한 capacity 를 넘을 수 없다.
+// 쓰기 프로세스가 트리를 바꾸던 도중에 죽으면 트리를 되돌릴 수 없으므로
+// 세그먼트를 오염(poisoned)으로 표시하고, 이후의 읽기와 쓰기는 모두
+// runtime_error 를 던진다. 새 세그먼트를 만들어 다시 채워야 한다
+class AvlSharedSet {
+public:
+  struct Node {
+    int key;
+    int height;
+    int size;
+    uint32_t left, right, parent; // 노드 번호 (0 은 없음)
+  };
+  struct Header {
+    char magic[4]; // "AVLM"
+    uint32_t capacity;
+    uint32_t root;
+    uint32_t free_head; // 반환된 노드 목록 (left 로 연결)
+    uint32_t next_unused; // 아직 쓰지 않은 첫 번호
+    std::atomic<uint64_t> seq; // 홀수면 쓰는 중
+    std::atomic<int32_t> writer_pid; // 마지막으로 바꾸기 시작한 프로세스
+    std::atomic<uint32_t> poisoned;  // 0 이 아니면 트리가 깨졌을 수 있다
+    pthread_mutex_t writer;          // 쓰기 프로세스 사이의 상호 배제
+  };
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "프로세스 사이에서 쓰려면 lock-free 여야 한다");
+
+  AvlSharedSet() : base_(nullptr), bytes_(0), writable_(false) {}
+  ~AvlSharedSet() { Close(); }
+  AvlSharedSet(const AvlSharedSet &) = delete;
+  AvlSharedSet &operator=(const AvlSharedSet &) = delete;
+
+  // name 은 shm_open 이름 ("/" 로 시작). 이미 있으면 Create 는 실패한다
+  bool Create(const char *name, uint32_t capacity);
+  bool Open(const char *name, bool writable); // 읽기만 하면 writable=false
+  void Close();                               // 매핑 해제 (세그먼트는 남음)
+  static bool Unlink(const char *name);       // 세그먼트 삭제
+  size_t bytes() const { return bytes_; }
+
+  // 쓰기: AvlSet 과 같은 값을 돌려준다. 이미 있는 키의 Insert 는 Find 의
+  // 값을 돌려주고, 노드가 가득 차면 bad_alloc. 읽기 전용으로 열었으면
+  // 매핑에 쓸 수 없으므로 아무것도 바꾸지 않고 -1 을 돌려준다
+  int InsertKey(int x);
+  int EraseKey(int x);
+
+  // 읽기: 쓰기와 동시에 불러도 된다. Prev/Next 는 없는 키도 받는다
+  AvlReply FindKey(int x) const;
+  AvlReply PrevKey(int x) const;
+  AvlReply NextKey(int x) const { return UpperBoundKey(x); }
+  AvlReply UpperBoundKey(int x) const;
+  AvlReply RankKey(int x) const;
+  int Size() const;
+  uint64_t version() const { return header()->seq.load(); }
+  bool poisoned() const { return header()->poisoned.load() != 0; }
+  AvlReply Execute(AvlOp op, int x);
+
+//private:  //for test code
+  static const size_t kHeaderBytes = 256; // Header 를 담는 세그먼트 앞부분
+  static_assert(sizeof(Header) <= kHeaderBytes, "Header 가 너무 크다");
+  static const int kMaxDepth = 64; // 읽는 도중 깨진 링크에서 멈추기 위한 한도
+
+  char *base_;
+  size_t bytes_;
+  bool writable_;
+
+  Header *header() const { return reinterpret_cast<Header *>(base_); }
+  Node *nodes() const { return reinterpret_cast<Node *>(base_ + kHeaderBytes); }
+  Node &At(uint32_t i) const { return nodes()[i]; }
+  static size_t SegmentBytes(uint32_t capacity) {
+    return kHeaderBytes + ((size_t)capacity + 1) * sizeof(Node);
+  }
+  bool Map(int fd, size_t bytes, bool writable);
+
+  // 읽는 도중 쓰기가 끼어들었을 수 있으므로 번호를 검사한다
+  bool Valid(uint32_t i) const { return i <= header()->capacity; }
+  int HeightOf(uint32_t i) const { return i ? At(i).height : 0; }
+  int SizeOf(uint32_t i) const { return i ? At(i).size : 0; }
+  // 키 x 의 노드 번호와 깊이 (없으면 0)
+  uint32_t Locate(int x, uint32_t *parent, int *depth) const;
+  AvlReply ReplyOf(uint32_t i) const; // (key, 깊이*높이), 없으면 -1
+  template <typename Fn> AvlReply ReadConsistent(Fn fn) const;
+  bool WriterAlive() const; // 쓰는 중인 프로세스가 살아 있는지
+  [[noreturn]] static void ThrowPoisoned();
+
+  // 쓰기: 뮤텍스를 잡고, 트리를 바꾸는 동안에만 버전을 홀수로 둔다
+  void LockWriter();
+  void UnlockWriter() { pthread_mutex_unlock(&header()->writer); }
+  void BeginChange();
+  void EndChange();
+  void ResizeHs(uint32_t x);
+  uint32_t &RootSlot() { return header()->root; } // AvlReBalance 등이 쓴다
+  void Replace(uint32_t x, uint32_t y) { AvlReplace(this, x, y); }
+  void RotateLeft(uint32_t x) { AvlRotateLeft(this, x); }
+  void RotateRight(uint32_t y) { AvlRotateRight(this, y); }
+  void ReBalance(uint32_t start_node) { AvlReBalance(this, start_node); }
+};
+
+bool AvlSharedSet::Map(int fd, size_t bytes, bool writable) {
+  void *p = mmap(nullptr, bytes, PROT_READ | (writable ? PROT_WRITE : 0),
+                 MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  base_ = static_cast<char *>(p);
+  bytes_ = bytes;
+  writable_ = writable;
+  return true;
+}
+
+bool AvlSharedSet::Create(const char *name, uint32_t capacity) {
+  Close();
+  if (capacity == 0 || capacity >= UINT32_MAX) {
+    return false;
+  }
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  size_t bytes = SegmentBytes(capacity);
+  if (ftruncate(fd, (off_t)bytes) != 0 || !Map(fd, bytes, true)) {
+    shm_unlink(name);
+    return false;
+  }
+  Header *h = header(); // 새 세그먼트는 0 으로 채워져 있다
+  h->capacity = capacity;
+  h->root = 0;
+  h->free_head = 0;
+  h->next_unused = 1;
+  new (&h->seq) std::atomic<uint64_t>(0);
+  new (&h->writer_pid) std::atomic<int32_t>(0);
+  new (&h->poisoned) std::atomic<uint32_t>(0);
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  // 쓰던 프로세스가 죽어도 다음 쓰기가 멈추지 않는다
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&h->writer, &attr);
+  pthread_mutexattr_destroy(&attr);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(h->magic, "AVLM", 4); // 마지막에 써서 초기화 중에는 Open 이 실패
+  return true;
+}
+
+bool AvlSharedSet::Open(const char *name, bool writable) {
+  Close();
+  int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < kHeaderBytes ||
+      !Map(fd, (size_t)st.st_size, writable)) {
+    if (base_ == nullptr) {
+      close(fd);
+    }
+    return false;
+  }
+  if (memcmp(header()->magic, "AVLM", 4) != 0 ||
+      bytes_ < SegmentBytes(header()->capacity)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void AvlSharedSet::Close() {
+  if (base_ != nullptr) {
+    munmap(base_, bytes_);
+    base_ = nullptr;
+    bytes_ = 0;
+  }
+}
+
+bool AvlSharedSet::Unlink(const char *name) { return shm_unlink(name) == 0; }
+
+void AvlSharedSet::ThrowPoisoned() {
+  throw runtime_error("AvlSharedSet: a writer died while changing the tree");
+}
+
+void AvlSharedSet::LockWriter() {
+  Header *h = header();
+  if (pthread_mutex_lock(&h->writer) == EOWNERDEAD) {
+    // 이전 쓰기 프로세스가 뮤텍스를 잡은 채 죽었다. 버전이 홀수면 트리를
+    // 바꾸던 중이었으므로 트리를 믿을 수 없다 (짝수면 그대로 써도 된다)
+    if (h->seq.load(std::memory_order_relaxed) & 1) {
+      h->poisoned.store(1, std::memory_order_release);
+    }
+    pthread_mutex_consistent(&h->writer);
+  }
+  if (h->poisoned.load(std::memory_order_acquire)) {
+    pthread_mutex_unlock(&h->writer);
+    ThrowPoisoned();
+  }
+}
+
+void AvlSharedSet::BeginChange() {
+  header()->writer_pid.store((int32_t)getpid(), std::memory_order_relaxed);
+  header()->seq.fetch_add(1, std::memory_order_relaxed); // 홀수
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void AvlSharedSet::EndChange() {
+  header()->seq.fetch_add(1, std::memory_order_release); // 다시 짝수
+}
+
+bool AvlSharedSet::WriterAlive() const {
+  pid_t pid = (pid_t)header()->writer_pid.load(std::memory_order_acquire);
+  // 권한이 없어 보낼 수 없어도(EPERM) 프로세스는 있다
+  return pid <= 0 || kill(pid, 0) == 0 || errno == EPERM;
+}
+
+// fn 을 버전이 바뀌지 않은 상태에서 끝날 때까지 다시 실행한다. 쓰는 중이면
+// 점점 길게 기다리며, 가끔 쓰는 프로세스가 살아 있는지 확인한다
+template <typename Fn> AvlReply AvlSharedSet::ReadConsistent(Fn fn) const {
+  const unsigned kYieldSpins = 64;    // 그 뒤로는 잠깐씩 잠든다
+  const unsigned kLivenessEvery = 64; // 이만큼 기다릴 때마다 확인
+  for (unsigned waits = 0;;) {
+    uint64_t before = header()->seq.load(std::memory_order_acquire);
+    if (header()->poisoned.load(std::memory_order_acquire)) {
+      ThrowPoisoned();
+    }
+    if (before & 1) { // 쓰는 중
+      ++waits;
+      if (waits % kLivenessEvery == 0 && !WriterAlive()) {
+        ThrowPoisoned(); // 바꾸던 프로세스가 죽어 버전이 짝수로 돌아오지 않는다
+      }
+      if (waits < kYieldSpins) {
+        std::this_thread::yield();
+      } else {
+        usleep(50);
+      }
+      continue;
+    }
+    AvlReply reply = fn();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header()->seq.load(std::memory_order_relaxed) == before) {
+      return reply;
+    }
+  }
+}
+
+uint32_t AvlSharedSet::Locate(int x, uint32_t *parent, int *depth) const {
+  uint32_t cur_node = header()->root;
+  *parent = 0;
+  *depth = 0;
+  while (cur_node && Valid(cur_node) && *depth < kMaxDepth) {
+    const Node &node = At(cur_node);
+    if (node.key == x) {
+      return cur_node;
+    }
+    *parent = cur_node;
+    cur_node = (x < node.key) ? node.left : node.right;
+    ++*depth;
+  }
+  return 0;
+}
+
+AvlReply AvlSharedSet::ReplyOf(uint32_t i) const {
+  if (i == 0 || !Valid(i)) {
+    return MakeReply(-1);
+  }
+  int depth = 0;
+  for (uint32_t t = At(i).parent; t && Valid(t) && depth < kMaxDepth;
+       t = At(t).parent) {
+    depth++;
+  }
+  return MakeReply(At(i).key, depth * At(i).height);
+}
+
+AvlReply AvlSharedSet::FindKey(int x) const {
+  return ReadConsistent([&] {
+    uint32_t parent;
+    int depth;
+    uint32_t node = Locate(x, &parent, &depth);
+    return node ? MakeReply(depth * At(node).height) : MakeReply(-1);
+  });
+}
+
+AvlReply AvlSharedSet::PrevKey(int x) const {
+  return ReadConsistent([&] {
+    uint32_t result = 0, cur_node = header()->root;
+    for (int steps = 0; cur_node && Valid(cur_node) && steps < kMaxDepth;
+         ++steps) {
+      if (At(cur_node).key < x) {
+        result = cur_node;
+        cur_node = At(cur_node).right;
+      } else {
+        cur_node = At(cur_node).left;
+      }
+    }
+    return ReplyOf(result);
+  });
+}
+
+AvlReply AvlSharedSet::UpperBoundKey(int x) const {
+  return ReadConsistent([&] {
+    uint32_t result = 0, cur_node = header()->root;
+    for (int steps = 0; cur_node && Valid(cur_node) && steps < kMaxDepth;
+         ++steps) {
+      if (At(cur_node).key > x) {
+        result = cur_node;
+        cur_node = At(cur_node).left;
+      } else {
+        cur_node = At(cur_node).right;
+      }
+    }
+    return ReplyOf(result);
+  });
+}
+
+AvlReply AvlSharedSet::RankKey(int x) const {
+  return ReadConsistent([&] {
+    uint32_t cur_node = header()->root;
+    int rank = 0;
+    for (int depth = 0; cur_node && Valid(cur_node) && depth < kMaxDepth;
+         ++depth) {
+      const Node &node = At(cur_node);
+      if (x < node.key) {
+        cur_node = node.left;
+      } else {
+        rank += SizeOf(node.left) + 1;
+        if (node.key == x) {
+          return MakeReply(depth * node.height, rank);
+        }
+        cur_node = node.right;
+      }
+    }
+    return MakeReply(-1);
+  });
+}
+
+int AvlSharedSet::Size() const {
+  return ReadConsistent([&] {
+    uint32_t root = header()->root;
+    return MakeReply(root && Valid(root) ? At(root).size : 0);
+  }).v[0];
+}
+
+void AvlSharedSet::ResizeHs(uint32_t x) {
+  Node &node = At(x);
+  node.height = 1 + max(HeightOf(node.left), HeightOf(node.right));
+  node.size = 1 + SizeOf(node.left) + SizeOf(node.right);
+}
+
+int AvlSharedSet::InsertKey(int x) {
+  if (!writable_) {
+    return -1;
+  }
+  LockWriter(); // 잡고 있는 동안에는 다른 프로세스가 바꾸지 않는다
+  Header *h = header();
+  uint32_t parent;
+  int depth;
+  if (uint32_t found = Locate(x, &parent, &depth)) {
+    int result = depth * At(found).height;
+    UnlockWriter();
+    return result;
+  }
+  if (h->free_head == 0 && h->next_unused > h->capacity) {
+    UnlockWriter();
+    throw bad_alloc();
+  }
+
+  BeginChange();
+  uint32_t node;
+  if (h->free_head) {
+    node = h->free_head;
+    h->free_head = At(node).left;
+  } else {
+    node = h->next_unused++;
+  }
+  At(node) = Node{x, 1, 1, 0, 0, parent};
+  if (!parent) {
+    h->root = node;
+  } else {
+    if (x < At(parent).key) {
+      At(parent).left = node;
+    } else {
+      At(parent).right = node;
+    }
+    ReBalance(parent);
+  }
+  EndChange();
+  depth = 0; // 회전으로 깊이가 바뀌었으므로 다시 센다
+  for (uint32_t t = At(node).parent; t; t = At(t).parent) {
+    depth++;
+  }
+  int result = depth * At(node).height;
+  UnlockWriter();
+  return result;
+}
+
+int AvlSharedSet::EraseKey(int x) {
+  if (!writable_) {
+    return -1;
+  }
+  LockWriter();
+  uint32_t parent;
+  int depth;
+  uint32_t node = Locate(x, &parent, &depth);
+  if (!node) {
+    UnlockWriter();
+    return -1;
+  }
+  int result = depth * At(node).height; // AvlSet 처럼 삭제 전의 값
+
+  BeginChange();
+  uint32_t rebalance_from;
+  if (At(node).left && At(node).right) { // 후임자를 node 자리로 옮겨 단다
+    uint32_t successor = At(node).right;
+    while (At(successor).left) {
+      successor = At(successor).left;
+    }
+    if (At(successor).parent == node) {
+      rebalance_from = successor;
+    } else {
+      rebalance_from = At(successor).parent;
+      Replace(successor, At(successor).right);
+      At(successor).right = At(node).right;
+      At(At(successor).right).parent = successor;
+    }
+    Replace(node, successor);
+    At(successor).left = At(node).left;
+    At(At(successor).left).parent = successor;
+  } else {
+    rebalance_from = At(node).parent;
+    Replace(node, At(node).left ? At(node).left : At(node).right);
+  }
+  At(node).left = header()->free_head;
+  header()->free_head = node;
+  if (rebalance_from) {
+    ReBalance(rebalance_from);
+  }
+  EndChange();
+  UnlockWriter();
+  return result;
+}
+
+AvlReply AvlSharedSet::Execute(AvlOp op, int x) {
+  switch (op) {
+  case kOpFind:
+    return FindKey(x);
+  case kOpInsert:
+    return MakeReply(InsertKey(x));
+  case kOpEmpty:
+    return MakeReply(Size() == 0 ? 1 : 0);
+  case kOpSize:
+    return MakeReply(Size());
+  case kOpPrev:
+    return PrevKey(x);
+  case kOpNext:
+    return NextKey(x);
+  case kOpUpperBound:
+    return UpperBoundKey(x);
+  case kOpRank:
+    return RankKey(x);
+  case kOpErase:
+    return MakeReply(EraseKey(x));
+  default:
+    return MakeReply(-1);
+  }
+}
+
+// 64비트 키를 블록 단위로 압축 저장하는 변형.
+// 각 노드(블록)는 최대 kBlockCap 개의 정렬된 키를 블록의 최소 키(base)에 대한
+// 32비트 차이값으로 저장하고, AVL 균형은 블록 단위로 맞춘다.
+// size 는 부분트리의 키 개수 합이므로 Rank 를 그대로 계산할 수 있다
+class AvlBlockSet {
+public:
+  AvlBlockSet() : root_(nullptr), n_(0), blocks_(0) {}
+  ~AvlBlockSet();
+  AvlBlockSet(const AvlBlockSet &) = delete;
+  AvlBlockSet &operator=(const AvlBlockSet &) = delete;
+
+  bool Insert(int64_t x);   // 새 키면 삽입 후 true
+  bool Erase(int64_t x);    // 있으면 삭제 후 true
+  bool Contains(int64_t x); // 키 x 의 존재 여부
+  int Rank(int64_t x);      // x 의 순위 (1부터), 없으면 -1
+  int Size() const { return n_; }
+  bool Empty() const { return n_ == 0; }
+  size_t MemoryBytes() const; // 블록이 차지하는 바이트 수
+
+  template <typename Fn> void ForEach(Fn fn); // 오름차순으로 fn(key) 호출
+
+//private:  //for test code
+  static const int kBlockCap = 32;
+  static const int64_t kMaxDelta = 0xffffffffLL; // 차이값의 최대 범위
+
+  struct Block;
+  Block *root_;
+  int n_;      // 키 개수
+  int blocks_; // 블록 개수
+
+  void ResizeHs(Block *x);
+  static Block &At(Block *x) { return *x; } // AvlReBalance 등이 쓰는 접근자
+  Block *&RootSlot() { return root_; }
+  void ReBalance(Block *start_block) { AvlReBalance(this, start_block); }
+  Block *RotateLeft(Block *x) { return AvlRotateLeft(this, x); }
+  Block *RotateRight(Block *y) { return AvlRotateRight(this, y); }
+
+  Block *NewBlock(int64_t x, Block *p);
+  void AttachAfter(Block *b, Block *nb); // nb 를 b 의 중위 후임자로 연결
+  Block *Split(Block *b, int64_t x);     // 가득 찬 b 를 둘로 나눔
+  void InsertAt(Block *b, int64_t x);    // 블록 내부에 키 삽입
+  void RemoveBlock(Block *b);            // 빈 블록을 트리에서 제거
+  Block *FindBlock(int64_t x);           // x 를 범위에 포함하는 블록
+};
+
+struct AvlBlockSet::Block {
+  int64_t base;             // 블록의 최소 키
+  uint32_t delta[kBlockCap]; // key - base (오름차순)
+  int16_t count;            // 블록 내 키 개수
+  int16_t height;
+  int size; // 부분트리에 포함된 키의 개수
+  Block *left, *right, *parent;
+
+  int64_t Key(int i) const { return base + delta[i]; }
+  int64_t Max() const { return Key(count - 1); }
+  int LowerBound(int64_t x) const { // x 이상인 첫 위치
+    return (int)(std::lower_bound(delta, delta + count, (uint32_t)(x - base)) -
+                 delta);
+  }
+};
+
+AvlBlockSet::~AvlBlockSet() {
+  vector<Block *> stack;
+  if (root_) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Block *b = stack.back();
+    stack.pop_back();
+    if (b->left) {
+      stack.push_back(b->left);
+    }
+    if (b->right) {
+      stack.push_back(b->right);
+    }
+    delete b;
+  }
+}
+
+size_t AvlBlockSet::MemoryBytes() const { return blocks_ * sizeof(Block); }
+
+void AvlBlockSet::ResizeHs(Block *x) {
+  if (!x) {
+    return;
+  }
+  int lh = (x->left) ? x->left->height : 0;
+  int rh = (x->right) ? x->right->height : 0;
+  x->height = (int16_t)(1 + ((lh > rh) ? lh : rh));
+
+  int ls = (x->left) ? x->left->size : 0;
+  int rs = (x->right) ? x->right->size : 0;
+  x->size = x->count + ls + rs; // 노드 하나가 아닌 블록의 키 개수를 더함
+}
+
+AvlBlockSet::Block *AvlBlockSet::NewBlock(int64_t x, Block *p) {
+  Block *b = new Block;
+  b->base = x;
+  b->delta[0] = 0;
+  b->count = 1;
+  b->height = 1;
+  b->size = 1;
+  b->left = b->right = nullptr;
+  b->parent = p;
+  blocks_++;
+  return b;
+}
+
+void AvlBlockSet::AttachAfter(Block *b, Block *nb) {
+  if (b->right == nullptr) {
+    b->right = nb;
+    nb->parent = b;
+  } else {
+    Block *cur = b->right;
+    while (cur->left) {
+      cur = cur->left;
+    }
+    cur->left = nb;
+    nb->parent = cur;
+  }
+  ReBalance(nb->parent);
+}
+
+AvlBlockSet::Block *AvlBlockSet::Split(Block *b, int64_t x) {
+  // 위쪽 절반을 새 블록으로 옮긴다
+  int half = b->count / 2;
+  Block *nb = NewBlock(b->Key(half), nullptr);
+  nb->count = (int16_t)(b->count - half);
+  for (int i = 0; i < nb->count; ++i) {
+    nb->delta[i] = (uint32_t)(b->Key(half + i) - nb->base);
+  }
+  nb->size = nb->count;
+  b->count = (int16_t)half;
+
+  AttachAfter(b, nb);
+  return (x < nb->base) ? b : nb;
+}
+
+void AvlBlockSet::InsertAt(Block *b, int64_t x) {
+  if (x < b->base) { // 새 최소값: base 를 옮기고 차이값을 다시 계산
+    uint32_t shift = (uint32_t)(b->base - x);
+    for (int i = b->count; i > 0; --i) {
+      b->delta[i] = b->delta[i - 1] + shift;
+    }
+    b->delta[0] = 0;
+    b->base = x;
+  } else {
+    int pos = b->LowerBound(x);
+    memmove(b->delta + pos + 1, b->delta + pos,
+            (b->count - pos) * sizeof(uint32_t));
+    b->delta[pos] = (uint32_t)(x - b->base);
+  }
+  b->count++;
+}
+
+AvlBlockSet::Block *AvlBlockSet::FindBlock(int64_t x) {
+  Block *cur = root_;
+  while (cur) {
+    if (x < cur->base) {
+      cur = cur->left;
+    } else if (x > cur->Max()) {
+      cur = cur->right;
+    } else {
+      return cur;
+    }
+  }
+  return nullptr;
+}
+
+bool AvlBlockSet::Insert(int64_t x) {
+  if (root_ == nullptr) {
+    root_ = NewBlock(x, nullptr);
+    n_++;
+    return true;
+  }
+
+  Block *b = root_;
+  while (true) {
+    if (x < b->base) {
+      if (b->left) {
+        b = b->left;
+        continue;
+      }
+      // 왼쪽 끝: 여유가 있고 차이값 범위 안이면 b 에 합치고 아니면 새 블록
+      if (b->count < kBlockCap &&
+          (uint64_t)b->Max() - (uint64_t)x <= (uint64_t)kMaxDelta) {
+        InsertAt(b, x);
+      } else {
+        b->left = NewBlock(x, b);
+        b = b->left;
+      }
+      break;
+    }
+    if (x > b->Max()) {
+      if (b->right) {
+        b = b->right;
+        continue;
+      }
+      if (b->count < kBlockCap &&
+          (uint64_t)x - (uint64_t)b->base <= (uint64_t)kMaxDelta) {
+        InsertAt(b, x);
+      } else {
+        b->right = NewBlock(x, b);
+        b = b->right;
+      }
+      break;
+    }
+
+    // b 의 범위 안
+    int pos = b->LowerBound(x);
+    if (b->Key(pos) == x) {
+      return false;
+    }
+    if (b->count == kBlockCap) {
+      b = Split(b, x);
+    }
+    InsertAt(b, x);
+    break;
+  }
+
+  n_++;
+  ReBalance(b);
+  return true;
+}
+
+void AvlBlockSet::RemoveBlock(Block *b) {
+  Block *target = b;
+  if (b->left && b->right) { // 후임 블록의 내용을 옮기고 후임 블록을 제거
+    Block *successor = b->right;
+    while (successor->left) {
+      successor = successor->left;
+    }
+    b->base = successor->base;
+    b->count = successor->count;
+    memcpy(b->delta, successor->delta, successor->count * sizeof(uint32_t));
+    target = successor;
+  }
+
+  Block *child = (target->left) ? target->left : target->right;
+  Block *parent = target->parent;
+  if (child) {
+    child->parent = parent;
+  }
+  if (parent == nullptr) {
+    root_ = child;
+  } else if (parent->left == target) {
+    parent->left = child;
+  } else {
+    parent->right = child;
+  }
+
+  delete target;
+  blocks_--;
+  ReBalance(parent);
+}
+
+bool AvlBlockSet::Erase(int64_t x) {
+  Block *b = FindBlock(x);
+  if (b == nullptr) {
+    return false;
+  }
+  int pos = b->LowerBound(x);
+  if (b->Key(pos) != x) {
+    return false;
+  }
+
+  n_--;
+  if (b->count == 1) {
+    RemoveBlock(b);
+    return true;
+  }
+  if (pos == 0) { // 최소값 삭제: 다음 키를 새 base 로
+    uint32_t shift = b->delta[1];
+    for (int i = 1; i < b->count; ++i) {
+      b->delta[i - 1] = b->delta[i] - shift;
+    }
+    b->base += shift;
+  } else {
+    memmove(b->delta + pos, b->delta + pos + 1,
+            (b->count - pos - 1) * sizeof(uint32_t));
+  }
+  b->count--;
+  ReBalance(b);
+  return true;
+}
+
+bool AvlBlockSet::Contains(int64_t x) {
+  Block *b = FindBlock(x);
+  return b != nullptr && b->Key(b->LowerBound(x)) == x;
+}
+
+int AvlBlockSet::Rank(int64_t x) {
+  Block *cur = root_;
+  int rank = 0;
+  while (cur) {
+    if (x < cur->base) {
+      cur = cur->left;
+    } else if (x > cur->Max()) {
+      rank += ((cur->left) ? cur->left->size : 0) + cur->count;
+      cur = cur->right;
+    } else {
+      int pos = cur->LowerBound(x);
+      if (cur->Key(pos) != x) {
+        return -1;
+      }
+      return rank + ((cur->left) ? cur->left->size : 0) + pos + 1;
+    }
+  }
+  return -1;
+}
+
+template <typename Fn> void AvlBlockSet::ForEach(Fn fn) {
+  Block *cur = root_;
+  while (cur && cur->left) {
+    cur = cur->left;
+  }
+  while (cur) {
+    for (int i = 0; i < cur->count; ++i) { // 블록 안은 연속된 메모리
+      fn(cur->Key(i));
+    }
+    // 중위 후임 블록으로 이동
+    if (cur->right) {
+      cur = cur->right;
+      while (cur->left) {
+        cur = cur->left;
+      }
+    } else {
+      Block *child = cur;
+      cur = cur->parent;
+      while (cur && cur->right == child) {
+        child = cur;
+        cur = cur->parent;
+      }
+    }
+  }
+}
+
+// 캐시 라인 크기의 노드를 쓰는 B+ 트리 엔진. AvlSet 과 같은 명령을 제공한다.
+// 내부 노드는 자식별 키 개수(sizes)를 함께 저장하므로 순위 질의가 가능하다.
+// 모든 키는 같은 깊이의 리프에 있으므로 출력의 "깊이*높이"는
+// 리프 깊이 * 1 (= 트리 높이 - 1)로 흉내낸 엔진 고유의 값이다.
+// 삭제로 루트가 아닌 노드가 절반 미만이 되면 형제에게서 빌리거나 병합하므로
+// 노드 수는 키 수에 비례한다
+class BPlusSet {
+public:
+  BPlusSet() : root_(nullptr), levels_(0), n_(0) {}
+  ~BPlusSet();
+  BPlusSet(const BPlusSet &) = delete;
+  BPlusSet &operator=(const BPlusSet &) = delete;
+
+  void Find(int x) { PrintReply(Execute(kOpFind, x)); }
+  void Insert(int x) { PrintReply(Execute(kOpInsert, x)); }
+  void Empty() { PrintReply(Execute(kOpEmpty, 0)); }
+  void Size() { PrintReply(Execute(kOpSize, 0)); }
+  void Prev(int x) { PrintReply(Execute(kOpPrev, x)); }
+  void Next(int x) { PrintReply(Execute(kOpNext, x)); }
+  void UpperBound(int x) { PrintReply(Execute(kOpUpperBound, x)); }
+  void Rank(int x) { PrintReply(Execute(kOpRank, x)); }
+  void Erase(int x) { PrintReply(Execute(kOpErase, x)); }
+
+  AvlReply Execute(AvlOp op, int x); // 명령 하나를 출력 없이 실행
+  AvlMemoryUsage MemoryUsage() const; // 현재 메모리 사용량, O(노드 수)
+
+//private:  //for test code
+  static const int kLeafCap = 15; // 리프: 4 + 15*4 = 64바이트
+  static const int kInnerCap = 8; // 내부 노드: 4 + 7*4 + 8*4 + 8*8 = 128바이트
+  // 루트가 아닌 노드의 최소 키/자식 수 (분할 직후 노드의 크기와 같다)
+  static const int kLeafMin = kLeafCap / 2;
+  static const int kInnerMin = kInnerCap / 2;
+
+  // 노드가 캐시 라인 경계에서 시작해야 한 노드가 한두 줄에 들어간다
+  // (C++17 의 정렬된 new 가 alignas 를 지킨다)
+  struct alignas(64) Leaf {
+    int count;
+    int keys[kLeafCap];
+  };
+  struct alignas(64) Inner {
+    int count;                // 자식 개수
+    int keys[kInnerCap - 1];  // keys[i] = children[i + 1] 의 최소 키
+    int sizes[kInnerCap];     // 자식별 키 개수
+    void *children[kInnerCap];
+  };
+  static_assert(sizeof(Leaf) == 64 && alignof(Leaf) == 64,
+                "Leaf 는 캐시 라인 하나여야 한다");
+  static_assert(sizeof(Inner) == 128 && alignof(Inner) == 64,
+                "Inner 는 캐시 라인 두 개여야 한다");
+
+  void *root_;
+  int levels_; // 트리 높이 (리프만 있으면 1, 빈 트리면 0)
+  int n_;
+
+  int LeafDepthHeight() const { return levels_ - 1; }
+  int CountLess(int x, bool inclusive); // x 미만(inclusive 면 이하) 키의 개수
+  int Select(int k);                    // k 번째(1부터) 키
+  bool Contains(int x);
+
+  // 분할되면 새 오른쪽 노드와 그 최소 키를 돌려준다
+  bool InsertRec(void *node, int level, int x, void **split, int *split_key);
+  // 삭제 후 절반 미만이 된 자식은 형제와 맞춘다 (노드 자신은 부모가 맞춤)
+  bool EraseRec(void *node, int level, int x);
+  // in 의 idx 번째 자식(level)이 덜 찼으면 이웃 형제에게서 빌리거나 병합
+  static void FixChild(Inner *in, int idx, int level);
+  static void RemoveChild(Inner *in, int pos); // pos > 0 인 자식 칸을 지움
+  void FreeRec(void *node, int level);
+  // 부분트리의 리프와 내부 노드 수를 더한다
+  static void CountRec(void *node, int level, size_t *leaves, size_t *inners);
+  static int ChildIndex(const Inner *in, int x); // x 가 속한 자식 위치
+  static int NodeSize(void *node, int level);
+  static int EntryCount(void *node, int level) { // 키 또는 자식 개수
+    return (level == 0) ? static_cast<Leaf *>(node)->count
+                        : static_cast<Inner *>(node)->count;
+  }
+};
+
+BPlusSet::~BPlusSet() {
+  if (root_) {
+    FreeRec(root_, levels_ - 1);
+  }
+}
+
+void BPlusSet::FreeRec(void *node, int level) {
+  if (level == 0) {
+    delete static_cast<Leaf *>(node);
+    return;
+  }
+  Inner *in = static_cast<Inner *>(node);
+  for (int i = 0; i < in->count; ++i) {
+    FreeRec(in->children[i], level - 1);
+  }
+  delete in;
+}
+
+void BPlusSet::CountRec(void *node, int level, size_t *leaves,
+                        size_t *inners) {
+  if (level == 0) {
+    (*leaves)++;
+    return;
+  }
+  Inner *in = static_cast<Inner *>(node);
+  (*inners)++;
+  for (int i = 0; i < in->count; ++i) {
+    CountRec(in->children[i], level - 1, leaves, inners);
+  }
+}
+
+AvlMemoryUsage BPlusSet::MemoryUsage() const {
+  size_t leaves = 0, inners = 0;
+  if (root_) {
+    CountRec(root_, levels_ - 1, &leaves, &inners);
+  }
+  // 노드 안의 빈 칸도 노드 바이트에 포함된다 (키 바이트와 비교할 것)
+  return MakeMemoryUsage(
+      n_, leaves * sizeof(Leaf) + inners * sizeof(Inner),
+      leaves * AvlHeapChunkBytes(sizeof(Leaf)) +
+          inners * AvlHeapChunkBytes(sizeof(Inner)));
+}
+
+int BPlusSet::ChildIndex(const Inner *in, int x) {
+  return (int)(std::upper_bound(in->keys, in->keys + in->count - 1, x) -
+               in->keys);
+}
+
+int BPlusSet::NodeSize(void *node, int level) {
+  if (level == 0) {
+    return static_cast<Leaf *>(node)->count;
+  }
+  Inner *in = static_cast<Inner *>(node);
+  int total = 0;
+  for (int i = 0; i < in->count; ++i) {
+    total += in->sizes[i];
+  }
+  return total;
+}
+
+int BPlusSet::CountLess(int x, bool inclusive) {
+  int result = 0;
+  void *node = root_;
+  for (int level = levels_ - 1; node && level > 0; --level) {
+    Inner *in = static_cast<Inner *>(node);
+    int idx = ChildIndex(in, x);
+    for (int i = 0; i < idx; ++i) {
+      result += in->sizes[i];
+    }
+    node = in->children[idx];
+  }
+  if (node) {
+    Leaf *leaf = static_cast<Leaf *>(node);
+    int *end = leaf->keys + leaf->count;
+    int *pos = inclusive ? std::upper_bound(leaf->keys, end, x)
+                         : std::lower_bound(leaf->keys, end, x);
+    result += (int)(pos - leaf->keys);
+  }
+  return result;
+}
+
+int BPlusSet::Select(int k) {
+  void *node = root_;
+  for (int level = levels_ - 1; level > 0; --level) {
+    Inner *in = static_cast<Inner *>(node);
+    int i = 0;
+    while (k > in->sizes[i]) { // 크기 합으로 k 번째 키가 있는 자식을 고른다
+      k -= in->sizes[i];
+      i++;
+    }
+    node = in->children[i];
+  }
+  return static_cast<Leaf *>(node)->keys[k - 1];
+}
+
+bool BPlusSet::Contains(int x) {
+  if (n_ == 0) {
+    return false;
+  }
+  void *node = root_;
+  for (int level = levels_ - 1; level > 0; --level) {
+    Inner *in = static_cast<Inner *>(node);
+    node = in->children[ChildIndex(in, x)];
+  }
+  Leaf *leaf = static_cast<Leaf *>(node);
+  return std::binary_search(leaf->keys, leaf->keys + leaf->count, x);
+}
+
+bool BPlusSet::InsertRec(void *node, int level, int x, void **split,
+                         int *split_key) {
+  *split = nullptr;
+  if (level == 0) {
+    Leaf *leaf = static_cast<Leaf *>(node);
+    int pos = (int)(std::lower_bound(leaf->keys, leaf->keys + leaf->count, x) -
+                    leaf->keys);
+    if (pos < leaf->count && leaf->keys[pos] == x) {
+      return false; // 이미 존재
+    }
+    if (leaf->count == kLeafCap) { // 절반으로 나누고 알맞은 쪽에 삽입
+      Leaf *right = new Leaf;
+      int half = (kLeafCap + 1) / 2;
+      right->count = kLeafCap - half;
+      memcpy(right->keys, leaf->keys + half, right->count * sizeof(int));
+      leaf->count = half;
+      *split = right;
+      if (pos > half) {
+        leaf = right;
+        pos -= half;
+      }
+    }
+    memmove(leaf->keys + pos + 1, leaf->keys + pos,
+            (leaf->count - pos) * sizeof(int));
+    leaf->keys[pos] = x;
+    leaf->count++;
+    if (*split) {
+      *split_key = static_cast<Leaf *>(*split)->keys[0];
+    }
+    return true;
+  }
+
+  Inner *in = static_cast<Inner *>(node);
+  int idx = ChildIndex(in, x);
+  void *child_split = nullptr;
+  int child_key = 0;
+  if (!InsertRec(in->children[idx], level - 1, x, &child_split, &child_key)) {
+    return false;
+  }
+  in->sizes[idx]++;
+  if (child_split == nullptr) {
+    return true;
+  }
+
+  // 나뉜 자식을 idx + 1 위치에 끼워넣는다
+  int child_size = NodeSize(child_split, level - 1);
+  in->sizes[idx] -= child_size;
+  for (int i = in->count; i > idx + 1; --i) {
+    in->children[i] = in->children[i - 1];
+    in->sizes[i] = in->sizes[i - 1];
+    in->keys[i - 1] = in->keys[i - 2];
+  }
+  in->children[idx + 1] = child_split;
+  in->sizes[idx + 1] = child_size;
+  in->keys[idx] = child_key;
+  in->count++;
+
+  if (in->count < kInnerCap) {
+    return true;
+  }
+  // 가득 찼으면 미리 나눠서 다음 삽입에 여유를 둔다
+  Inner *right = new Inner;
+  int half = kInnerCap / 2;
+  right->count = in->count - half;
+  for (int i = 0; i < right->count; ++i) {
+    right->children[i] = in->children[half + i];
+    right->sizes[i] = in->sizes[half + i];
+    if (i > 0) {
+      right->keys[i - 1] = in->keys[half + i - 1];
+    }
+  }
+  *split_key = in->keys[half - 1];
+  in->count = half;
+  *split = right;
+  return true;
+}
+
+bool BPlusSet::EraseRec(void *node, int level, int x) {
+  if (level == 0) {
+    Leaf *leaf = static_cast<Leaf *>(node);
+    int pos = (int)(std::lower_bound(leaf->keys, leaf->keys + leaf->count, x) -
+                    leaf->keys);
+    if (pos == leaf->count || leaf->keys[pos] != x) {
+      return false;
+    }
+    memmove(leaf->keys + pos, leaf->keys + pos + 1,
+            (leaf->count - pos - 1) * sizeof(int));
+    leaf->count--;
+    return true;
+  }
+
+  Inner *in = static_cast<Inner *>(node);
+  int idx = ChildIndex(in, x);
+  if (!EraseRec(in->children[idx], level - 1, x)) {
+    return false;
+  }
+  in->sizes[idx]--;
+  if (EntryCount(in->children[idx], level - 1) <
+      (level == 1 ? kLeafMin : kInnerMin)) {
+    FixChild(in, idx, level - 1);
+  }
+  return true;
+}
+
+void BPlusSet::RemoveChild(Inner *in, int pos) {
+  for (int i = pos; i < in->count - 1; ++i) {
+    in->children[i] = in->children[i + 1];
+    in->sizes[i] = in->sizes[i + 1];
+    in->keys[i - 1] = in->keys[i];
+  }
+  in->count--;
+}
+
+void BPlusSet::FixChild(Inner *in, int idx, int level) {
+  // 왼쪽 형제가 있으면 (idx - 1, idx), 없으면 (idx, idx + 1) 쌍을 맞춘다.
+  // 루트가 아닌 내부 노드는 자식이 둘 이상이고, 루트도 삭제 전에는 둘 이상
+  int l = (idx > 0) ? idx - 1 : idx;
+  if (level == 0) {
+    Leaf *a = static_cast<Leaf *>(in->children[l]);
+    Leaf *b = static_cast<Leaf *>(in->children[l + 1]);
+    if (a->count + b->count <= kLeafCap) { // 병합: b 를 a 뒤에 붙인다
+      memcpy(a->keys + a->count, b->keys, b->count * sizeof(int));
+      a->count += b->count;
+      delete b;
+      in->sizes[l] = a->count;
+      RemoveChild(in, l + 1);
+      return;
+    }
+    if (a->count < b->count) { // b 의 첫 키를 a 로
+      a->keys[a->count++] = b->keys[0];
+      b->count--;
+      memmove(b->keys, b->keys + 1, b->count * sizeof(int));
+    } else { // a 의 마지막 키를 b 로
+      memmove(b->keys + 1, b->keys, b->count * sizeof(int));
+      b->keys[0] = a->keys[--a->count];
+      b->count++;
+    }
+    in->keys[l] = b->keys[0];
+    in->sizes[l] = a->count;
+    in->sizes[l + 1] = b->count;
+    return;
+  }
+
+  Inner *a = static_cast<Inner *>(in->children[l]);
+  Inner *b = static_cast<Inner *>(in->children[l + 1]);
+  int sep = in->keys[l]; // b 부분트리의 하한
+  if (a->count + b->count < kInnerCap) { // 병합: 구분 키를 내려 이어 붙인다
+    a->keys[a->count - 1] = sep;
+    for (int i = 0; i < b->count; ++i) {
+      a->children[a->count + i] = b->children[i];
+      a->sizes[a->count + i] = b->sizes[i];
+      if (i > 0) {
+        a->keys[a->count + i - 1] = b->keys[i - 1];
+      }
+    }
+    a->count += b->count;
+    delete b;
+    in->sizes[l] += in->sizes[l + 1];
+    RemoveChild(in, l + 1);
+    return;
+  }
+  if (a->count < b->count) { // b 의 첫 자식을 a 로 (구분 키는 부모를 거쳐 회전)
+    a->keys[a->count - 1] = sep;
+    a->children[a->count] = b->children[0];
+    a->sizes[a->count] = b->sizes[0];
+    a->count++;
+    in->keys[l] = b->keys[0];
+    for (int i = 0; i < b->count - 1; ++i) {
+      b->children[i] = b->children[i + 1];
+      b->sizes[i] = b->sizes[i + 1];
+      if (i < b->count - 2) {
+        b->keys[i] = b->keys[i + 1];
+      }
+    }
+    b->count--;
+  } else { // a 의 마지막 자식을 b 로
+    for (int i = b->count; i > 0; --i) {
+      b->children[i] = b->children[i - 1];
+      b->sizes[i] = b->sizes[i - 1];
+      if (i > 1) {
+        b->keys[i - 1] = b->keys[i - 2];
+      }
+    }
+    b->keys[0] = sep;
+    b->children[0] = a->children[a->count - 1];
+    b->sizes[0] = a->sizes[a->count - 1];
+    b->count++;
+    in->keys[l] = a->keys[a->count - 2];
+    a->count--;
+  }
+  in->sizes[l] = NodeSize(a, level);
+  in->sizes[l + 1] = NodeSize(b, level);
+}
+
+AvlReply BPlusSet::Execute(AvlOp op, int x) {
+  switch (op) {
+  case kOpFind:
+    return MakeReply(Contains(x) ? LeafDepthHeight() : -1);
+  case kOpInsert: {
+    if (root_ == nullptr) {
+      Leaf *leaf = new Leaf;
+      leaf->count = 0;
+      root_ = leaf;
+      levels_ = 1;
+    }
+    void *split = nullptr;
+    int split_key = 0;
+    if (InsertRec(root_, levels_ - 1, x, &split, &split_key)) {
+      n_++;
+    }
+    if (split) { // 루트가 나뉘면 높이가 1 증가
+      Inner *root = new Inner;
+      root->count = 2;
+      root->children[0] = root_;
+      root->children[1] = split;
+      root->keys[0] = split_key;
+      root->sizes[1] = NodeSize(split, levels_ - 1);
+      root->sizes[0] = n_ - root->sizes[1];
+      root_ = root;
+      levels_++;
+    }
+    return MakeReply(LeafDepthHeight());
+  }
+  case kOpEmpty:
+    return MakeReply(n_ == 0 ? 1 : 0);
+  case kOpSize:
+    return MakeReply(n_);
+  case kOpPrev: {
+    int less = CountLess(x, false);
+    return less == 0 ? MakeReply(-1)
+                     : MakeReply(Select(less), LeafDepthHeight());
+  }
+  case kOpNext:
+  case kOpUpperBound: {
+    int upto = CountLess(x, true);
+    return upto == n_ ? MakeReply(-1)
+                      : MakeReply(Select(upto + 1), LeafDepthHeight());
+  }
+  case kOpRank:
+    return Contains(x) ? MakeReply(LeafDepthHeight(), CountLess(x, true))
+                       : MakeReply(-1);
+  case kOpErase: {
+    int depth_height = LeafDepthHeight();
+    if (n_ == 0 || !EraseRec(root_, levels_ - 1, x)) {
+      return MakeReply(-1);
+    }
+    n_--;
+    if (n_ == 0) { // 덜 찬 자식은 병합되므로 이때 루트는 빈 리프
+      FreeRec(root_, levels_ - 1);
+      root_ = nullptr;
+      levels_ = 0;
+    }
+    // 자식이 하나뿐인 루트는 걷어낸다
+    while (levels_ > 1 && static_cast<Inner *>(root_)->count == 1) {
+      Inner *old = static_cast<Inner *>(root_);
+      root_ = old->children[0];
+      delete old;
+      levels_--;
+    }
+    return MakeReply(depth_height);
+  }
+  default:
+    return MakeReply(-1);
+  }
+}
+
+// ---------------------------- 파이프라인 모드 ----------------------------
+// 파서, 실행기, 포매터 스레드를 SPSC 링 버퍼로 연결하여 입력 해석, 트리 연산,
+// 결과 출력을 동시에 진행한다. 명령과 결과는 배치 단위로 순서대로 전달된다
+
+// 파이프라인 단계 사이에 전달되는 명령. op == kOpCount 는 새 테스트 케이스
+struct AvlCommand {
+  AvlOp op;
+  int x;
+};
+
+// 단일 생산자/단일 소비자 lock-free 링 버퍼 (Capacity 는 2의 거듭제곱)
+template <typename T, size_t Capacity> class SpscRing {
+public:
+  SpscRing() : head_(0), tail_(0) {}
+
+  bool TryPush(T &item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+      return false; // 가득 참
+    }
+    slots_[tail & (Capacity - 1)] = std::move(item);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPop(T &item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false; // 비어 있음
+    }
+    item = std::move(slots_[head & (Capacity - 1)]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  void Push(T item) {
+    for (int waits = 0; !TryPush(item); ++waits) {
+      Backoff(waits);
+    }
+  }
+
+  T Pop() {
+    T item;
+    for (int waits = 0; !TryPop(item); ++waits) {
+      Backoff(waits);
+    }
+    return item;
+  }
+
+private:
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be 2^k");
+  static const int kYieldWaits = 64; // 이후로는 코어를 내주고 잠든다
+
+  // 상대가 곧 따라오면 yield 로 충분하지만, 입력을 기다리는 등 오래 멈춘
+  // 상대를 기다리며 코어 하나를 계속 쓰지 않도록 잠깐씩 잠든다
+  static void Backoff(int waits) {
+    if (waits < kYieldWaits) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+  T slots_[Capacity];
+  alignas(64) std::atomic<size_t> head_; // 소비자가 다음에 읽을 위치
+  alignas(64) std::atomic<size_t> tail_; // 생산자가 다음에 쓸 위치
+};
+
+// FILE 에서 공백으로 구분된 토큰과 정수를 읽는 버퍼 입력기
+class AvlTextReader {
+public:
+  explicit AvlTextReader(FILE *in) : in_(in), pos_(0), len_(0) {}
+
+  // 다음 토큰을 token 에 담는다 (입력 끝이면 false)
+  bool NextToken(string *token);
+  // cin >> x 처럼 정수를 읽는다 (정수가 아니거나 입력 끝이면 false)
+  bool NextInt(int *x);
+
+private:
+  FILE *in_;
+  char buf_[1 << 16];
+  size_t pos_, len_;
+
+  int Peek() {
+    if (pos_ == len_) {
+      len_ = fread(buf_, 1, sizeof(buf_), in_);
+      pos_ = 0;
+      if (len_ == 0) {
+        return EOF;
+      }
+    }
+    return (unsigned char)buf_[pos_];
+  }
+  bool SkipSpace() {
+    int c;
+    while ((c = Peek()) != EOF && isspace(c)) {
+      pos_++;
+    }
+    return c != EOF;
+  }
+};
+
+bool AvlTextReader::NextToken(string *token) {
+  token->clear();
+  if (!SkipSpace()) {
+    return false;
+  }
+  int c;
+  while ((c = Peek()) != EOF && !isspace(c)) {
+    token->push_back((char)c);
+    pos_++;
+  }
+  return true;
+}
+
+bool AvlTextReader::NextInt(int *x) {
+  if (!SkipSpace()) {
+    return false;
+  }
+  bool negative = false;
+  int c = Peek();
+  if (c == '-' || c == '+') {
+    negative = (c == '-');
+    pos_++;
+    c = Peek();
+  }
+  if (c == EOF || !isdigit(c)) {
+    return false;
+  }
+  // cin 처럼 숫자는 끝까지 소비하되 int 범위를 넘으면 실패로 본다.
+  // 한계를 넘은 뒤로는 더 누적하지 않으므로 long long 도 넘치지 않는다
+  long long limit = negative ? -(long long)INT_MIN : INT_MAX;
+  long long value = 0;
+  bool overflow = false;
+  while ((c = Peek()) != EOF && isdigit(c)) {
+    if (!overflow) {
+      value = value * 10 + (c - '0');
+      overflow = value > limit;
+    }
+    pos_++;
+  }
+  if (overflow) {
+    return false;
+  }
+  *x = (int)(negative ? -value : value);
+  return true;
+}
+
+// 결과를 버퍼에 모아 한 번에 FILE 로 내보내는 출력기
+class AvlTextWriter {
+public:
+  explicit AvlTextWriter(FILE *out) : out_(out), len_(0) {}
+  ~AvlTextWriter() { Flush(); }
+
+  void Write(const AvlReply &reply) {
+    if (len_ + 32 > sizeof(buf_)) {
+      Flush();
+    }
+    WriteInt(reply.v[0]);
+    if (reply.count == 2) {
+      buf_[len_++] = ' ';
+      WriteInt(reply.v[1]);
+    }
+    buf_[len_++] = '\n';
+  }
+
+  void Flush() {
+    fwrite(buf_, 1, len_, out_);
+    len_ = 0;
+  }
+
+private:
+  FILE *out_;
+  char buf_[1 << 16];
+  size_t len_;
+
+  void WriteInt(int v) {
+    unsigned int u = (v < 0) ? 0u - (unsigned int)v : (unsigned int)v;
+    char digits[12];
+    int n = 0;
+    do {
+      digits[n++] = (char)('0' + u % 10);
+      u /= 10;
+    } while (u);
+    if (v < 0) {
+      buf_[len_++] = '-';
+    }
+    while (n) {
+      buf_[len_++] = digits[--n];
+    }
+  }
+};
+
+// 테스트 케이스마다 새 집합을 만든 직후(Begin)와 해제하기 직전(End)에
+// 호출되는 훅. 기본 훅은 아무것도 하지 않는다
+struct AvlNoCaseHook {
+  template <typename Set> void Begin(Set &) {}
+  template <typename Set> void End(Set &) {}
+};
+
+// 명령 T, Q 형식의 입력을 파이프라인으로 처리한다 (출력은 순차 모드와 동일)
+template <typename Set, typename Hook = AvlNoCaseHook>
+void RunPipelined(FILE *in, FILE *out, Hook hook = Hook()) {
+  const size_t kBatch = 4096; // 배치당 명령 수
+  struct CommandBatch {
+    vector<AvlCommand> commands;
+    bool last = false;
+  };
+  struct ReplyBatch {
+    vector<AvlReply> replies;
+    bool last = false;
+  };
+  SpscRing<CommandBatch, 16> commands;
+  SpscRing<ReplyBatch, 16> replies;
+
+  // 1단계: 입력 해석
+  std::thread parser([&] {
+    AvlTextReader reader(in);
+    CommandBatch batch;
+    int T = 0;
+    reader.NextInt(&T);
+    string token;
+    bool ok = true;
+    while (ok && T-- > 0) {
+      int Q = 0;
+      if (!reader.NextInt(&Q)) {
+        break;
+      }
+      batch.commands.push_back(AvlCommand{kOpCount, 0});
+      while (Q-- > 0) {
+        if (!reader.NextToken(&token)) {
+          ok = false;
+          break;
+        }
+        AvlOp op;
+        if (!ParseAvlOp(token, &op)) {
+          continue;
+        }
+        int x = 0;
+        if (AvlOpHasArg(op) && !reader.NextInt(&x)) {
+          ok = false; // cin 과 같이 이후 입력은 처리하지 않는다
+          break;
+        }
+        batch.commands.push_back(AvlCommand{op, x});
+        if (batch.commands.size() >= kBatch) {
+          commands.Push(std::move(batch));
+          batch = CommandBatch();
+        }
+      }
+    }
+    batch.last = true;
+    commands.Push(std::move(batch));
+  });
+
+  // 3단계: 결과 출력
+  std::thread formatter([&] {
+    AvlTextWriter writer(out);
+    while (true) {
+      ReplyBatch batch = replies.Pop();
+      for (const AvlReply &reply : batch.replies) {
+        writer.Write(reply);
+      }
+      if (batch.last) {
+        break;
+      }
+    }
+    writer.Flush();
+    fflush(out);
+  });
+
+  // 2단계: 트리 연산 (호출한 스레드에서 실행)
+  std::unique_ptr<Set> set;
+  while (true) {
+    CommandBatch batch = commands.Pop();
+    ReplyBatch result;
+    result.replies.reserve(batch.commands.size());
+    for (const AvlCommand &command : batch.commands) {
+      if (command.op == kOpCount) {
+        if (set) {
+          hook.End(*set);
+        }
+        set.reset(); // 이전 케이스의 트리를 먼저 해제
+        set.reset(new Set());
+        hook.Begin(*set);
+      } else {
+        result.replies.push_back(set->Execute(command.op, command.x));
+      }
+    }
+    result.last = batch.last;
+    replies.Push(std::move(result));
+    if (batch.last) {
+      break;
+    }
+  }
+  if (set) {
+    hook.End(*set);
+  }
+
+  parser.join();
+  formatter.join();
+}
+
+// ---------------------------- 이진 명령 형식 ----------------------------
+// 텍스트 입력의 해석 비용을 없애기 위한 이진 명령 스트림.
+//   헤더: "AVLB", 버전(1), 플래그(1바이트), 0(2바이트), T (varint)
+//   케이스: Q (varint), 명령 Q 개
+//   명령: AvlOp 값 1바이트 + (인자가 있으면) x
+// x 는 플래그에 kAvlBinaryFixed32 가 있으면 4바이트 little endian, 없으면
+// zigzag varint. 결과 스트림은 "AVLR", 버전, 0(2바이트) 뒤에 응답마다
+// (zigzag(v0) << 1 | 값이 두 개인지) varint, 두 개면 zigzag(v1) varint 가
+// 이어진다. varint 는 7비트씩 낮은 자리부터 쓰고 마지막이 아닌 바이트의
+// 최상위 비트를 켠다
+static const char kAvlBinaryMagic[4] = {'A', 'V', 'L', 'B'};
+static const char kAvlResultMagic[4] = {'A', 'V', 'L', 'R'};
+static const uint8_t kAvlBinaryVersion = 1;
+static const uint8_t kAvlBinaryFixed32 = 1; // 인자를 고정 4바이트로 저장
+
+static uint32_t ZigZag(int x) {
+  return ((uint32_t)x << 1) ^ (uint32_t)(x >> 31);
+}
+static int UnZigZag(uint32_t u) { return (int)(u >> 1) ^ -(int)(u & 1); }
+
+// 버퍼에 모아 FILE 로 내보내는 바이트 출력기 (이진 명령, 결과 스트림 공용)
+class AvlBinaryWriter {
+public:
+  explicit AvlBinaryWriter(FILE *out) : out_(out), len_(0) {}
+  ~AvlBinaryWriter() { Flush(); }
+
+  // 명령 스트림
+  void WriteHeader(int T, uint8_t flags) {
+    Reserve(16);
+    memcpy(buf_ + len_, kAvlBinaryMagic, 4);
+    buf_[len_ + 4] = (char)kAvlBinaryVersion;
+    buf_[len_ + 5] = (char)flags;
+    buf_[len_ + 6] = buf_[len_ + 7] = 0;
+    len_ += 8;
+    fixed32_ = (flags & kAvlBinaryFixed32) != 0;
+    PutVarint((uint32_t)T);
+  }
+  void WriteCount(int Q) {
+    Reserve(8);
+    PutVarint((uint32_t)Q);
+  }
+  void WriteCommand(AvlOp op, int x) {
+    Reserve(8);
+    buf_[len_++] = (char)op;
+    if (!AvlOpHasArg(op)) {
+      return;
+    }
+    if (fixed32_) {
+      for (int i = 0; i < 4; ++i) {
+        buf_[len_++] = (char)((uint32_t)x >> (8 * i));
+      }
+    } else {
+      PutVarint(ZigZag(x));
+    }
+  }
+
+  // 결과 스트림 (AvlTextWriter 와 같은 Write/Flush)
+  void WriteResultHeader() {
+    Reserve(8);
+    memcpy(buf_ + len_, kAvlResultMagic, 4);
+    buf_[len_ + 4] = (char)kAvlBinaryVersion;
+    buf_[len_ + 5] = buf_[len_ + 6] = buf_[len_ + 7] = 0;
+    len_ += 8;
+  }
+  void Write(const AvlReply &reply) {
+    Reserve(16);
+    PutVarint((uint64_t)ZigZag(reply.v[0]) << 1 | (reply.count == 2));
+    if (reply.count == 2) {
+      PutVarint(ZigZag(reply.v[1]));
+    }
+  }
+
+  void Flush() {
+    fwrite(buf_, 1, len_, out_);
+    len_ = 0;
+  }
+
+private:
+  FILE *out_;
+  char buf_[1 << 16];
+  size_t len_;
+  bool fixed32_ = false;
+
+  void Reserve(size_t n) {
+    if (len_ + n > sizeof(buf_)) {
+      Flush();
+    }
+  }
+  void PutVarint(uint64_t u) {
+    while (u >= 0x80) {
+      buf_[len_++] = (char)(u | 0x80);
+      u >>= 7;
+    }
+    buf_[len_++] = (char)u;
+  }
+};
+
+// AvlBinaryWriter 가 쓴 스트림을 읽는다. 잘린 입력이나 알 수 없는 명령을
+// 만나면 false 를 돌려주고, 이후 입력은 처리하지 않는다 (cin 과 같이)
+class AvlBinaryReader {
+public:
+  explicit AvlBinaryReader(istream &in) : in_(in.rdbuf()), pos_(0), len_(0) {}
+
+  bool ReadHeader(int *T); // 명령 스트림 헤더 (형식이 다르면 false)
+  bool ReadResultHeader(); // 결과 스트림 헤더
+  bool NextCount(int *Q) {
+    uint64_t u;
+    if (!GetVarint(&u) || u > INT_MAX) {
+      return false;
+    }
+    *Q = (int)u;
+    return true;
+  }
+  bool NextCommand(AvlCommand *command);
+  bool NextReply(AvlReply *reply);
+
+private:
+  streambuf *in_; // cin 과 같은 버퍼를 쓰므로 앞에서 peek 한 바이트도 읽힌다
+  unsigned char buf_[1 << 16];
+  size_t pos_, len_;
+  bool fixed32_ = false;
+
+  int Get() {
+    if (pos_ == len_) {
+      len_ = (size_t)in_->sgetn((char *)buf_, sizeof(buf_));
+      pos_ = 0;
+      if (len_ == 0) {
+        return EOF;
+      }
+    }
+    return buf_[pos_++];
+  }
+  bool GetBytes(unsigned char *dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      int c = Get();
+      if (c == EOF) {
+        return false;
+      }
+      dst[i] = (unsigned char)c;
+    }
+    return true;
+  }
+  bool GetVarint(uint64_t *u) { // 최대 10바이트
+    uint64_t v = 0;
+    if (pos_ + 10 <= len_) { // 버퍼 안에 있으면 바이트마다 채우지 않는다
+      for (int shift = 0; shift < 70; shift += 7) {
+        unsigned char c = buf_[pos_++];
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (c < 0x80) {
+          *u = v;
+          return true;
+        }
+      }
+      return false;
+    }
+    for (int shift = 0; shift < 70; shift += 7) {
+      int c = Get();
+      if (c == EOF) {
+        return false;
+      }
+      v |= (uint64_t)(c & 0x7f) << shift;
+      if (c < 0x80) {
+        *u = v;
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+bool AvlBinaryReader::ReadHeader(int *T) {
+  unsigned char header[8];
+  if (!GetBytes(header, 8) || memcmp(header, kAvlBinaryMagic, 4) != 0 ||
+      header[4] != kAvlBinaryVersion) {
+    return false;
+  }
+  fixed32_ = (header[5] & kAvlBinaryFixed32) != 0;
+  return NextCount(T);
+}
+
+bool AvlBinaryReader::ReadResultHeader() {
+  unsigned char header[8];
+  return GetBytes(header, 8) && memcmp(header, kAvlResultMagic, 4) == 0 &&
+         header[4] == kAvlBinaryVersion;
+}
+
+bool AvlBinaryReader::NextCommand(AvlCommand *command) {
+  int op = Get();
+  if (op == EOF || op >= kOpCount) {
+    return false;
+  }
+  command->op = (AvlOp)op;
+  command->x = 0;
+  if (!AvlOpHasArg(command->op)) {
+    return true;
+  }
+  if (fixed32_) {
+    unsigned char b[4];
+    if (!GetBytes(b, 4)) {
+      return false;
+    }
+    command->x = (int)((uint32_t)b[0] | (uint32_t)b[1] << 8 |
+                       (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24);
+    return true;
+  }
+  uint64_t u;
+  if (!GetVarint(&u) || u > UINT32_MAX) {
+    return false;
+  }
+  command->x = UnZigZag((uint32_t)u);
+  return true;
+}
+
+bool AvlBinaryReader::NextReply(AvlReply *reply) {
+  uint64_t first, second = 0;
+  if (!GetVarint(&first) || first >> 33 != 0) {
+    return false;
+  }
+  reply->count = (first & 1) ? 2 : 1;
+  if (reply->count == 2 && (!GetVarint(&second) || second > UINT32_MAX)) {
+    return false;
+  }
+  reply->v[0] = UnZigZag((uint32_t)(first >> 1));
+  reply->v[1] = UnZigZag((uint32_t)second);
+  return true;
+}
+
+// 이진 명령 스트림의 테스트 케이스들을 Set 엔진으로 처리하고 결과를
+// writer (AvlTextWriter 또는 결과 헤더를 쓴 AvlBinaryWriter) 로 내보낸다.
+// 헤더가 올바르지 않으면 false
+template <typename Set, typename Writer, typename Hook = AvlNoCaseHook>
+bool RunBinaryCases(istream &in, Writer &writer, Hook hook = Hook()) {
+  AvlBinaryReader reader(in);
+  int T;
+  if (!reader.ReadHeader(&T)) {
+    return false;
+  }
+  while (T-- > 0) {
+    int Q;
+    if (!reader.NextCount(&Q)) {
+      break;
+    }
+    Set set;
+    hook.Begin(set);
+    AvlCommand command;
+    bool ok = true;
+    while (Q-- > 0 && (ok = reader.NextCommand(&command))) {
+      writer.Write(set.Execute(command.op, command.x));
+    }
+    hook.End(set);
+    if (!ok) {
+      break;
+    }
+  }
+  writer.Flush();
+  return true;
+}
+
+// ---------------------------- 읽기 구간 병렬 실행 ----------------------------
+// 명령들을 순서대로 실행하고 결과를 같은 위치에 담는다. 길이가 min_run 이상인
+// 읽기 전용 명령의 연속 구간은 트리가 바뀌지 않으므로 pool 에서 나눠 실행하고,
+// 나머지는 순차로 실행한다. 읽기가 상태를 바꾸는 기능(핑거, 조회 필터)은
+// 꺼져 있어야 한다
+template <typename Set>
+void ExecuteCommands(Set &set, const vector<AvlCommand> &commands,
+                     vector<AvlReply> *replies, size_t min_run,
+                     AvlWorkPool &pool) {
+  const size_t kMinChunk = 64; // 작업 하나에 줄 최소 명령 수
+  replies->resize(commands.size());
+  size_t i = 0;
+  while (i < commands.size()) {
+    size_t end = i;
+    while (end < commands.size() && AvlOpIsReadOnly(commands[end].op)) {
+      end++;
+    }
+    if (end - i >= min_run && pool.size() > 1) {
+      size_t chunk = max(kMinChunk, (end - i) / (pool.size() * 4));
+      size_t chunks = (end - i + chunk - 1) / chunk;
+      pool.ParallelFor(chunks, [&](size_t c) {
+        size_t last = min(end, i + (c + 1) * chunk);
+        for (size_t j = i + c * chunk; j < last; ++j) {
+          (*replies)[j] = set.Execute(commands[j].op, commands[j].x);
+        }
+      });
+    } else { // 짧은 읽기 구간, 또는 쓰기 명령 하나는 순차로 실행
+      end = max(end, i + 1);
+      for (size_t j = i; j < end; ++j) {
+        (*replies)[j] = set.Execute(commands[j].op, commands[j].x);
+      }
+    }
+    i = end;
+  }
+}
+
+// ---------------------------- 명령별 지연 시간 ----------------------------
+// 나노초 단위 지연 시간의 로그-선형(HDR 방식) 히스토그램. 64 미만은 값마다,
+// 그 이상은 2의 거듭제곱 구간마다 32칸으로 나누어 세므로 백분위수의 상대
+// 오차는 1/32 이하이고, 메모리는 값의 범위와 관계없이 고정이다
+class AvlLatencyHistogram {
+public:
+  AvlLatencyHistogram() : counts_(kBuckets, 0), total_(0), sum_(0), max_(0) {}
+
+  void Record(uint64_t ns) {
+    counts_[BucketOf(ns)]++;
+    total_++;
+    sum_ += ns;
+    max_ = max(max_, ns);
+  }
+  void Merge(const AvlLatencyHistogram &other);
+  // 기록된 값 중 비율 p (0~1) 가 들어가는 칸의 상한 (최대값을 넘지 않음)
+  uint64_t Percentile(double p) const;
+  uint64_t count() const { return total_; }
+  uint64_t max_value() const { return max_; }
+  double mean() const { return total_ ? (double)sum_ / total_ : 0.0; }
+
+private:
+  static constexpr int kSubBits = 5; // 2의 거듭제곱 구간당 2^5 칸
+  static constexpr int kBuckets = (64 - kSubBits + 1) << kSubBits;
+  vector<uint64_t> counts_;
+  uint64_t total_;
+  uint64_t sum_;
+  uint64_t max_;
+
+  static int BucketOf(uint64_t v);
+  static uint64_t BucketHigh(int bucket); // 칸에 들어가는 가장 큰 값
+};
+
+int AvlLatencyHistogram::BucketOf(uint64_t v) {
+  if (v < (2u << kSubBits)) {
+    return (int)v;
+  }
+#if defined(__GNUC__) || defined(__clang__)
+  int msb = 63 - __builtin_clzll(v);
+#else
+  int msb = 0;
+  while (v >> (msb + 1)) {
+    msb++;
+  }
+#endif
+  int shift = msb - kSubBits; // v >> shift 는 [32, 64) 범위
+  return (shift << kSubBits) + (int)(v >> shift);
+}
+
+uint64_t AvlLatencyHistogram::BucketHigh(int bucket) {
+  if (bucket < (2 << kSubBits)) {
+    return (uint64_t)bucket;
+  }
+  int shift = (bucket >> kSubBits) - 1;
+  uint64_t top = (uint64_t)(bucket - (shift << kSubBits));
+  return (top << shift) + ((1ull << shift) - 1);
+}
+
+void AvlLatencyHistogram::Merge(const AvlLatencyHistogram &other) {
+  for (int i = 0; i < kBuckets; ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  total_ += other.total_;
+  sum_ += other.sum_;
+  max_ = max(max_, other.max_);
+}
+
+uint64_t AvlLatencyHistogram::Percentile(double p) const {
+  if (total_ == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p * total_ + 0.999999); // 올림
+  rank = max<uint64_t>(1, min(rank, total_));
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      return min(BucketHigh(i), max_);
+    }
+  }
+  return max_;
+}
+
+// 명령 종류마다 히스토그램을 두고 명령 실행 시간을 기록한다 (스레드 하나용)
+class AvlLatencyRecorder {
+public:
+  // set.Execute(op, x) 를 실행하고 걸린 시간을 op 의 히스토그램에 기록
+  template <typename Set> AvlReply Execute(Set &set, AvlOp op, int x) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    AvlReply reply = set.Execute(op, x);
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - start);
+    histograms_[op].Record((uint64_t)elapsed.count());
+    return reply;
+  }
+  const AvlLatencyHistogram &histogram(AvlOp op) const {
+    return histograms_[op];
+  }
+  // 기록이 있는 명령마다 count, mean, p50, p99, p999, max (ns) 를 출력
+  void WriteJson(FILE *out) const;
+
+private:
+  AvlLatencyHistogram histograms_[kOpCount];
+};
+
+void AvlLatencyRecorder::WriteJson(FILE *out) const {
+  fprintf(out, "{\n  \"unit\": \"ns\",\n  \"commands\": {");
+  const char *separator = "\n";
+  for (int op = 0; op < kOpCount; ++op) {
+    const AvlLatencyHistogram &h = histograms_[op];
+    if (h.count() == 0) {
+      continue;
+    }
+    fprintf(out,
+            "%s    \"%s\": {\"count\": %llu, \"mean\": %.1f, "
+            "\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, "
+            "\"max\": %llu}",
+            separator, kAvlOpNames[op], (unsigned long long)h.count(),
+            h.mean(), (unsigned long long)h.Percentile(0.5),
+            (unsigned long long)h.Percentile(0.99),
+            (unsigned long long)h.Percentile(0.999),
+            (unsigned long long)h.max_value());
+    separator = ",\n";
+  }
+  fprintf(out, "\n  }\n}\n");
+}
+
+// Execute 마다 걸린 시간을 recorder 에 기록하는 Set 엔진. 실행기(RunTestCases
+// 등)가 Set 을 직접 만들므로 기록기는 엔진 종류별 정적 포인터로 넘긴다
+template <typename Set> class AvlTimedSet : public Set {
+public:
+  AvlReply Execute(AvlOp op, int x) {
+    return recorder->Execute(static_cast<Set &>(*this), op, x);
+  }
+  static AvlLatencyRecorder *recorder;
+};
+
+template <typename Set> AvlLatencyRecorder *AvlTimedSet<Set>::recorder;
+
+// ------------------------------- 서버 모드 -------------------------------
+#ifdef __linux__
+// Unix 도메인 소켓으로 이름 붙은 AvlSet 들을 계속 유지하며 제공하는 단일
+// 스레드 epoll 서버. 연결마다 입력을 줄 단위로 모아 같은 텍스트 명령(한 줄에
+// 하나)을 실행하고, 응답은 연결의 출력 버퍼에 모았다가 보낼 수 있을 때 보낸다.
+// 클라이언트는 응답을 기다리지 않고 명령을 이어 보내도 된다.
+// "Use 이름" 은 그 연결이 이후에 쓸 집합을 고른다 (없으면 만들고, 처음에는
+// "default"). 빈 줄이 아닌 모든 줄은 응답 한 줄을 받는다: Use 는 OK, 해석할
+// 수 없는 줄은 ERR. 원격 입력이므로 있는 키의 Insert 는 Find 로, 없는 키의
+// Prev/Next 는 -1 로 답한다
+class AvlServer {
+public:
+  // init 은 새 집합을 만들 때마다 불린다 (선택 기능 설정용)
+  explicit AvlServer(const string &path,
+                     function<void(AvlSet &)> init = nullptr);
+  ~AvlServer();
+  AvlServer(const AvlServer &) = delete;
+  AvlServer &operator=(const AvlServer &) = delete;
+
+  bool Listen(); // 소켓을 만들고 연결을 받기 시작 (실패하면 false)
+  void Run();    // Stop 이 불릴 때까지 이벤트 루프 실행
+  void Stop();   // 다른 스레드나 시그널 처리기에서 불러도 된다
 
-    int balance = BalanceDegree(cur_node);
+  // 텍스트 한 줄을 *set 에 실행하고 응답 한 줄을 *out 에 덧붙인다
+  void HandleLine(const char *line, size_t len, AvlSet **set, string *out);
+  static AvlReply ExecuteChecked(AvlSet &set, AvlOp op, int x);
+  size_t set_count() const { return sets_.size(); }
 
-    // 왼쪽으로 기움 : LL or LR
-    if (balance == 2) {
-      // LR: 왼쪽 자식을 먼저 좌회전
-      if (BalanceDegree(cur_node->left) < 0)
-        RotateLeft(cur_node->left);
+//private:  //for test code
+  struct Connection {
+    int fd;
+    AvlSet *set;     // Use 로 고른 집합
+    string in;       // 아직 줄바꿈을 받지 못한 입력
+    string out;      // 아직 보내지 못한 응답
+    size_t out_pos;  // out 에서 이미 보낸 바이트 수
+    uint32_t events; // 현재 epoll 에 등록된 이벤트
+    bool closing;    // 입력이 끝났고 남은 응답만 보내면 된다
+    size_t pending() const { return out.size() - out_pos; }
+  };
+  static const size_t kMaxPending = 1 << 20; // 넘으면 읽기를 잠시 멈춘다
+  static const size_t kMaxLine = 1 << 12;    // 줄바꿈 없이 이보다 길면 끊는다
 
-      RotateRight(cur_node);
-    }
+  string path_;
+  function<void(AvlSet &)> init_;
+  int listen_fd_, epoll_fd_, wake_fd_;
+  unordered_map<string, unique_ptr<AvlSet>> sets_;
+  unordered_map<int, unique_ptr<Connection>> connections_;
 
-    // 오른쪽으로 기움 : RR or RL
-    else if (balance == -2) {
-      // RL: 오른쪽 자식을 먼저 우회전
-      if (BalanceDegree(cur_node->right) > 0)
-        RotateRight(cur_node->right);
+  AvlSet *SetNamed(const string &name);
+  void Accept();
+  bool OnReadable(Connection *c); // 연결을 닫았으면 false
+  void ProcessLines(Connection *c);
+  bool Flush(Connection *c); // 보낼 수 있는 만큼 보낸다 (오류면 false)
+  void UpdateEvents(Connection *c);
+  void Close(Connection *c);
+};
 
-      RotateLeft(cur_node);
-    }
+AvlServer::AvlServer(const string &path, function<void(AvlSet &)> init)
+    : path_(path), init_(std::move(init)), listen_fd_(-1), epoll_fd_(-1),
+      wake_fd_(-1) {}
 
-    // 부모로 올라가서 체크
-    cur_node = cur_node->parent;
+AvlServer::~AvlServer() {
+  for (auto &entry : connections_) {
+    close(entry.first);
+  }
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(path_.c_str());
+  }
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+  if (wake_fd_ >= 0) {
+    close(wake_fd_);
   }
 }
 
-AvlSet::Node *AvlSet::FindNode(int x) {
-  Node *cur_node = root_;
-  while (cur_node != nullptr) {
-    if (cur_node->key == x) {
-      return cur_node;
-    }
-    if (cur_node->key > x) { // 왼쪽 자식으로 이동
-      cur_node = cur_node->left;
-    } else { // 오른쪽 자식으로 이동
-      cur_node = cur_node->right;
-    }
+bool AvlServer::Listen() {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path_.empty() || path_.size() >= sizeof(addr.sun_path)) {
+    return false;
   }
-  return nullptr;
+  memcpy(addr.sun_path, path_.c_str(), path_.size() + 1);
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    return false;
+  }
+  unlink(path_.c_str()); // 이전 실행이 남긴 소켓 파일
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (bind(listen_fd_, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(listen_fd_, SOMAXCONN) != 0 || epoll_fd_ < 0 || wake_fd_ < 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = listen_fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+  ev.data.fd = wake_fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+  return true;
 }
 
-void AvlSet::Find(int x) {
-  Node *cur_node = root_;
-  int depth = 0;
+void AvlServer::Stop() {
+  uint64_t one = 1;
+  ssize_t ignored = write(wake_fd_, &one, sizeof(one)); // 시그널 안전
+  (void)ignored;
+}
 
-  while (cur_node != nullptr) {
-    if (cur_node->key == x) {
-      cout << depth * cur_node->height << '\n';
+void AvlServer::Run() {
+  const int kMaxEvents = 64;
+  epoll_event events[kMaxEvents];
+  while (true) {
+    int n = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
       return;
     }
-
-    if (cur_node->key > x) { // 왼쪽 자식으로 이동
-      cur_node = cur_node->left;
-    } else {
-      cur_node = cur_node->right;
+    for (int i = 0; i < n; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == wake_fd_) {
+        return;
+      }
+      if (fd == listen_fd_) {
+        Accept();
+        continue;
+      }
+      auto it = connections_.find(fd);
+      if (it == connections_.end()) { // 같은 묶음에서 이미 닫은 연결
+        continue;
+      }
+      Connection *c = it->second.get();
+      if (events[i].events & EPOLLERR) {
+        Close(c);
+        continue;
+      }
+      if ((events[i].events & (EPOLLIN | EPOLLHUP)) && !OnReadable(c)) {
+        continue;
+      }
+      if (events[i].events & EPOLLOUT) {
+        if (!Flush(c) || (c->closing && c->pending() == 0)) {
+          Close(c);
+          continue;
+        }
+        UpdateEvents(c);
+      }
     }
-    depth++;
   }
-
-  cout << -1 << '\n'; // 찾지 못함
 }
 
-void AvlSet::Empty() {
-  if (n_ == 0) {
-    cout << 1 << '\n';
-  } else {
-    cout << 0 << '\n';
+AvlSet *AvlServer::SetNamed(const string &name) {
+  unique_ptr<AvlSet> &set = sets_[name];
+  if (!set) {
+    set.reset(new AvlSet);
+    if (init_) {
+      init_(*set);
+    }
   }
+  return set.get();
 }
 
-void AvlSet::Size() { cout << n_ << '\n'; }
-
-void AvlSet::Insert(int x) {
-  Node *new_node = new Node(x);
-
-  if (root_ == nullptr) { // 빈 트리일 경우
-    root_ = new_node;
-    ++n_;
-    cout << 0 << '\n';
-    return;
+void AvlServer::Accept() {
+  while (true) {
+    int fd = accept4(listen_fd_, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return; // EAGAIN: 대기 중인 연결이 없다
+    }
+    Connection *c = new Connection{fd, SetNamed("default"), string(),
+                                   string(), 0, EPOLLIN, false};
+    connections_[fd].reset(c);
+    epoll_event ev;
+    ev.events = c->events;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
   }
+}
 
-  Node *p_node = nullptr;
-  Node *cur_node = root_;
-
-  while (cur_node != nullptr) {
-    p_node = cur_node;
-
-    if (cur_node->key > x) { // 왼쪽 자식으로 이동
-      cur_node = cur_node->left;
-    } else { // 오른쪽 자식으로 이동
-      cur_node = cur_node->right;
+bool AvlServer::OnReadable(Connection *c) {
+  char buf[1 << 16];
+  while (!c->closing && c->pending() < kMaxPending) {
+    ssize_t n = read(c->fd, buf, sizeof(buf));
+    if (n > 0) {
+      c->in.append(buf, n);
+      ProcessLines(c);
+    } else if (n == 0) { // 입력 끝: 줄바꿈 없는 마지막 줄도 실행
+      HandleLine(c->in.data(), c->in.size(), &c->set, &c->out);
+      c->in.clear();
+      c->closing = true;
+    } else if (errno != EINTR) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        Close(c);
+        return false;
+      }
+      break;
     }
   }
-
-  new_node->parent = p_node;
-  if (p_node->key > x) {
-    p_node->left = new_node;
-  } else {
-    p_node->right = new_node;
+  if (c->in.size() > kMaxLine || !Flush(c) ||
+      (c->closing && c->pending() == 0)) {
+    Close(c);
+    return false;
   }
+  UpdateEvents(c);
+  return true;
+}
 
-  ++n_;
-
-  // 삽입 후 재정렬
-  ReBalance(p_node);
-
-  // 깊이 * 높이 출력
-  Node *result_node = root_;
-  int depth = 0;
-  while (result_node != nullptr && result_node->key != x) {
-    if (result_node->key > x) {
-      result_node = result_node->left;
-    } else {
-      result_node = result_node->right;
+void AvlServer::ProcessLines(Connection *c) {
+  size_t start = 0;
+  while (true) {
+    size_t end = c->in.find('\n', start);
+    if (end == string::npos) {
+      break;
     }
-    depth++;
+    HandleLine(c->in.data() + start, end - start, &c->set, &c->out);
+    start = end + 1;
   }
-
-  cout << depth * result_node->height << '\n';
+  c->in.erase(0, start);
 }
 
-void AvlSet::Prev(int x) {
-  Node *x_node = FindNode(x);
-  Node *y_node = nullptr;
-
-  if (x_node->left) { // 왼쪽 자식이 있는 경우
-    y_node = x_node->left;
-    while (y_node->right) {
-      y_node = y_node->right;
+void AvlServer::HandleLine(const char *line, size_t len, AvlSet **set,
+                           string *out) {
+  // 명령 이름과 인자 하나, 앞뒤와 사이의 공백(\r 포함)은 무시
+  const char *p = line, *end = line + len;
+  const char *token[3];
+  size_t token_len[3];
+  int tokens = 0;
+  while (tokens < 3) {
+    while (p < end && isspace((unsigned char)*p)) {
+      p++;
     }
-  } else { // 왼쪽 자식이 없는 경우
-    Node *cur_node = x_node;
-    Node *p_node = cur_node->parent;
-    while (p_node && p_node->left == cur_node) {
-      cur_node = p_node;
-      p_node = p_node->parent;
+    if (p == end) {
+      break;
     }
-    y_node = p_node;
+    token[tokens] = p;
+    while (p < end && !isspace((unsigned char)*p)) {
+      p++;
+    }
+    token_len[tokens] = p - token[tokens];
+    tokens++;
   }
-
-  // y_node가 없는 경우
-  if (y_node == nullptr) {
-    cout << -1 << '\n';
+  if (tokens == 0) {
+    return; // 빈 줄
+  }
+  if (tokens == 2 && token_len[0] == 3 && memcmp(token[0], "Use", 3) == 0) {
+    *set = SetNamed(string(token[1], token_len[1]));
+    out->append("OK\n");
     return;
   }
 
-  // key값과 깊이 * 높이를 공백으로 구분하여 출력
-  int depth = 0;
-  for (Node *t = y_node; t && t->parent; t = t->parent) {
-    depth++;
+  AvlOp op;
+  long long x = 0;
+  bool ok = tokens <= 2 && ParseAvlOp(token[0], token_len[0], &op) &&
+            AvlOpHasArg(op) == (tokens == 2);
+  if (ok && tokens == 2) { // 부호 있는 10진 정수 (int 범위)
+    const char *d = token[1], *d_end = token[1] + token_len[1];
+    bool negative = (*d == '-');
+    d += negative;
+    ok = (d < d_end);
+    for (; ok && d < d_end; ++d) {
+      ok = isdigit((unsigned char)*d) && x <= INT_MAX;
+      x = x * 10 + (*d - '0');
+    }
+    x = negative ? -x : x;
+    ok = ok && x >= INT_MIN && x <= INT_MAX;
+  }
+  if (!ok) {
+    out->append("ERR\n");
+    return;
   }
-  cout << y_node->key << ' ' << depth * y_node->height << '\n';
+  AppendReply(out, ExecuteChecked(**set, op, (int)x));
 }
 
-void AvlSet::Next(int x) {
-  Node *x_node = FindNode(x);
-  Node *y_node = nullptr;
+AvlReply AvlServer::ExecuteChecked(AvlSet &set, AvlOp op, int x) {
+  if (op == kOpInsert && set.FindNode(x) != nullptr) {
+    return set.FindKey(x); // 중복 노드를 만들지 않는다
+  }
+  if ((op == kOpPrev || op == kOpNext) && set.FindNode(x) == nullptr) {
+    return MakeReply(-1); // AvlSet 의 Prev/Next 는 있는 키만 받는다
+  }
+  return set.Execute(op, x);
+}
 
-  if (x_node->right) { // 오른쪽 자식이 있는 경우
-    y_node = x_node->right;
-    while (y_node->left) {
-      y_node = y_node->left;
-    }
-  } else { // 오른쪽 자식이 없는 경우
-    Node *cur_node = x_node;
-    Node *p_node = cur_node->parent;
-    while (p_node && p_node->right == cur_node) {
-      cur_node = p_node;
-      p_node = p_node->parent;
+bool AvlServer::Flush(Connection *c) {
+  while (c->pending() > 0) {
+    ssize_t n = send(c->fd, c->out.data() + c->out_pos, c->pending(),
+                     MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return false;
     }
-    y_node = p_node;
+    c->out_pos += n;
   }
-  // y_node가 없는 경우
-  if (y_node == nullptr) {
-    cout << -1 << '\n';
-    return;
+  if (c->pending() == 0) {
+    c->out.clear();
+    c->out_pos = 0;
+  } else if (c->out_pos > kMaxPending / 2) { // 보낸 앞부분을 버린다
+    c->out.erase(0, c->out_pos);
+    c->out_pos = 0;
   }
+  return true;
+}
 
-  // key값과 깊이 * 높이를 공백으로 나눠서 출력
-  int depth = 0;
-  for (Node *t = y_node; t && t->parent; t = t->parent) {
-    depth++;
+void AvlServer::UpdateEvents(Connection *c) {
+  uint32_t events = 0;
+  if (!c->closing && c->pending() < kMaxPending) {
+    events |= EPOLLIN;
+  }
+  if (c->pending() > 0) {
+    events |= EPOLLOUT;
   }
+  if (events != c->events) { // 바뀔 때만 시스템 호출
+    epoll_event ev;
+    ev.events = events;
+    ev.data.fd = c->fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = events;
+  }
+}
 
-  cout << y_node->key << ' ' << depth * y_node->height << '\n';
+void AvlServer::Close(Connection *c) {
+  int fd = c->fd;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  connections_.erase(fd); // c 도 해제된다
 }
+#endif
 
-void AvlSet::UpperBound(int x) {
-  Node *cur_node = root_;
-  Node *result_node = nullptr;
+#ifndef AVLSET_NO_MAIN
+// 표준 입력의 테스트 케이스들을 Set 엔진으로 처리
+template <typename Set, typename Hook> void RunTestCases(Hook hook) {
+  int T;
+  cin >> T;
+  while (T--) {
+    Set set;
+    hook.Begin(set);
+    string command;
 
-  while (cur_node) {
-    if (cur_node->key > x) {
-      result_node = cur_node;
-      cur_node = cur_node->left;
-    } else {
-      cur_node = cur_node->right;
+    int Q;
+    cin >> Q;
+    while (Q--) {
+      cin >> command;
+      AvlOp op;
+      if (!ParseAvlOp(command, &op)) {
+        continue;
+      }
+      int x = 0;
+      if (AvlOpHasArg(op) && !(cin >> x)) {
+        continue;
+      }
+      PrintReply(set.Execute(op, x));
     }
+    hook.End(set);
   }
+}
 
-  if (!result_node) {
-    cout << -1 << '\n';
-    return;
-  }
+// RunTestCases 와 같지만 명령을 블록 단위로 모아 ExecuteCommands 로 실행한다
+template <typename Set, typename Hook>
+void RunParallelReads(Hook hook, size_t min_run) {
+  const size_t kBlock = 1 << 16; // 한 번에 모으는 명령 수
+  AvlWorkPool &pool = AvlWorkPool::Default();
+  vector<AvlCommand> commands;
+  vector<AvlReply> replies;
+  auto flush = [&](Set &set) {
+    ExecuteCommands(set, commands, &replies, min_run, pool);
+    for (const AvlReply &reply : replies) {
+      PrintReply(reply);
+    }
+    commands.clear();
+  };
 
-  int depth = 0;
+  int T;
+  cin >> T;
+  while (T--) {
+    Set set;
+    hook.Begin(set);
+    string command;
 
-  Node *t = result_node;
-  while (t != nullptr) {
-    if (t->parent != nullptr) {
-      depth++;
-      t = t->parent;
-    } else {
-      break;
+    int Q;
+    cin >> Q;
+    while (Q--) {
+      cin >> command;
+      AvlOp op;
+      if (!ParseAvlOp(command, &op)) {
+        continue;
+      }
+      int x = 0;
+      if (AvlOpHasArg(op) && !(cin >> x)) {
+        continue;
+      }
+      commands.push_back(AvlCommand{op, x});
+      if (commands.size() == kBlock) {
+        flush(set);
+      }
     }
+    flush(set);
+    hook.End(set);
   }
-
-  cout << result_node->key << ' ' << depth * result_node->height << '\n';
 }
 
-void AvlSet::Rank(int x) {
-  Node *current = root_; // root부터 내려가며 탐색
-  int rank = 0;
-  int depth = 0;
+// 명령행 선택 기능. AvlSet 전용 기능은 다른 엔진에서 무시한다
+struct AppCaseHook {
+  bool lookup_filter = false;
+  bool memory_report = false;
+  bool arena = false; // 노드를 AvlNodeArena 에서 할당
+  AvlArenaOptions arena_options;
 
-  while (current != nullptr) {
-    if (x < current->key) {
-      current = current->left;
-      depth++;
-    } else if (x > current->key) {
-      int leftsize = (current->left != nullptr) ? current->left->size
-                                                : 0; // 왼쪽 서브트리 크기
-      rank += leftsize + 1;                          // 왼쪽 + 현재 노드
-      current = current->right;
-      depth++;
-    } else { // x == cur->key (찾음)
-      int leftsize = (current->left != nullptr) ? current->left->size : 0;
-      rank += leftsize + 1;
-      cout << (depth * current->height) << ' ' << rank << '\n';
-      return;
+  void Begin(AvlSet &set) {
+    set.EnableLookupFilter(lookup_filter);
+    if (arena) {
+      set.EnableArena(arena_options);
     }
   }
+  void Begin(BPlusSet &) {}
+  void Begin(AvlLazySet &) {} // 지연 삭제 엔진은 조회 필터를 쓰지 않는다
 
-  cout << -1 << '\n'; // 못 찾은 경우
-}
+  // 케이스별 통계를 표준 오류로 출력 (표준 출력의 결과는 그대로)
+  template <typename Set> void End(Set &set) {
+    PrintLookupStats(set);
+    if (memory_report) {
+      PrintMemoryUsage(set.MemoryUsage());
+    }
+  }
 
-void AvlSet::Erase(int x) {
-  Node *node = FindNode(x);
-  if (node == nullptr) {
-    cout << -1 << '\n';
-    return;
+  void PrintMemoryUsage(const AvlMemoryUsage &usage) {
+    fprintf(stderr,
+            "memory: keys %zu  nodes %zu B  reserved %zu B  slack %zu B  "
+            "%.1f B/key",
+            usage.keys, usage.node_bytes, usage.reserved_bytes,
+            usage.slack_bytes, usage.bytes_per_key);
+#ifdef __GLIBC__
+    // 삭제로 반환되었지만 힙에 남은 공간 (프로세스 전체)
+    struct mallinfo2 heap = mallinfo2();
+    fprintf(stderr, "  heap in use %zu B  heap free %zu B", heap.uordblks,
+            heap.fordblks);
+#endif
+    fprintf(stderr, "\n");
   }
 
-  // 노드의 깊이*높이 출력
-  int depth = 0;
-  for (Node *t = node; (t != nullptr && t->parent != nullptr); t = t->parent)
-    depth++;
-  cout << depth * node->height << '\n';
+  void PrintLookupStats(BPlusSet &) {}
+  void PrintLookupStats(AvlLazySet &) {}
+  void PrintLookupStats(AvlSet &set) {
+    if (lookup_filter) {
+      const AvlLookupStats &st = set.lookup_stats();
+      double n = st.lookups ? (double)st.lookups : 1.0;
+      fprintf(stderr,
+              "lookup: %llu  filter rejects %.1f%%  false positives %.1f%%  "
+              "cache hits %.1f%%\n",
+              (unsigned long long)st.lookups, 100.0 * st.filter_rejects / n,
+              100.0 * st.false_positives / n, 100.0 * st.cache_hits / n);
+    }
+  }
+};
 
-  Node *delete_target = node; // 실제로 해제될 노드
+#ifdef __linux__
+static AvlServer *g_server = nullptr; // 시그널 처리기가 멈출 서버
 
-  // 자식이 2개인 경우
-  if (node->left != nullptr && node->right != nullptr) {
-    Node *successor = node->right;
-    while (successor->left != nullptr) {
-      successor = successor->left;
-    }
+static void StopServer(int) { g_server->Stop(); }
 
-    node->key = successor->key; // 후임자 값 복사
-    delete_target = successor;  // 삭제할 대상을 후임자로 변경
+// PATH 에서 요청을 받는다. SIGINT/SIGTERM 을 받으면 끝낸다
+static int Serve(const string &path, AppCaseHook hook) {
+  AvlServer server(path, [hook](AvlSet &set) mutable { hook.Begin(set); });
+  if (!server.Listen()) {
+    cerr << "cannot listen on " << path << '\n';
+    return 1;
   }
+  g_server = &server;
+  signal(SIGINT, StopServer);
+  signal(SIGTERM, StopServer);
+  server.Run();
+  g_server = nullptr;
+  return 0;
+}
+#endif
 
-  // 그 외의 경우(자식이 0개 또는 1개) (Case 1을 거치면 delete_target은 항상 이
-  // 상태가 됨)
-  Node *child_node = (delete_target->left != nullptr) ? delete_target->left
-                                                      : delete_target->right;
-  Node *parent_node = delete_target->parent;
-
-  // 삭제할 노드의 자식과 부모를 서로 연결
-  if (child_node != nullptr) {
-    child_node->parent = parent_node;
+// 표준 입력의 이진 명령 스트림을 처리한다. 결과는 이진 결과 스트림으로
+// (text_output 이면 순차 모드와 같은 텍스트로) 출력한다
+template <typename Set> bool RunBinary(AppCaseHook hook, bool text_output) {
+  if (text_output) {
+    AvlTextWriter writer(stdout);
+    return RunBinaryCases<Set>(cin, writer, hook);
   }
-  if (parent_node == nullptr) {
-    root_ = child_node;
-  } else if (parent_node->left == delete_target) {
-    parent_node->left = child_node;
+  AvlBinaryWriter writer(stdout);
+  writer.WriteResultHeader();
+  return RunBinaryCases<Set>(cin, writer, hook);
+}
+
+// 선택한 실행 방식으로 Set 엔진을 돌린다
+template <typename Set>
+void RunEngine(AppCaseHook hook, bool pipeline, size_t min_read_run) {
+  if (min_read_run > 0) {
+    RunParallelReads<Set>(hook, min_read_run);
+  } else if (pipeline) {
+    RunPipelined<Set>(stdin, stdout, hook);
   } else {
-    parent_node->right = child_node;
+    RunTestCases<Set>(hook);
   }
+}
 
-  delete delete_target;
-  n_--;
+// 입력 형식과 실행 방식 (main 의 명령행 옵션)
+struct AppRunMode {
+  bool binary = false; // 이진 명령 입력
+  bool text_output = false;
+  bool pipeline = false;
+  size_t min_read_run = 0; // 0 이면 읽기 구간 병렬 실행을 끔
+};
 
-  if (parent_node != nullptr) {
-    ReBalance(parent_node); // 균형 재조정
+// mode 에 맞게 Set 엔진을 돌린다. 이진 입력의 헤더가 올바르지 않으면 false
+template <typename Set>
+bool RunInput(AppCaseHook hook, const AppRunMode &mode) {
+  if (mode.binary) {
+    return RunBinary<Set>(hook, mode.text_output);
   }
+  RunEngine<Set>(hook, mode.pipeline, mode.min_read_run);
+  return true;
 }
-#ifndef AVLSET_NO_MAIN
-int main(void) {
+
+// RunInput 과 같지만 latency 가 있으면 명령마다 걸린 시간을 기록한다
+template <typename Set>
+bool RunSelected(AppCaseHook hook, const AppRunMode &mode,
+                 AvlLatencyRecorder *latency) {
+  if (latency == nullptr) {
+    return RunInput<Set>(hook, mode);
+  }
+  AvlTimedSet<Set>::recorder = latency;
+  return RunInput<AvlTimedSet<Set>>(hook, mode);
+}
+
+int main(int argc, char **argv) {
   ios_base::sync_with_stdio(false);
   cin.tie(nullptr);
   cout.tie(nullptr);
 
-  int T;
-  cin >> T;
-  while (T--) {
-    AvlSet set;
-    string command;
+  // --engine=avl (기본값), --engine=bptree 또는 --engine=lazy
+  // --pipeline: 입력 해석, 연산, 출력을 각각의 스레드에서 처리
+  // --lookup-filter: Find/Rank 앞에 Bloom 필터와 캐시를 두고 통계를 출력
+  // --memory-report: 케이스마다 메모리 사용량 요약을 출력
+  // --parallel-reads[=N]: 길이 N(기본 256) 이상의 읽기 명령 구간을 병렬 실행
+  // --huge-pages: AvlSet 노드를 2MB 페이지 arena 에서 할당
+  // --numa-node=N: AvlSet 노드 arena 를 NUMA 노드 N 에 묶음 (libnuma 필요)
+  // --serve=PATH: 표준 입력 대신 Unix 도메인 소켓 PATH 에서 명령을 받음
+  // --text-output: 이진 명령 입력의 결과도 텍스트로 출력
+  // --latency-json=PATH: 명령 종류별 지연 시간 분포를 끝날 때 PATH 에 JSON 으로
+  // 입력이 "AVLB" 로 시작하면 이진 명령 스트림으로 읽는다 (순차 모드만)
+  string engine = "avl";
+  string serve_path;
+  string latency_path;
+  AppRunMode mode;
+  AppCaseHook hook;
+  hook.arena_options.huge_pages = false; // --huge-pages 로만 켠다
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg == "--engine=avl" || arg == "--engine=bptree" ||
+        arg == "--engine=lazy") {
+      engine = arg.substr(9);
+    } else if (arg == "--pipeline") {
+      mode.pipeline = true;
+    } else if (arg == "--lookup-filter") {
+      hook.lookup_filter = true;
+    } else if (arg == "--memory-report") {
+      hook.memory_report = true;
+    } else if (arg == "--parallel-reads") {
+      mode.min_read_run = 256;
+    } else if (arg.compare(0, 17, "--parallel-reads=") == 0 &&
+               atoi(arg.c_str() + 17) > 0) {
+      mode.min_read_run = (size_t)atoi(arg.c_str() + 17);
+    } else if (arg == "--huge-pages") {
+      hook.arena = true;
+      hook.arena_options.huge_pages = true;
+    } else if (arg.compare(0, 12, "--numa-node=") == 0 &&
+               isdigit((unsigned char)arg[12])) {
+      hook.arena = true;
+      hook.arena_options.numa_node = atoi(arg.c_str() + 12);
+    } else if (arg == "--text-output") {
+      mode.text_output = true;
+    } else if (arg.compare(0, 8, "--serve=") == 0 && arg.size() > 8) {
+      serve_path = arg.substr(8);
+    } else if (arg.compare(0, 15, "--latency-json=") == 0 && arg.size() > 15) {
+      latency_path = arg.substr(15);
+    } else {
+      cerr << "unknown option: " << arg << '\n';
+      return 1;
+    }
+  }
 
-    int Q;
-    cin >> Q;
-    while (Q--) {
-      cin >> command;
-      int x;
-      if (command == "Find") {
-        if (cin >> x)
-          set.Find(x);
-      } else if (command == "Insert") {
-        if (cin >> x)
-          set.Insert(x);
-      } else if (command == "Empty") {
-        set.Empty();
-      } else if (command == "Size") {
-        set.Size();
-      } else if (command == "Prev") {
-        if (cin >> x)
-          set.Prev(x);
-      } else if (command == "Next") {
-        if (cin >> x)
-          set.Next(x);
-      } else if (command == "UpperBound") {
-        if (cin >> x)
-          set.UpperBound(x);
-      } else if (command == "Rank") {
-        if (cin >> x)
-          set.Rank(x);
-      } else if (command == "Erase") {
-        if (cin >> x)
-          set.Erase(x);
-      }
+  if (mode.min_read_run > 0 && (mode.pipeline || hook.lookup_filter)) {
+    // 조회 필터는 읽기 중에도 캐시와 통계를 바꾼다
+    cerr << "--parallel-reads cannot be combined with --pipeline or "
+            "--lookup-filter\n";
+    return 1;
+  }
+
+  if (!serve_path.empty()) {
+#ifdef __linux__
+    if (engine != "avl" || mode.pipeline || mode.min_read_run > 0 ||
+        !latency_path.empty()) {
+      cerr << "--serve supports only the avl engine in sequential mode "
+              "without --latency-json\n";
+      return 1;
     }
+    return Serve(serve_path, hook);
+#else
+    cerr << "--serve is not supported on this platform\n";
+    return 1;
+#endif
   }
 
+  // 읽기 구간은 여러 스레드가 나눠 실행하므로 기록기를 함께 쓸 수 없다
+  if (!latency_path.empty() && mode.min_read_run > 0) {
+    cerr << "--latency-json cannot be combined with --parallel-reads\n";
+    return 1;
+  }
+  AvlLatencyRecorder latency;
+  FILE *latency_file = nullptr; // 실행 전에 열어 경로 오류를 먼저 알린다
+  if (!latency_path.empty() &&
+      (latency_file = fopen(latency_path.c_str(), "w")) == nullptr) {
+    cerr << "cannot open " << latency_path << '\n';
+    return 1;
+  }
+
+  // 파이프라인 모드는 표준 입력을 FILE 로 읽으므로 cin 대신 stdin 에서 엿본다
+  int first;
+  if (mode.pipeline) {
+    first = getc(stdin);
+    ungetc(first, stdin);
+  } else {
+    first = cin.peek();
+  }
+  mode.binary = first == kAvlBinaryMagic[0];
+  if (mode.binary && (mode.pipeline || mode.min_read_run > 0)) {
+    cerr << "binary input cannot be combined with --pipeline or "
+            "--parallel-reads\n";
+    return 1;
+  }
+  AvlLatencyRecorder *recorder = latency_file ? &latency : nullptr;
+  bool ok = (engine == "bptree")
+                ? RunSelected<BPlusSet>(hook, mode, recorder)
+            : (engine == "lazy") ? RunSelected<AvlLazySet>(hook, mode, recorder)
+                                 : RunSelected<AvlSet>(hook, mode, recorder);
+  if (latency_file) {
+    latency.WriteJson(latency_file);
+    fclose(latency_file);
+  }
+  if (!ok) {
+    cerr << "invalid binary command stream header\n";
+    return 1;
+  }
   return 0;
 }
-#endif
\ No newline at end of file
+#endif
@@ -1,11 +1,16 @@
 #include <functional>
 #include <gtest/gtest.h>
 #include <iostream>
+#include <map>
+#include <random>
+#include <set>
 #include <sstream>
 #include <string>
 #include <tuple>
 #include <vector>
 
+#include <sys/wait.h>
+
 using namespace std;
 
 #include "src/AVLSet.cpp"
@@ -1003,4 +1008,1958 @@ TEST_F(AVLSetTest, Erase_TriggerRotation) {
   // 부모 연결 확인
   EXPECT_EQ(s.root_->left->parent, s.root_);
   EXPECT_EQ(s.root_->right->parent, s.root_);
-}
\ No newline at end of file
+}
+
+// -------------------------FindBatch & RankBatch 테스트--------------------------
+
+// 구조: {5, 10, 15, 20(Root), 25, 30, 40}
+TEST_F(PrevNextTest, FindBatch_MatchesFind) {
+  // 그룹 크기(8)를 넘는 입력, 없는 키, 중복 키 포함
+  vector<int> keys = {40, 5, 12, 20, 25, 100, 10, 15, 30, 0, 20, 5};
+  vector<int> result = s.FindBatch(keys);
+
+  ASSERT_EQ(result.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    // 결과는 입력 순서대로 단일 Find 출력과 같아야 함
+    string expected = OneToken(CaptureStdout([&] { s.Find(keys[i]); }));
+    EXPECT_EQ(expected, to_string(result[i])) << "key " << keys[i];
+  }
+}
+
+TEST_F(PrevNextTest, RankBatch_MatchesRank) {
+  vector<int> keys = {5, 10, 20, 40, 25, 12, 0, 100, 30, 15};
+  vector<pair<int, int>> result = s.RankBatch(keys);
+
+  ASSERT_EQ(result.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    string expected = GetTrimmedOutput([&] { s.Rank(keys[i]); });
+    string actual = (result[i].first == -1)
+                        ? "-1"
+                        : to_string(result[i].first) + " " +
+                              to_string(result[i].second);
+    EXPECT_EQ(expected, actual) << "key " << keys[i];
+  }
+}
+
+TEST_F(AVLSetTest, FindBatch_EmptyInput) {
+  EXPECT_TRUE(s.FindBatch({}).empty());
+  EXPECT_EQ(s.FindBatch({1, 2}), vector<int>({-1, -1}));
+  EXPECT_TRUE(s.RankBatch({}).empty());
+}
+
+// -------------------------Save & Load 테스트--------------------------
+
+// 저장 후 복원한 트리와 mmap 뷰가 원본과 같은 출력을 내는지 확인
+TEST_F(PrevNextTest, SaveLoad_RoundTrip) {
+  const char *path = "avlset_snapshot_test.bin";
+  ASSERT_TRUE(s.Save(path));
+
+  AvlSet loaded;
+  ASSERT_TRUE(loaded.Load(path));
+  EXPECT_EQ(loaded.n_, s.n_);
+
+  AvlSetView view;
+  ASSERT_TRUE(view.Open(path));
+
+  for (int x : {0, 5, 10, 12, 15, 20, 25, 30, 40, 50}) {
+    string expected = CaptureStdout([&] {
+      s.Find(x);
+      s.Rank(x);
+      s.UpperBound(x);
+    });
+    EXPECT_EQ(expected, CaptureStdout([&] {
+                loaded.Find(x);
+                loaded.Rank(x);
+                loaded.UpperBound(x);
+              }));
+    EXPECT_EQ(expected, CaptureStdout([&] {
+                view.Find(x);
+                view.Rank(x);
+                view.UpperBound(x);
+              }));
+  }
+  for (int x : {5, 15, 20, 25, 40}) {
+    string expected = CaptureStdout([&] {
+      s.Prev(x);
+      s.Next(x);
+    });
+    EXPECT_EQ(expected, CaptureStdout([&] {
+                loaded.Prev(x);
+                loaded.Next(x);
+              }));
+    EXPECT_EQ(expected, CaptureStdout([&] {
+                view.Prev(x);
+                view.Next(x);
+              }));
+  }
+  EXPECT_EQ("7", OneToken(CaptureStdout([&] { view.Size(); })));
+
+  // 복원한 트리도 일반 트리처럼 수정 가능 (slab 노드 재사용 포함)
+  auto mutate = [](AvlSet &set) {
+    set.Erase(20);
+    set.Erase(5);
+    set.Insert(22);
+    set.Insert(1);
+    for (int x : {1, 10, 15, 22, 25, 30, 40}) {
+      set.Rank(x);
+    }
+  };
+  EXPECT_EQ(CaptureStdout([&] { mutate(s); }),
+            CaptureStdout([&] { mutate(loaded); }));
+  EXPECT_EQ(loaded.n_, 7);
+
+  remove(path);
+}
+
+TEST_F(AVLSetTest, Load_RejectsCorruptFile) {
+  const char *path = "avlset_snapshot_corrupt.bin";
+  CaptureStdout([&] {
+    s.Insert(10);
+    s.Insert(20);
+  });
+  ASSERT_TRUE(s.Save(path));
+
+  // 노드 영역의 한 바이트를 변조하면 체크섬 검증에 실패해야 함
+  FILE *fp = fopen(path, "r+b");
+  ASSERT_NE(fp, nullptr);
+  fseek(fp, sizeof(AvlSnapshotHeader), SEEK_SET);
+  fputc(0x7f, fp);
+  fclose(fp);
+
+  AvlSet loaded;
+  EXPECT_FALSE(loaded.Load(path));
+  AvlSetView view;
+  EXPECT_FALSE(view.Open(path));
+  EXPECT_FALSE(loaded.Load("avlset_snapshot_missing.bin"));
+
+  remove(path);
+}
+
+// 체크섬은 맞지만 트리가 아닌 노드 배열 (순환, 공유 자식, 끊긴 노드)은 거부
+TEST_F(AVLSetTest, Load_RejectsNonTreeShape) {
+  const char *path = "avlset_snapshot_shape.bin";
+  auto write = [&](vector<AvlSnapshotNode> nodes) {
+    AvlSnapshotHeader h;
+    memcpy(h.magic, kAvlSnapshotMagic, 4);
+    h.version = kAvlSnapshotVersion;
+    h.count = (uint32_t)nodes.size();
+    h.root = 0;
+    h.checksum =
+        AvlChecksum(nodes.data(), nodes.size() * sizeof(AvlSnapshotNode));
+    h.epoch = 0;
+    FILE *fp = fopen(path, "wb");
+    ASSERT_NE(fp, nullptr);
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(nodes.data(), sizeof(AvlSnapshotNode), nodes.size(), fp);
+    fclose(fp);
+  };
+  auto rejected = [&] {
+    AvlSet loaded;
+    AvlSetView view;
+    return !loaded.Load(path) && !view.Open(path);
+  };
+
+  write({{20, 2, 3, 1, 2}, {10, 1, 1, -1, -1}, {30, 1, 1, -1, -1}});
+  AvlSet ok;
+  ASSERT_TRUE(ok.Load(path));
+  EXPECT_EQ(ok.n_, 3);
+
+  write({{20, 2, 2, 1, -1}, {10, 1, 1, -1, 0}}); // 루트로 돌아가는 순환
+  EXPECT_TRUE(rejected());
+  write({{20, 2, 3, 1, 1}, {10, 1, 1, -1, -1}}); // 두 자식이 같은 노드
+  EXPECT_TRUE(rejected());
+  write({{20, 2, 3, 1, -1}, {10, 1, 1, -1, 2}, // 서로 다른 부모가 공유
+         {15, 1, 1, -1, -1}, {30, 1, 1, 2, -1}});
+  EXPECT_TRUE(rejected());
+  write({{20, 1, 1, -1, -1}, {10, 1, 1, 2, -1}, // 루트에서 끊긴 순환
+         {30, 1, 1, 1, -1}});
+  EXPECT_TRUE(rejected());
+
+  remove(path);
+}
+
+TEST_F(AVLSetTest, SaveLoad_EmptyTree) {
+  const char *path = "avlset_snapshot_empty.bin";
+  ASSERT_TRUE(s.Save(path));
+  AvlSet loaded;
+  ASSERT_TRUE(loaded.Load(path));
+  EXPECT_EQ(loaded.root_, nullptr);
+  EXPECT_EQ("1", OneToken(CaptureStdout([&] { loaded.Empty(); })));
+  remove(path);
+}
+
+// -------------------------작업 로그 & Checkpoint 테스트--------------------------
+
+// 로그만으로 복구, 체크포인트 이후 꼬리만 재생하여 복구
+TEST_F(AVLSetTest, Log_RecoverAfterCheckpoint) {
+  const char *snapshot = "avlset_wal_test.snap";
+  const char *log_path = "avlset_wal_test.log";
+  remove(snapshot);
+
+  {
+    AvlSetLog log(4);
+    ASSERT_TRUE(log.Open(log_path, 0));
+    AvlSet set;
+    set.AttachLog(&log);
+    CaptureStdout([&] {
+      for (int x : {50, 20, 80, 10, 30})
+        set.Insert(x);
+      set.Erase(20);
+      set.Erase(99); // 없는 키 삭제는 기록되지 않음
+    });
+  } // 소멸 시 남은 기록 커밋
+
+  AvlSet recovered;
+  ASSERT_TRUE(recovered.Recover(snapshot, log_path));
+  EXPECT_EQ(recovered.n_, 4);
+  EXPECT_EQ(recovered.FindNode(20), nullptr);
+  EXPECT_NE(recovered.FindNode(30), nullptr);
+
+  // 체크포인트 후의 변경만 로그에 남는다
+  AvlSetLog log(1);
+  ASSERT_TRUE(log.Open(log_path, recovered.epoch_));
+  recovered.AttachLog(&log);
+  ASSERT_TRUE(recovered.Checkpoint(snapshot));
+  EXPECT_EQ(log.epoch(), recovered.epoch_);
+  CaptureStdout([&] {
+    recovered.Insert(60);
+    recovered.Erase(50);
+  });
+
+  uint64_t epoch = 0;
+  vector<AvlLogRecord> records;
+  ASSERT_TRUE(AvlSetLog::Read(log_path, &epoch, &records));
+  EXPECT_EQ(epoch, recovered.epoch_);
+  ASSERT_EQ(records.size(), 2u);
+
+  AvlSet again;
+  ASSERT_TRUE(again.Recover(snapshot, log_path));
+  string expected = CaptureStdout([&] {
+    for (int x : {10, 30, 50, 60, 80})
+      recovered.Rank(x);
+  });
+  EXPECT_EQ(expected, CaptureStdout([&] {
+              for (int x : {10, 30, 50, 60, 80})
+                again.Rank(x);
+            }));
+
+  remove(snapshot);
+  remove(log_path);
+}
+
+// 이전 세대의 로그는 재생하지 않고, 끊긴 마지막 기록은 무시
+TEST_F(AVLSetTest, Log_StaleAndTornRecords) {
+  const char *snapshot = "avlset_wal_stale.snap";
+  const char *log_path = "avlset_wal_stale.log";
+
+  CaptureStdout([&] {
+    s.Insert(1);
+    s.Insert(2);
+  });
+  s.epoch_ = 3;
+  ASSERT_TRUE(s.Save(snapshot));
+
+  {
+    AvlSetLog log(1);
+    ASSERT_TRUE(log.Open(log_path, 2)); // 스냅샷보다 오래된 세대
+    log.Append(AvlSetLog::kInsert, 7);
+  }
+  AvlSet recovered;
+  ASSERT_TRUE(recovered.Recover(snapshot, log_path));
+  EXPECT_EQ(recovered.n_, 2);
+
+  {
+    AvlSetLog log(1);
+    ASSERT_TRUE(log.Open(log_path, 3));
+    log.Append(AvlSetLog::kInsert, 7);
+  }
+  // 마지막 기록의 절반만 쓰인 상황
+  FILE *fp = fopen(log_path, "ab");
+  ASSERT_NE(fp, nullptr);
+  fputc(0x01, fp);
+  fputc(0x02, fp);
+  fclose(fp);
+
+  AvlSet again;
+  ASSERT_TRUE(again.Recover(snapshot, log_path));
+  EXPECT_EQ(again.n_, 3);
+  EXPECT_NE(again.FindNode(7), nullptr);
+
+  remove(snapshot);
+  remove(log_path);
+}
+
+// Checkpoint 의 Reset 이 실패하면 세대를 되돌리고, 로그는 다음 Checkpoint
+// 까지 기록을 거부한다
+TEST(LogTest, FailedResetKeepsEpochAndRefusesAppends) {
+  const char *snapshot = "avlset_wal_reset.snap";
+  const char *log_path = "avlset_wal_reset.log";
+  remove(snapshot);
+  remove(log_path);
+
+  int probe = open("/dev/null", O_RDONLY); // 로그가 받을 가장 작은 fd 번호
+  ASSERT_GE(probe, 0);
+  close(probe);
+  AvlSetLog log(1);
+  ASSERT_TRUE(log.Open(log_path, 0));
+  char link[256] = {0};
+  string fd_path = "/proc/self/fd/" + to_string(probe);
+  ASSERT_GT(readlink(fd_path.c_str(), link, sizeof(link) - 1), 0);
+  ASSERT_NE(nullptr, strstr(link, log_path));
+
+  AvlSet s;
+  s.AttachLog(&log);
+  s.InsertKey(1);
+  int saved = dup(probe);
+  int read_only = open(log_path, O_RDONLY);
+  ASSERT_GE(read_only, 0);
+  ASSERT_EQ(probe, dup2(read_only, probe)); // 이제 로그 fd 에 쓸 수 없다
+  close(read_only);
+
+  EXPECT_FALSE(s.Checkpoint(snapshot)); // 스냅샷은 바꿨지만 Reset 실패
+  EXPECT_EQ(0u, s.epoch_);
+  EXPECT_EQ(0u, log.epoch());
+  EXPECT_TRUE(log.broken());
+  s.InsertKey(2);
+  EXPECT_FALSE(log.Append(AvlSetLog::kInsert, 3));
+  EXPECT_FALSE(log.Commit());
+
+  ASSERT_EQ(probe, dup2(saved, probe)); // 디스크가 돌아왔다
+  close(saved);
+  ASSERT_TRUE(s.Checkpoint(snapshot));
+  EXPECT_FALSE(log.broken());
+  EXPECT_EQ(1u, s.epoch_);
+  EXPECT_EQ(1u, log.epoch());
+  s.InsertKey(4);
+  log.Commit();
+
+  AvlSet recovered;
+  ASSERT_TRUE(recovered.Recover(snapshot, log_path));
+  EXPECT_EQ(3, recovered.n_);
+  EXPECT_NE(nullptr, recovered.FindNode(4)); // 새 세대의 기록이 재생된다
+  log.Close();
+  remove(snapshot);
+  remove(log_path);
+}
+
+// -------------------------AvlBlockSet 테스트--------------------------
+
+// 무작위 삽입/삭제 후 std::set 과 내용, 순위가 같은지 확인
+TEST(AvlBlockSetTest, MatchesStdSet) {
+  AvlBlockSet blocks;
+  std::set<int64_t> expected;
+  std::mt19937_64 rng(7);
+  const int64_t base = 1700000000000000000LL; // 타임스탬프 형태의 큰 키
+
+  for (int i = 0; i < 20000; ++i) {
+    int64_t x;
+    if (i % 10 == 0) { // 가끔은 멀리 떨어진 키 (차이값 범위 초과)
+      x = (int64_t)(rng() >> 1) - (1LL << 61);
+    } else {
+      x = base + (int64_t)(rng() % 50000);
+    }
+    if (rng() % 3 == 0) {
+      EXPECT_EQ(expected.erase(x) == 1, blocks.Erase(x));
+    } else {
+      EXPECT_EQ(expected.insert(x).second, blocks.Insert(x));
+    }
+  }
+
+  ASSERT_EQ((int)expected.size(), blocks.Size());
+  vector<int64_t> scanned;
+  blocks.ForEach([&](int64_t key) { scanned.push_back(key); });
+  EXPECT_EQ(vector<int64_t>(expected.begin(), expected.end()), scanned);
+
+  int rank = 0;
+  for (int64_t x : expected) {
+    ++rank;
+    if (rank % 37 == 0) {
+      EXPECT_EQ(rank, blocks.Rank(x));
+      EXPECT_TRUE(blocks.Contains(x));
+    }
+  }
+  EXPECT_EQ(-1, blocks.Rank(base - 1));
+  EXPECT_FALSE(blocks.Contains(base + 50001));
+}
+
+// 연속된 키는 키 하나당 AvlSet::Node 보다 훨씬 적은 메모리를 사용
+TEST(AvlBlockSetTest, CompressesClusteredKeys) {
+  AvlBlockSet blocks;
+  for (int64_t i = 0; i < 10000; ++i) {
+    blocks.Insert(1700000000000LL + i * 1000);
+  }
+  double per_key = (double)blocks.MemoryBytes() / blocks.Size();
+  EXPECT_LT(per_key * 3, (double)sizeof(AvlSet::Node));
+
+  // 모두 지우면 블록도 모두 해제
+  for (int64_t i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(blocks.Erase(1700000000000LL + i * 1000));
+  }
+  EXPECT_TRUE(blocks.Empty());
+  EXPECT_EQ(blocks.root_, nullptr);
+  EXPECT_EQ(blocks.blocks_, 0);
+}
+
+// -------------------------BPlusSet 테스트--------------------------
+
+// 무작위 명령에 대해 키, 순위, 존재 여부가 AvlSet 과 같은지 확인
+// (깊이*높이 값은 엔진마다 다르므로 비교하지 않음)
+TEST(BPlusSetTest, MatchesAvlSetSemantics) {
+  AvlSet avl;
+  BPlusSet bpt;
+  std::mt19937 rng(3);
+  vector<int> present;
+
+  for (int i = 0; i < 20000; ++i) {
+    int x = (int)(rng() % 5000);
+    int kind = (int)(rng() % 6);
+    AvlOp op;
+    if (kind == 0 && avl.FindNode(x) == nullptr) {
+      op = kOpInsert;
+    } else if (kind == 1) {
+      op = kOpErase;
+    } else if (kind == 2) {
+      op = kOpRank;
+    } else if (kind == 3) {
+      op = kOpUpperBound;
+    } else if (kind == 4 && avl.FindNode(x) != nullptr) {
+      op = (rng() % 2) ? kOpPrev : kOpNext; // AvlSet 은 x 가 존재해야 함
+    } else {
+      op = kOpFind;
+    }
+
+    AvlReply a = avl.Execute(op, x);
+    AvlReply b = bpt.Execute(op, x);
+    ASSERT_EQ(a.count, b.count) << kAvlOpNames[op] << ' ' << x;
+    ASSERT_EQ(a.v[0] == -1, b.v[0] == -1) << kAvlOpNames[op] << ' ' << x;
+    if (op == kOpRank && a.count == 2) {
+      ASSERT_EQ(a.v[1], b.v[1]) << "Rank " << x;
+    } else if (a.count == 2) {
+      ASSERT_EQ(a.v[0], b.v[0]) << kAvlOpNames[op] << ' ' << x;
+    }
+  }
+  EXPECT_EQ(avl.Execute(kOpSize, 0).v[0], bpt.Execute(kOpSize, 0).v[0]);
+}
+
+TEST(BPlusSetTest, GrowsAndShrinks) {
+  BPlusSet bpt;
+  EXPECT_EQ("1", OneToken(CaptureStdout([&] { bpt.Empty(); })));
+  for (int i = 0; i < 1000; ++i) {
+    bpt.Execute(kOpInsert, i);
+  }
+  EXPECT_EQ(bpt.n_, 1000);
+  EXPECT_GT(bpt.levels_, 2);
+
+  // 중복 삽입은 무시
+  bpt.Execute(kOpInsert, 10);
+  EXPECT_EQ(bpt.n_, 1000);
+
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_NE(-1, bpt.Execute(kOpErase, i).v[0]);
+  }
+  EXPECT_EQ(bpt.root_, nullptr);
+  EXPECT_EQ(bpt.levels_, 0);
+  EXPECT_EQ("-1", OneToken(CaptureStdout([&] { bpt.Erase(5); })));
+}
+
+// 루트가 아닌 노드가 절반 이상 차 있고 sizes 와 구분 키가 맞는지 확인.
+// 부분트리의 키 개수를 돌려준다
+static int CheckBPlusNode(void *node, int level, bool root, int lo, int hi) {
+  if (level == 0) {
+    BPlusSet::Leaf *leaf = static_cast<BPlusSet::Leaf *>(node);
+    EXPECT_TRUE(root || leaf->count >= BPlusSet::kLeafMin);
+    for (int i = 0; i < leaf->count; ++i) {
+      EXPECT_TRUE(leaf->keys[i] >= lo && leaf->keys[i] < hi);
+      EXPECT_TRUE(i == 0 || leaf->keys[i - 1] < leaf->keys[i]);
+    }
+    return leaf->count;
+  }
+  BPlusSet::Inner *in = static_cast<BPlusSet::Inner *>(node);
+  EXPECT_GE(in->count, root ? 2 : (int)BPlusSet::kInnerMin);
+  EXPECT_LT(in->count, (int)BPlusSet::kInnerCap);
+  int total = 0;
+  for (int i = 0; i < in->count; ++i) {
+    int l = (i == 0) ? lo : in->keys[i - 1];
+    int h = (i == in->count - 1) ? hi : in->keys[i];
+    int n = CheckBPlusNode(in->children[i], level - 1, false, l, h);
+    EXPECT_EQ(in->sizes[i], n);
+    total += n;
+  }
+  return total;
+}
+
+// 대량 삭제 후에도 덜 찬 노드가 병합되어 노드 수가 남은 키 수에 비례하는지
+TEST(BPlusSetTest, MassEraseMergesNodes) {
+  BPlusSet bpt;
+  std::mt19937 rng(17);
+  vector<int> keys(20000);
+  for (int i = 0; i < (int)keys.size(); ++i) {
+    keys[i] = i * 3;
+  }
+  std::shuffle(keys.begin(), keys.end(), rng);
+  for (int x : keys) {
+    bpt.Execute(kOpInsert, x);
+  }
+  std::shuffle(keys.begin(), keys.end(), rng);
+  std::set<int> left(keys.begin(), keys.end());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    ASSERT_NE(-1, bpt.Execute(kOpErase, keys[i]).v[0]);
+    left.erase(keys[i]);
+    if (i % 997 == 0 || left.size() < 40) {
+      ASSERT_EQ((int)left.size(),
+                bpt.root_ ? CheckBPlusNode(bpt.root_, bpt.levels_ - 1, true,
+                                           INT_MIN, INT_MAX)
+                          : 0);
+    }
+    if (left.size() == 500) {
+      // 리프는 최소 kLeafMin 개, 내부 노드는 최소 kInnerMin 개를 담는다
+      AvlMemoryUsage mem = bpt.MemoryUsage();
+      size_t max_leaves = 500 / BPlusSet::kLeafMin;
+      size_t max_inners = max_leaves / (BPlusSet::kInnerMin - 1) + 1;
+      EXPECT_LE(mem.node_bytes, max_leaves * sizeof(BPlusSet::Leaf) +
+                                    max_inners * sizeof(BPlusSet::Inner));
+      int k = 1;
+      for (int x : left) {
+        ASSERT_EQ(x, bpt.Execute(kOpNext, x - 1).v[0]);
+        ASSERT_EQ(k++, bpt.Execute(kOpRank, x).v[1]);
+      }
+    }
+  }
+  EXPECT_EQ(bpt.root_, nullptr);
+  EXPECT_EQ(bpt.levels_, 0);
+}
+
+// -------------------------AvlAggSet 테스트--------------------------
+// 노드 값을 모르는 Load/EnableArena 가 AvlSet& 로 불리지 않는다
+static_assert(!is_convertible<AvlAggSet<AvlSumMonoid> *, AvlSet *>::value,
+              "AvlAggSet must not convert to AvlSet");
+
+
+// 회전과 삭제(후임자 값 이동 포함)를 거쳐도 구간 합성값이 정확한지 확인
+TEST(AvlAggSetTest, RangeAggregatesMatchScan) {
+  AvlAggSet<AvlSumMonoid> sums;
+  AvlAggSet<AvlMinMonoid> mins;
+  std::map<int, long long> expected; // key -> value
+  std::mt19937 rng(11);
+
+  for (int i = 0; i < 3000; ++i) {
+    int x = (int)(rng() % 1000);
+    if (rng() % 4 == 0) {
+      if (expected.erase(x)) {
+        sums.EraseKey(x);
+        mins.EraseKey(x);
+      }
+    } else if (expected.count(x) == 0) {
+      long long v = (long long)(rng() % 100) - 20;
+      expected[x] = v;
+      sums.InsertKey(x, v);
+      mins.InsertKey(x, v);
+    }
+  }
+
+  for (int q = 0; q < 300; ++q) {
+    int lo = (int)(rng() % 1000), hi = (int)(rng() % 1000);
+    long long sum = 0, mn = LLONG_MAX;
+    for (auto it = expected.lower_bound(lo);
+         it != expected.end() && it->first <= hi; ++it) {
+      sum += it->second;
+      mn = std::min(mn, it->second);
+    }
+    EXPECT_EQ(sum, sums.Aggregate(lo, hi)) << lo << ' ' << hi;
+    EXPECT_EQ(mn, mins.Aggregate(lo, hi)) << lo << ' ' << hi;
+  }
+}
+
+// 값 없이 삽입하면 키 자체가 값 (키의 합)
+TEST(AvlAggSetTest, DefaultValueIsKeyAndSetValue) {
+  AvlAggSet<AvlSumMonoid> sums;
+  CaptureStdout([&] {
+    for (int x : {10, 20, 30, 40, 50})
+      sums.Insert(x);
+  });
+  EXPECT_EQ(150, sums.Aggregate(0, 100));
+  EXPECT_EQ(90, sums.Aggregate(20, 40));
+  EXPECT_EQ(0, sums.Aggregate(21, 29));
+
+  EXPECT_TRUE(sums.SetValue(30, 1));
+  EXPECT_FALSE(sums.SetValue(35, 1));
+  EXPECT_EQ(61, sums.Aggregate(20, 40));
+}
+
+// 누적 가중치로 k 번째 찾기
+TEST(AvlAggSetTest, KthByWeight) {
+  AvlAggSet<AvlSumMonoid> weights;
+  weights.InsertKey(1, 5);  // 누적 1..5
+  weights.InsertKey(2, 0);  // 가중치 0은 선택되지 않음
+  weights.InsertKey(3, 10); // 누적 6..15
+  weights.InsertKey(7, 1);  // 누적 16
+
+  EXPECT_EQ(1, weights.KthByWeight(1));
+  EXPECT_EQ(1, weights.KthByWeight(5));
+  EXPECT_EQ(3, weights.KthByWeight(6));
+  EXPECT_EQ(3, weights.KthByWeight(15));
+  EXPECT_EQ(7, weights.KthByWeight(16));
+  EXPECT_EQ(-1, weights.KthByWeight(17));
+}
+
+// -------------------------파이프라인 모드 테스트--------------------------
+
+// 여러 테스트 케이스, 알 수 없는 명령, 배치 크기를 넘는 입력에서도
+// 순차 실행과 같은 출력을 같은 순서로 내는지 확인
+TEST(PipelineTest, MatchesSequentialOutput) {
+  std::mt19937 rng(21);
+  string input = "3\n";
+  string expected;
+  for (int t = 0; t < 3; ++t) {
+    int q = 6000;
+    input += to_string(q) + "\n";
+    AvlSet set;
+    for (int i = 0; i < q; ++i) {
+      int x = (int)(rng() % 3000);
+      AvlOp op = (AvlOp)(rng() % kOpCount);
+      if ((op == kOpPrev || op == kOpNext) && set.FindNode(x) == nullptr) {
+        op = kOpFind; // AvlSet 의 Prev/Next 는 x 가 존재해야 함
+      }
+      if (op == kOpInsert && set.FindNode(x) != nullptr) {
+        op = kOpRank;
+      }
+      if (i % 1000 == 7) {
+        input += "Unknown\n"; // 무시되지만 Q 에는 포함
+        continue;
+      }
+      input += kAvlOpNames[op];
+      input += AvlOpHasArg(op) ? " " + to_string(x) + "\n" : "\n";
+      expected += CaptureStdout([&] { PrintReply(set.Execute(op, x)); });
+    }
+  }
+
+  FILE *in = tmpfile();
+  FILE *out = tmpfile();
+  ASSERT_NE(in, nullptr);
+  ASSERT_NE(out, nullptr);
+  fputs(input.c_str(), in);
+  rewind(in);
+
+  RunPipelined<AvlSet>(in, out);
+
+  rewind(out);
+  string actual;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), out)) > 0) {
+    actual.append(buf, n);
+  }
+  fclose(in);
+  fclose(out);
+  EXPECT_EQ(expected, actual);
+}
+
+TEST(PipelineTest, TextReaderParsesLikeCin) {
+  FILE *in = tmpfile();
+  ASSERT_NE(in, nullptr);
+  fputs("  Insert\t-15\n+7 Find abc", in);
+  rewind(in);
+
+  AvlTextReader reader(in);
+  string token;
+  int x = 0;
+  ASSERT_TRUE(reader.NextToken(&token));
+  EXPECT_EQ("Insert", token);
+  ASSERT_TRUE(reader.NextInt(&x));
+  EXPECT_EQ(-15, x);
+  ASSERT_TRUE(reader.NextInt(&x));
+  EXPECT_EQ(7, x);
+  ASSERT_TRUE(reader.NextToken(&token));
+  EXPECT_EQ("Find", token);
+  EXPECT_FALSE(reader.NextInt(&x)); // 정수가 아님
+  fclose(in);
+}
+
+// int 범위 밖의 정수는 cin 처럼 실패하고, 숫자는 모두 소비한다
+TEST(PipelineTest, TextReaderRejectsIntOverflow) {
+  FILE *in = tmpfile();
+  ASSERT_NE(in, nullptr);
+  fputs("2147483647 -2147483648 2147483648 -2147483649 "
+        "99999999999999999999999999 5",
+        in);
+  rewind(in);
+
+  AvlTextReader reader(in);
+  int x = 0;
+  ASSERT_TRUE(reader.NextInt(&x));
+  EXPECT_EQ(INT_MAX, x);
+  ASSERT_TRUE(reader.NextInt(&x));
+  EXPECT_EQ(INT_MIN, x);
+  EXPECT_FALSE(reader.NextInt(&x));
+  EXPECT_FALSE(reader.NextInt(&x));
+  EXPECT_FALSE(reader.NextInt(&x));
+  ASSERT_TRUE(reader.NextInt(&x));
+  EXPECT_EQ(5, x);
+  fclose(in);
+}
+
+// -------------------------핑거 탐색 테스트--------------------------
+// 핑거를 켠 집합과 끈 집합에 같은 명령을 주고 결과를 비교한다
+void ExpectSameWithFinger(const vector<pair<AvlOp, int>> &ops) {
+  AvlSet plain, finger;
+  finger.EnableFinger(true);
+  set<int> keys;
+  for (const auto &op : ops) {
+    bool present = keys.count(op.second) > 0;
+    if ((op.first == kOpInsert && present) ||
+        ((op.first == kOpPrev || op.first == kOpNext) && !present)) {
+      continue; // 입력 조건을 벗어나는 명령은 건너뛴다
+    }
+    if (op.first == kOpInsert) {
+      keys.insert(op.second);
+    } else if (op.first == kOpErase) {
+      keys.erase(op.second);
+    }
+    AvlReply a = plain.Execute(op.first, op.second);
+    AvlReply b = finger.Execute(op.first, op.second);
+    ASSERT_EQ(a.count, b.count) << kAvlOpNames[op.first] << " " << op.second;
+    for (int i = 0; i < a.count; ++i) {
+      ASSERT_EQ(a.v[i], b.v[i]) << kAvlOpNames[op.first] << " " << op.second;
+    }
+  }
+}
+
+TEST(FingerTest, SortedStreamMatchesPlainSet) {
+  vector<pair<AvlOp, int>> ops;
+  for (int i = 0; i < 2000; ++i) {
+    ops.push_back(make_pair(kOpInsert, i * 2));
+    ops.push_back(make_pair(kOpFind, i * 2 - 3));
+    ops.push_back(make_pair(kOpUpperBound, i * 2 - 1));
+    ops.push_back(make_pair(kOpNext, i));
+    ops.push_back(make_pair(kOpPrev, i * 2));
+  }
+  ExpectSameWithFinger(ops);
+}
+
+TEST(FingerTest, LocalRandomStreamMatchesPlainSet) {
+  mt19937 rng(33);
+  const AvlOp kinds[] = {kOpInsert, kOpFind,       kOpPrev, kOpNext,
+                         kOpErase,  kOpUpperBound, kOpRank};
+  vector<pair<AvlOp, int>> ops;
+  int cursor = 5000;
+  for (int i = 0; i < 30000; ++i) {
+    cursor += (int)(rng() % 41) - 20; // 직전 키 근처를 오간다
+    if (rng() % 100 == 0) {
+      cursor = (int)(rng() % 10000); // 가끔 멀리 점프
+    }
+    ops.push_back(make_pair(kinds[rng() % 7], cursor));
+  }
+  ExpectSameWithFinger(ops);
+}
+
+// -------------------------조회 필터 테스트--------------------------
+TEST(LookupFilterTest, MatchesPlainSetUnderChurn) {
+  AvlSet plain, filtered;
+  filtered.EnableLookupFilter(true);
+  set<int> keys;
+  mt19937 rng(34);
+  for (int i = 0; i < 40000; ++i) {
+    int x = (int)(rng() % 3000);
+    int kind = (int)(rng() % 4);
+    AvlOp op = kind == 0 ? kOpFind : kind == 1 ? kOpRank : kOpInsert;
+    if (kind == 3 || (op == kOpInsert && keys.count(x))) {
+      op = kOpErase;
+      keys.erase(x);
+    } else if (op == kOpInsert) {
+      keys.insert(x);
+    }
+    AvlReply a = plain.Execute(op, x);
+    AvlReply b = filtered.Execute(op, x);
+    ASSERT_EQ(a.count, b.count) << kAvlOpNames[op] << " " << x;
+    for (int j = 0; j < a.count; ++j) {
+      ASSERT_EQ(a.v[j], b.v[j]) << kAvlOpNames[op] << " " << x;
+    }
+  }
+  const AvlLookupStats &st = filtered.lookup_stats();
+  EXPECT_GT(st.filter_rejects, 0u);
+  EXPECT_GT(st.cache_hits, 0u);
+}
+
+TEST(LookupFilterTest, CacheIsInvalidatedByRotation) {
+  AvlSet s;
+  s.EnableLookupFilter(true);
+  s.InsertKey(10);
+  s.InsertKey(20);
+  EXPECT_EQ(1, s.FindKey(20).v[0]); // 깊이 1, 높이 1
+  EXPECT_EQ(1, s.FindKey(20).v[0]);
+  EXPECT_EQ(1u, s.lookup_stats().cache_hits);
+
+  s.InsertKey(30); // 좌회전으로 20 이 루트가 된다
+  EXPECT_EQ(0, s.FindKey(20).v[0]);
+  EXPECT_EQ(1u, s.lookup_stats().cache_hits);
+  EXPECT_EQ(-1, s.FindKey(25).v[0]);
+  EXPECT_EQ(-1, s.RankKey(25).v[0]);
+}
+
+// -------------------------메모리 사용량 테스트--------------------------
+TEST(MemoryUsageTest, CountsHeapNodesAndSlabSlack) {
+  AvlSet s;
+  EXPECT_EQ(0u, s.MemoryUsage().reserved_bytes);
+  for (int i = 0; i < 1000; ++i) {
+    s.InsertKey(i);
+  }
+  AvlMemoryUsage heap = s.MemoryUsage();
+  EXPECT_EQ(1000u, heap.keys);
+  EXPECT_EQ(1000 * sizeof(AvlSet::Node), heap.node_bytes);
+  EXPECT_GE(heap.reserved_bytes, heap.node_bytes);
+  EXPECT_EQ(heap.reserved_bytes - heap.node_bytes, heap.slack_bytes);
+  // 키당 크기 회귀 감지: 노드 + 할당자 헤더 한 칸을 넘지 않는다
+  EXPECT_LE(heap.bytes_per_key, sizeof(AvlSet::Node) + 2 * sizeof(size_t));
+
+  // slab 에서 삭제된 노드는 재사용 전까지 slack 으로 남는다
+  const char *path = "memory_usage_test.snap";
+  ASSERT_TRUE(s.Save(path));
+  AvlSet loaded;
+  ASSERT_TRUE(loaded.Load(path));
+  remove(path);
+  EXPECT_EQ(1000 * sizeof(AvlSet::Node), loaded.MemoryUsage().reserved_bytes);
+  for (int i = 0; i < 500; ++i) {
+    loaded.EraseKey(i);
+  }
+  AvlMemoryUsage churned = loaded.MemoryUsage();
+  EXPECT_EQ(500 * sizeof(AvlSet::Node), churned.node_bytes);
+  EXPECT_EQ(500 * sizeof(AvlSet::Node), churned.slack_bytes);
+  EXPECT_DOUBLE_EQ(2.0 * sizeof(AvlSet::Node), churned.bytes_per_key);
+}
+
+TEST(MemoryUsageTest, ReportsLayoutOfEachEngine) {
+  AvlAggSet<AvlSumMonoid> agg;
+  BPlusSet bptree;
+  for (int i = 0; i < 1000; ++i) {
+    agg.InsertKey(i);
+    bptree.Execute(kOpInsert, i);
+  }
+  EXPECT_GT(agg.MemoryUsage().node_bytes, 1000 * sizeof(AvlSet::Node));
+  AvlMemoryUsage bp = bptree.MemoryUsage();
+  EXPECT_EQ(1000u, bp.keys);
+  EXPECT_GE(bp.node_bytes, 1000 * sizeof(int));
+  EXPECT_LT(bp.bytes_per_key, (double)sizeof(AvlSet::Node));
+}
+
+// -------------------------StaticAvlSet 테스트--------------------------
+constexpr int kStaticKeys[] = {50, 20, 80, 10, 30, 70, 90, 20, 60};
+constexpr StaticAvlSet kStaticSet(kStaticKeys);
+
+// 컴파일 시간에 평가된다
+static_assert(kStaticSet.Size() == 8, "중복 키는 하나만 남는다");
+static_assert(kStaticSet.Find(40).v[0] == -1, "없는 키");
+static_assert(kStaticSet.Rank(60).v[1] == 5, "정렬 순서의 위치");
+static_assert(kStaticSet.UpperBound(90).v[0] == -1, "가장 큰 키 다음은 없음");
+
+TEST(StaticAvlSetTest, MatchesAvlSetOfSameShape) {
+  const int kKeys[] = {15, 3, 99, 42, 7, 8, 64, 23, 1, 56, 77, 31, 12};
+  StaticAvlSet<13> fixed(kKeys);
+  vector<int> sorted(begin(kKeys), end(kKeys));
+  sort(sorted.begin(), sorted.end());
+
+  // 구간 중앙값을 레벨 순서로 삽입하면 회전 없이 같은 모양의 AvlSet 이 된다
+  AvlSet s;
+  vector<pair<int, int>> ranges = {make_pair(0, (int)sorted.size())};
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    int lo = ranges[i].first, hi = ranges[i].second;
+    if (lo >= hi) {
+      continue;
+    }
+    int mid = (lo + hi) / 2;
+    s.InsertKey(sorted[mid]);
+    ranges.push_back(make_pair(lo, mid));
+    ranges.push_back(make_pair(mid + 1, hi));
+  }
+
+  for (int x = 0; x <= 100; ++x) {
+    bool present = binary_search(sorted.begin(), sorted.end(), x);
+    for (AvlOp op : {kOpFind, kOpRank, kOpUpperBound, kOpPrev, kOpNext}) {
+      if ((op == kOpPrev || op == kOpNext) && !present) {
+        continue; // AvlSet 의 Prev/Next 는 있는 키만 받는다
+      }
+      AvlReply a = s.Execute(op, x);
+      AvlReply b = fixed.Execute(op, x);
+      ASSERT_EQ(a.count, b.count) << kAvlOpNames[op] << " " << x;
+      for (int i = 0; i < a.count; ++i) {
+        EXPECT_EQ(a.v[i], b.v[i]) << kAvlOpNames[op] << " " << x;
+      }
+    }
+  }
+  EXPECT_EQ(s.n_, fixed.Size());
+}
+
+// -------------------------AvlIntervalSet 테스트--------------------------
+// 시작점 단위의 Insert/Erase 가 AvlSet& 로 불리지 않는다
+static_assert(!is_convertible<AvlIntervalSet *, AvlSet *>::value,
+              "AvlIntervalSet must not convert to AvlSet");
+
+TEST(IntervalSetTest, MatchesLinearScanUnderChurn) {
+  AvlIntervalSet tree;
+  set<pair<int, int>> naive;
+  mt19937 rng(37);
+  for (int i = 0; i < 20000; ++i) {
+    int low = (int)(rng() % 1000), high = low + (int)(rng() % 60);
+    if (rng() % 3 == 0 && !naive.empty()) { // 있는 구간 하나를 삭제
+      auto it = naive.lower_bound(make_pair(low, INT_MIN));
+      if (it == naive.end()) {
+        it = naive.begin();
+      }
+      EXPECT_TRUE(tree.EraseInterval(it->first, it->second));
+      naive.erase(it);
+    } else {
+      EXPECT_EQ(naive.insert(make_pair(low, high)).second,
+                tree.InsertInterval(low, high));
+    }
+  }
+  ASSERT_EQ(naive.size(), tree.IntervalCount());
+
+  vector<pair<int, int>> ranges;
+  for (int i = 0; i < 200; ++i) {
+    int low = (int)(rng() % 1100), high = low + (int)(rng() % 30);
+    ranges.push_back(make_pair(low, high));
+  }
+  vector<vector<pair<int, int>>> batch = tree.OverlapBatch(ranges);
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    vector<pair<int, int>> expected;
+    for (const auto &iv : naive) {
+      if (iv.first <= ranges[i].second && iv.second >= ranges[i].first) {
+        expected.push_back(iv);
+      }
+    }
+    vector<pair<int, int>> actual = tree.Overlap(ranges[i].first,
+                                                 ranges[i].second);
+    sort(actual.begin(), actual.end());
+    sort(batch[i].begin(), batch[i].end());
+    EXPECT_EQ(expected, actual);
+    EXPECT_EQ(expected, batch[i]);
+  }
+}
+
+TEST(IntervalSetTest, StabSharedStartAndRotation) {
+  AvlIntervalSet tree;
+  EXPECT_TRUE(tree.InsertInterval(10, 20));
+  EXPECT_TRUE(tree.InsertInterval(10, 15)); // 같은 시작점
+  EXPECT_FALSE(tree.InsertInterval(10, 20));
+  EXPECT_FALSE(tree.InsertInterval(30, 25)); // low > high
+  EXPECT_TRUE(tree.InsertInterval(30, 100));
+  EXPECT_TRUE(tree.InsertInterval(40, 45)); // 회전이 일어난다
+  EXPECT_EQ(100, tree.MaxHighOf(tree.root_));
+
+  vector<vector<pair<int, int>>> hits = tree.StabBatch({17, 12, 42, 5});
+  EXPECT_EQ((vector<pair<int, int>>{{10, 20}}), hits[0]);
+  EXPECT_EQ((vector<pair<int, int>>{{10, 20}, {10, 15}}), hits[1]);
+  EXPECT_EQ((vector<pair<int, int>>{{30, 100}, {40, 45}}), hits[2]);
+  EXPECT_TRUE(hits[3].empty());
+
+  EXPECT_TRUE(tree.EraseInterval(30, 100)); // 노드가 삭제되며 끝점이 옮겨진다
+  EXPECT_EQ(45, tree.MaxHighOf(tree.root_));
+  EXPECT_EQ((vector<pair<int, int>>{{40, 45}}), tree.Stab(42));
+}
+
+// -------------------------AvlMap 테스트--------------------------
+TEST(AvlMapTest, MatchesAvlSetShapeAndStdMap) {
+  AvlMap<int, string> m;
+  AvlSet s;
+  map<int, string> expected;
+  mt19937 rng(38);
+  for (int i = 0; i < 20000; ++i) {
+    int k = (int)(rng() % 2000);
+    if (rng() % 3 == 0) {
+      bool present = expected.erase(k) > 0;
+      EXPECT_EQ(present, m.Erase(k));
+      EXPECT_EQ(present, s.EraseKey(k) >= 0);
+    } else {
+      bool absent = expected.emplace(k, to_string(i)).second;
+      EXPECT_EQ(absent, m.TryEmplace(k, to_string(i)).second);
+      if (absent) {
+        s.InsertKey(k);
+      }
+    }
+  }
+  ASSERT_EQ((int)expected.size(), m.Size());
+
+  // 같은 명령열이면 트리 모양이 같으므로 깊이*높이와 순위가 일치한다
+  for (int k = -1; k <= 2000; ++k) {
+    auto it = expected.find(k);
+    string *value = m.Find(k);
+    ASSERT_EQ(it != expected.end(), value != nullptr);
+    AvlReply rank = s.RankKey(k);
+    if (value) {
+      EXPECT_EQ(it->second, *value);
+      EXPECT_EQ(rank.v[1], m.Rank(k));
+      EXPECT_EQ(rank.v[0], m.DepthHeight(m.Kth(rank.v[1])));
+    } else {
+      EXPECT_EQ(-1, m.Rank(k));
+    }
+    auto upper = expected.upper_bound(k);
+    auto *node = m.UpperBound(k);
+    ASSERT_EQ(upper != expected.end(), node != nullptr);
+    if (node) {
+      EXPECT_EQ(upper->first, node->key);
+      EXPECT_EQ(s.UpperBoundKey(k).v[1], m.DepthHeight(node));
+    }
+  }
+}
+
+TEST(AvlMapTest, EmplaceInPlaceAndRelinkingErase) {
+  AvlMap<int, unique_ptr<int>> m; // 복사할 수 없는 값
+  for (int k : {50, 30, 70, 20, 40, 60, 80}) {
+    EXPECT_TRUE(m.Emplace(k, new int(k * 10)).second);
+  }
+  EXPECT_FALSE(m.Emplace(50, new int(0)).second); // 새 노드는 버려진다
+  EXPECT_EQ(500, **m.Find(50));
+
+  int constructed = 0;
+  struct Counted {
+    explicit Counted(int *c) { ++*c; }
+  };
+  AvlMap<int, Counted> counted;
+  counted.TryEmplace(1, &constructed);
+  counted.TryEmplace(1, &constructed); // 이미 있으면 값을 만들지 않는다
+  EXPECT_EQ(1, constructed);
+
+  // 자식이 둘인 노드를 지워도 후임자의 값 주소는 그대로다
+  int *successor_value = m.Find(60)->get();
+  unique_ptr<int> *successor_slot = m.Find(60);
+  EXPECT_TRUE(m.Erase(50));
+  EXPECT_EQ(successor_slot, m.Find(60));
+  EXPECT_EQ(successor_value, m.Find(60)->get());
+  EXPECT_EQ(60, m.root_->key);
+  EXPECT_EQ(nullptr, m.Find(50));
+  EXPECT_EQ(40, m.Prev(60)->key);
+  EXPECT_EQ(3, m.Rank(40));
+
+  vector<int> keys;
+  m.ForEach([&](int k, unique_ptr<int> &v) { keys.push_back(k + *v); });
+  EXPECT_EQ((vector<int>{220, 330, 440, 660, 770, 880}), keys);
+}
+
+// -------------------------EraseIf 테스트--------------------------
+// 부분트리의 높이, 크기, 부모 연결과 AVL 균형을 확인하고 높이를 돌려준다
+int CheckAvlSubtree(AvlSet::Node *x, AvlSet::Node *parent) {
+  if (x == nullptr) {
+    return 0;
+  }
+  EXPECT_EQ(parent, x->parent);
+  int lh = CheckAvlSubtree(x->left, x);
+  int rh = CheckAvlSubtree(x->right, x);
+  EXPECT_LE(abs(lh - rh), 1) << "key " << x->key;
+  EXPECT_EQ(1 + max(lh, rh), x->height) << "key " << x->key;
+  int ls = x->left ? x->left->size : 0, rs = x->right ? x->right->size : 0;
+  EXPECT_EQ(1 + ls + rs, x->size) << "key " << x->key;
+  return x->height;
+}
+
+TEST(EraseIfTest, RebuildAndIndividualPathsAgree) {
+  for (double fraction : {0.0, 0.15, 2.0}) { // 항상 재구성 / 기본 / 항상 개별
+    AvlSet s;
+    s.EnableLookupFilter(true);
+    vector<int> keys;
+    for (int i = 0; i < 50000; ++i) {
+      keys.push_back(i * 3);
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(39));
+    for (int key : keys) {
+      s.InsertKey(key);
+    }
+    EXPECT_EQ(0u, s.EraseIf([](int) { return false; }, fraction));
+    EXPECT_EQ(30000u, s.EraseIf([](int k) { return k % 5 < 3; }, fraction));
+    EXPECT_EQ(20000, s.n_);
+    CheckAvlSubtree(s.root_, nullptr);
+    for (int k = 0; k < 150000; k += 7) {
+      bool kept = k % 3 == 0 && k % 5 >= 3;
+      EXPECT_EQ(kept, s.RankKey(k).count == 2) << k;
+    }
+    EXPECT_EQ(4, s.RankKey(24).v[1]); // 3, 9, 18, 24
+  }
+}
+
+TEST(EraseIfTest, KeepsAugmentationAfterRebuild) {
+  AvlAggSet<AvlSumMonoid> sums;
+  long long expected = 0;
+  for (int i = 1; i <= 1000; ++i) {
+    sums.InsertKey(i, 2 * i);
+    expected += (i % 2 == 0) ? 2 * i : 0;
+  }
+  EXPECT_EQ(500u, sums.EraseIf([](int k) { return k % 2 == 1; }, 0.0));
+  EXPECT_EQ(expected, sums.Aggregate(INT_MIN, INT_MAX));
+  sums.InsertKey(1001, 5);
+  EXPECT_EQ(expected + 5, sums.Aggregate(0, 2000));
+}
+
+TEST(EraseIfTest, ParallelFlattenAndBuild) {
+  // 코어 수와 관계없이 threads 를 4 로 주어 공용 풀을 쓰는 경로로 펼치고
+  // 다시 짓는다
+  AvlSet s;
+  const int n = 4 * AvlSet::kParallelGrain;
+  for (int i = 0; i < n; ++i) {
+    s.InsertKey(i);
+  }
+  vector<AvlSet::FlattenTask> tasks;
+  size_t offset = 0;
+  AvlSet::PartitionSubtrees(s.root_, 1000, &offset, &tasks);
+  EXPECT_EQ((size_t)n, offset);
+  vector<AvlSet::Node *> nodes(n);
+  AvlSet::RunParallel(tasks.size(), 4, [&](size_t i) {
+    if (tasks[i].whole) {
+      AvlSet::FlattenSubtree(tasks[i].node, &nodes[tasks[i].offset]);
+    } else {
+      nodes[tasks[i].offset] = tasks[i].node;
+    }
+  });
+  for (int i = 0; i < n; ++i) {
+    ASSERT_EQ(i, nodes[i]->key);
+    nodes[i]->left = nodes[i]->right = nullptr;
+  }
+  s.root_ = s.BuildBalanced(nodes.data(), n, nullptr, 4);
+  CheckAvlSubtree(s.root_, nullptr);
+  EXPECT_EQ(n, s.root_->size);
+}
+
+// -------------------------병렬 순회 테스트--------------------------
+TEST(ParallelTraversalTest, ForEachVisitsEveryKeyOnce) {
+  AvlSet s;
+  const int n = 10000;
+  for (int key : {5, 1, 9}) {
+    s.InsertKey(key - 10); // 음수 키도 섞는다
+  }
+  for (int i = 0; i < n; ++i) {
+    s.InsertKey(i);
+  }
+  AvlWorkPool pool(4);
+  vector<std::atomic<int>> seen(n);
+  std::atomic<int> negatives(0);
+  s.ParallelForEach(
+      [&](int key) {
+        if (key < 0) {
+          negatives++;
+        } else {
+          seen[key]++;
+        }
+      },
+      pool);
+  EXPECT_EQ(3, negatives.load());
+  for (int i = 0; i < n; ++i) {
+    ASSERT_EQ(1, seen[i].load()) << i;
+  }
+}
+
+TEST(ParallelTraversalTest, ReduceKeepsKeyOrder) {
+  AvlSet s;
+  for (int i = 200; i >= 1; --i) {
+    s.InsertKey(i);
+  }
+  AvlWorkPool pool(3);
+  long long sum = s.ParallelReduce(
+      0LL, [](int k) { return (long long)k; },
+      [](long long a, long long b) { return a + b; }, pool);
+  EXPECT_EQ(200LL * 201 / 2, sum);
+
+  // 교환 법칙이 없는 결합: 문자열 이어 붙이기
+  string serial;
+  for (int i = 1; i <= 200; ++i) {
+    serial += to_string(i) + ",";
+  }
+  string joined = s.ParallelReduce(
+      string(), [](int k) { return to_string(k) + ","; },
+      [](const string &a, const string &b) { return a + b; }, pool);
+  EXPECT_EQ(serial, joined);
+
+  AvlSet empty;
+  EXPECT_EQ(7, empty.ParallelReduce(7, [](int k) { return k; },
+                                    [](int a, int b) { return a + b; }));
+}
+
+// -------------------------읽기 구간 병렬 실행 테스트--------------------------
+template <typename Set> void ExpectParallelReadsMatchSerial() {
+  vector<AvlCommand> commands;
+  set<int> keys;
+  mt19937 rng(41);
+  const AvlOp kReads[] = {kOpFind,       kOpRank, kOpSize, kOpEmpty,
+                          kOpUpperBound, kOpPrev, kOpNext};
+  for (int i = 0; i < 30000; ++i) {
+    int x = (int)(rng() % 5000);
+    if (rng() % 50 == 0 || keys.empty()) { // 드문 쓰기 명령
+      bool insert = keys.insert(x).second;
+      if (!insert) {
+        keys.erase(x);
+      }
+      commands.push_back(AvlCommand{insert ? kOpInsert : kOpErase, x});
+      continue;
+    }
+    AvlOp op = kReads[rng() % 7];
+    if (op == kOpPrev || op == kOpNext) {
+      x = *keys.lower_bound(0); // 있는 키만 받는다
+    }
+    commands.push_back(AvlCommand{op, x});
+  }
+
+  Set serial, parallel;
+  vector<AvlReply> expected, actual;
+  for (const AvlCommand &command : commands) {
+    expected.push_back(serial.Execute(command.op, command.x));
+  }
+  AvlWorkPool pool(4);
+  ExecuteCommands(parallel, commands, &actual, 16, pool);
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(expected[i].count, actual[i].count) << i;
+    for (int j = 0; j < expected[i].count; ++j) {
+      ASSERT_EQ(expected[i].v[j], actual[i].v[j]) << i;
+    }
+  }
+}
+
+TEST(ParallelReadsTest, AvlSetMatchesSerial) {
+  ExpectParallelReadsMatchSerial<AvlSet>();
+}
+
+TEST(ParallelReadsTest, BPlusSetMatchesSerial) {
+  ExpectParallelReadsMatchSerial<BPlusSet>();
+}
+
+TEST(ParallelReadsTest, LazySetMatchesSerial) {
+  ExpectParallelReadsMatchSerial<AvlLazySet>();
+}
+
+// -------------------------지연 삭제 테스트--------------------------
+// 죽은 키를 모르는 AvlSet 기능이 AvlSet& 로 불리지 않는다
+static_assert(!is_convertible<AvlLazySet *, AvlSet *>::value,
+              "AvlLazySet must not convert to AvlSet");
+
+TEST(LazySetTest, MatchesStdSetUnderEraseHeavyChurn) {
+  AvlLazySet s;
+  set<int> keys;
+  mt19937 rng(42);
+  for (int i = 0; i < 40000; ++i) {
+    int x = (int)(rng() % 3000);
+    if (rng() % 5 < 2) { // 삽입보다 삭제를 많이 시도한다
+      if (keys.insert(x).second) { // 이미 있는 키는 삽입하지 않는다
+        EXPECT_GE(s.InsertKey(x), 0);
+      }
+    } else {
+      EXPECT_EQ(keys.erase(x) == 1, s.EraseKey(x) >= 0) << x;
+    }
+    ASSERT_EQ((int)keys.size(), s.LiveSize());
+    ASSERT_LE(s.tombstones(), max<size_t>(AvlLazySet::kMinCompact,
+                                          (size_t)(0.25 * s.n_) + 1));
+
+    int y = (int)(rng() % 3000);
+    auto it = keys.find(y);
+    EXPECT_EQ(it != keys.end(), s.FindKey(y).v[0] >= 0) << y;
+    AvlReply rank = s.RankKey(y);
+    if (it != keys.end()) {
+      EXPECT_EQ((int)distance(keys.begin(), it) + 1, rank.v[1]) << y;
+    } else {
+      EXPECT_EQ(-1, rank.v[0]) << y;
+    }
+    auto ub = keys.upper_bound(y);
+    EXPECT_EQ(ub == keys.end() ? -1 : *ub, s.UpperBoundKey(y).v[0]) << y;
+    if (!keys.empty() && i % 16 == 0) { // Prev/Next 는 있는 키만 받는다
+      auto at = keys.lower_bound(y);
+      if (at == keys.end()) {
+        --at;
+      }
+      int before = at == keys.begin() ? -1 : *prev(at);
+      int after = next(at) == keys.end() ? -1 : *next(at);
+      EXPECT_EQ(before, s.PrevKey(*at).v[0]) << *at;
+      EXPECT_EQ(after, s.NextKey(*at).v[0]) << *at;
+    }
+  }
+  CheckAvlSubtree(s.root_, nullptr);
+}
+
+TEST(LazySetTest, CompactsWhenTombstonesExceedRatio) {
+  AvlLazySet s(0.25);
+  for (int i = 0; i < 1000; ++i) {
+    s.InsertKey(i);
+  }
+  for (int i = 0; i < 250; ++i) { // 아직 비율 이하: 표시만 한다
+    s.EraseKey(i * 4);
+  }
+  EXPECT_EQ(1000, s.n_);
+  EXPECT_EQ(250u, s.tombstones());
+  EXPECT_EQ(750, s.LiveSize());
+  EXPECT_EQ(-1, s.EraseKey(0)); // 이미 지운 키
+  EXPECT_EQ(-1, s.FindKey(4).v[0]);
+
+  s.InsertKey(4); // 죽은 노드를 되살린다
+  EXPECT_EQ(249u, s.tombstones());
+  EXPECT_EQ(4, s.RankKey(4).v[1]); // 1, 2, 3, 4
+
+  s.EraseKey(1);
+  s.EraseKey(2); // 251 > 0.25 * 1000: 정리
+  EXPECT_EQ(0u, s.tombstones());
+  EXPECT_EQ(749, s.n_);
+  EXPECT_EQ(749, s.LiveSize());
+  CheckAvlSubtree(s.root_, nullptr);
+  EXPECT_EQ(5, s.UpperBoundKey(4).v[0]);
+  EXPECT_EQ(3, s.PrevKey(4).v[0]);
+}
+
+// -------------------------노드 arena 테스트--------------------------
+TEST(NodeArenaTest, AlignedChunksAndBlockReuse) {
+  AvlArenaOptions options;
+  options.huge_pages = true; // 예약된 huge page 가 없으면 THP 로 대체
+  AvlNodeArena arena(sizeof(AvlSet::Node), options);
+  EXPECT_EQ(sizeof(AvlSet::Node), arena.block_bytes());
+  const size_t per_chunk = AvlNodeArena::kChunkBytes / arena.block_bytes();
+  vector<void *> blocks;
+  for (size_t i = 0; i < per_chunk + 1; ++i) { // 두 번째 청크까지
+    blocks.push_back(arena.Allocate());
+    ASSERT_EQ(0u, (uintptr_t)blocks.back() % alignof(AvlSet::Node));
+  }
+  EXPECT_EQ(per_chunk + 1, arena.live());
+  EXPECT_EQ(2 * AvlNodeArena::kChunkBytes, arena.reserved_bytes());
+  EXPECT_EQ(0u, (uintptr_t)blocks[0] % AvlNodeArena::kChunkBytes);
+  EXPECT_EQ(0u, (uintptr_t)blocks[per_chunk] % AvlNodeArena::kChunkBytes);
+
+  arena.Free(blocks[7]);
+  arena.Free(blocks[3]);
+  EXPECT_EQ(blocks[3], arena.Allocate()); // 마지막에 해제한 블록부터
+  EXPECT_EQ(blocks[7], arena.Allocate());
+  EXPECT_EQ(2 * AvlNodeArena::kChunkBytes, arena.reserved_bytes());
+}
+
+TEST(NodeArenaTest, ArenaSetMatchesPlainSet) {
+  AvlSet plain, arena;
+  AvlArenaOptions options;
+  options.numa_node = 0; // libnuma 가 없으면 무시된다
+  ASSERT_TRUE(arena.EnableArena(options));
+  mt19937 rng(43);
+  for (int i = 0; i < 20000; ++i) {
+    int x = (int)(rng() % 4000);
+    AvlOp op = plain.FindNode(x) ? kOpErase : kOpInsert;
+    ASSERT_EQ(plain.Execute(op, x).v[0], arena.Execute(op, x).v[0]) << i;
+    int y = (int)(rng() % 4000);
+    ASSERT_EQ(plain.RankKey(y).v[1], arena.RankKey(y).v[1]) << y;
+  }
+  EXPECT_FALSE(arena.EnableArena(options)); // 비어 있지 않으면 거부
+  EXPECT_EQ((size_t)arena.n_, arena.arena()->live());
+  AvlMemoryUsage usage = arena.MemoryUsage();
+  EXPECT_EQ(AvlNodeArena::kChunkBytes, usage.reserved_bytes);
+  arena.Clear();
+  EXPECT_EQ(0u, arena.arena()->live());
+}
+
+// -------------------------서버 모드 테스트--------------------------
+TEST(ServerTest, HandleLineParsesCommandsAndUse) {
+  AvlServer server("unused.sock");
+  AvlSet *set = nullptr;
+  string out;
+  server.HandleLine("Use a", 5, &set, &out);
+  const char *const kLines[] = {
+      "Insert 5", "Insert 3\r", "  Find   3 ", "Insert 5", "Prev 4",
+      "Next 3",   "Size 1",     "Find",        "Find 3x",  "Find 99999999999",
+      "",         "Use b",      "Empty",       "Insert -7", "Rank -7"};
+  for (const char *line : kLines) {
+    server.HandleLine(line, strlen(line), &set, &out);
+  }
+  EXPECT_EQ("OK\n0\n1\n1\n0\n-1\n5 0\nERR\nERR\nERR\nERR\nOK\n1\n0\n0 1\n",
+            out);
+  EXPECT_EQ(2u, server.set_count());
+}
+
+TEST(ServerTest, PipelinedBatchOverSocket) {
+  string path = "/tmp/avlset_test." + to_string(getpid()) + ".sock";
+  AvlServer server(path);
+  ASSERT_TRUE(server.Listen());
+  thread loop([&] { server.Run(); });
+
+  string request, expected;
+  AvlSet reference;
+  for (int i = 0; i < 5000; ++i) { // 응답을 기다리지 않고 한 번에 보낸다
+    int x = (i * 7919) % 3000;
+    AvlOp op = (i % 3 == 0) ? kOpFind : reference.FindNode(x) ? kOpErase
+                                                               : kOpInsert;
+    request += string(kAvlOpNames[op]) + " " + to_string(x) + "\n";
+    AppendReply(&expected, reference.Execute(op, x));
+  }
+  request += "Size"; // 줄바꿈 없는 마지막 줄은 입력이 끝날 때 실행
+  AppendReply(&expected, MakeReply(reference.n_));
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path.c_str());
+  ASSERT_EQ(0, connect(fd, (sockaddr *)&addr, sizeof(addr)));
+  ASSERT_EQ((ssize_t)request.size(),
+            send(fd, request.data(), request.size(), MSG_NOSIGNAL));
+  shutdown(fd, SHUT_WR);
+  string reply;
+  char buf[4096];
+  for (ssize_t n; (n = recv(fd, buf, sizeof(buf), 0)) > 0;) {
+    reply.append(buf, n);
+  }
+  close(fd);
+  server.Stop();
+  loop.join();
+  EXPECT_EQ(expected, reply);
+}
+
+// -------------------------이진 명령 형식 테스트--------------------------
+// writer 가 FILE 에 쓴 바이트를 문자열로 돌려준다
+template <typename Fn> string WriteBinary(Fn fn) {
+  FILE *f = tmpfile();
+  {
+    AvlBinaryWriter writer(f);
+    fn(writer);
+  }
+  string bytes(ftell(f), '\0');
+  rewind(f);
+  EXPECT_EQ(bytes.size(), fread(&bytes[0], 1, bytes.size(), f));
+  fclose(f);
+  return bytes;
+}
+
+TEST(BinaryFormatTest, CommandAndResultRoundTrip) {
+  const int kValues[] = {0, 1, -1, 63, -64, 64, 300, -300, INT_MAX, INT_MIN};
+  for (uint8_t flags : {(uint8_t)0, kAvlBinaryFixed32}) {
+    string bytes = WriteBinary([&](AvlBinaryWriter &w) {
+      w.WriteHeader(2, flags);
+      w.WriteCount(10);
+      for (int i = 0; i < 10; ++i) {
+        w.WriteCommand((AvlOp)(i % kOpCount), kValues[i]);
+      }
+      w.WriteCount(0);
+    });
+    istringstream in(bytes);
+    AvlBinaryReader reader(in);
+    int T, Q;
+    ASSERT_TRUE(reader.ReadHeader(&T));
+    EXPECT_EQ(2, T);
+    ASSERT_TRUE(reader.NextCount(&Q));
+    EXPECT_EQ(10, Q);
+    for (int i = 0; i < 10; ++i) {
+      AvlCommand command;
+      ASSERT_TRUE(reader.NextCommand(&command));
+      EXPECT_EQ((AvlOp)(i % kOpCount), command.op);
+      EXPECT_EQ(AvlOpHasArg(command.op) ? kValues[i] : 0, command.x);
+    }
+    ASSERT_TRUE(reader.NextCount(&Q));
+    EXPECT_EQ(0, Q);
+    AvlCommand command;
+    EXPECT_FALSE(reader.NextCommand(&command)); // 입력 끝
+  }
+
+  string results = WriteBinary([&](AvlBinaryWriter &w) {
+    w.WriteResultHeader();
+    w.Write(MakeReply(INT_MIN));
+    w.Write(MakeReply(-1, INT_MAX));
+    w.Write(MakeReply(7, 3));
+  });
+  EXPECT_EQ(8u + 5 + 1 + 5 + 1 + 1, results.size()); // 작은 값은 1바이트
+  istringstream in(results);
+  AvlBinaryReader reader(in);
+  ASSERT_TRUE(reader.ReadResultHeader());
+  AvlReply reply;
+  ASSERT_TRUE(reader.NextReply(&reply));
+  EXPECT_EQ(1, reply.count);
+  EXPECT_EQ(INT_MIN, reply.v[0]);
+  ASSERT_TRUE(reader.NextReply(&reply));
+  EXPECT_EQ(2, reply.count);
+  EXPECT_EQ(-1, reply.v[0]);
+  EXPECT_EQ(INT_MAX, reply.v[1]);
+  ASSERT_TRUE(reader.NextReply(&reply));
+  EXPECT_EQ(3, reply.v[1]);
+  EXPECT_FALSE(reader.NextReply(&reply));
+}
+
+TEST(BinaryFormatTest, RunBinaryCasesMatchesExecute) {
+  vector<vector<AvlCommand>> cases = {
+      {{kOpInsert, 5}, {kOpInsert, -3}, {kOpFind, -3}, {kOpSize, 0},
+       {kOpRank, 5}, {kOpPrev, 5}, {kOpErase, 5}, {kOpEmpty, 0}},
+      {{kOpEmpty, 0}, {kOpInsert, 1}, {kOpUpperBound, 0}}};
+  string bytes = WriteBinary([&](AvlBinaryWriter &w) {
+    w.WriteHeader((int)cases.size(), 0);
+    for (const auto &commands : cases) {
+      w.WriteCount((int)commands.size());
+      for (const AvlCommand &command : commands) {
+        w.WriteCommand(command.op, command.x);
+      }
+    }
+  });
+  string expected = WriteBinary([&](AvlBinaryWriter &w) {
+    w.WriteResultHeader();
+    for (const auto &commands : cases) {
+      AvlSet s;
+      for (const AvlCommand &command : commands) {
+        w.Write(s.Execute(command.op, command.x));
+      }
+    }
+  });
+  string actual = WriteBinary([&](AvlBinaryWriter &w) {
+    w.WriteResultHeader();
+    istringstream in(bytes);
+    EXPECT_TRUE(RunBinaryCases<AvlSet>(in, w));
+  });
+  EXPECT_EQ(expected, actual);
+
+  // 잘린 입력은 그 앞까지만 실행한다
+  string truncated = WriteBinary([&](AvlBinaryWriter &w) {
+    istringstream in(bytes.substr(0, bytes.size() - 2));
+    EXPECT_TRUE(RunBinaryCases<AvlSet>(in, w));
+  });
+  // 결과 헤더와 마지막 응답(값 두 개, 2바이트)이 빠진다
+  EXPECT_EQ(expected.size() - 8 - 2, truncated.size());
+  istringstream text("3\n1\nFind 1\n");
+  string none = WriteBinary([&](AvlBinaryWriter &w) {
+    EXPECT_FALSE(RunBinaryCases<AvlSet>(text, w)); // 텍스트 입력
+  });
+  EXPECT_TRUE(none.empty());
+}
+
+// -------------------------공유 메모리 집합 테스트--------------------------
+TEST(SharedSetTest, MatchesAvlSetAndReopensReadOnly) {
+  string name = "/avlset_test_" + to_string(getpid());
+  AvlSharedSet::Unlink(name.c_str());
+  AvlSharedSet shared;
+  ASSERT_TRUE(shared.Create(name.c_str(), 3000));
+  EXPECT_FALSE(AvlSharedSet().Create(name.c_str(), 10)); // 이미 있음
+  AvlSet plain;
+  mt19937 rng(46);
+  const AvlOp kReads[] = {kOpFind, kOpRank, kOpUpperBound, kOpSize};
+  for (int i = 0; i < 30000; ++i) {
+    int x = (int)(rng() % 3000);
+    AvlOp op = plain.FindNode(x) ? kOpErase : kOpInsert;
+    AvlReply a = plain.Execute(op, x), b = shared.Execute(op, x);
+    ASSERT_EQ(a.v[0], b.v[0]) << i;
+    op = kReads[rng() % 4];
+    if (plain.FindNode(x) && rng() % 2) {
+      op = (rng() % 2) ? kOpPrev : kOpNext; // AvlSet 은 있는 키만 받는다
+    }
+    a = plain.Execute(op, x);
+    b = shared.Execute(op, x);
+    ASSERT_EQ(a.count, b.count) << i;
+    ASSERT_EQ(a.v[0], b.v[0]) << i;
+    ASSERT_EQ(a.v[1], b.v[1]) << i;
+  }
+
+  AvlSharedSet reader; // 다른 프로세스처럼 따로 읽기 전용으로 매핑
+  ASSERT_TRUE(reader.Open(name.c_str(), false));
+  EXPECT_EQ(plain.n_, reader.Size());
+  for (int x = 0; x < 3000; x += 7) {
+    EXPECT_EQ(plain.RankKey(x).v[1], reader.RankKey(x).v[1]) << x;
+  }
+  // 읽기 전용 매핑으로는 바꾸지 않는다 (쓰면 SIGSEGV)
+  uint64_t version = reader.version();
+  int absent = 0, present = 0;
+  while (plain.FindNode(absent)) {
+    absent++;
+  }
+  while (!plain.FindNode(present)) {
+    present++;
+  }
+  EXPECT_EQ(-1, reader.Execute(kOpInsert, absent).v[0]);
+  EXPECT_EQ(-1, reader.Execute(kOpErase, present).v[0]);
+  EXPECT_EQ(-1, reader.FindKey(absent).v[0]);
+  EXPECT_NE(-1, reader.FindKey(present).v[0]);
+  EXPECT_EQ(plain.n_, reader.Size());
+  EXPECT_EQ(version, reader.version());
+  AvlSharedSet::Unlink(name.c_str()); // 매핑은 Close 할 때까지 유효
+  EXPECT_EQ(plain.n_, reader.Size());
+  EXPECT_FALSE(AvlSharedSet().Open(name.c_str(), false));
+}
+
+TEST(SharedSetTest, CapacityLimitAndNodeReuse) {
+  string name = "/avlset_test_cap_" + to_string(getpid());
+  AvlSharedSet::Unlink(name.c_str());
+  AvlSharedSet s;
+  ASSERT_TRUE(s.Create(name.c_str(), 4));
+  AvlSharedSet::Unlink(name.c_str());
+  for (int i = 1; i <= 4; ++i) {
+    s.InsertKey(i);
+  }
+  EXPECT_THROW(s.InsertKey(5), bad_alloc);
+  EXPECT_EQ(4, s.Size());
+  EXPECT_EQ(s.FindKey(2).v[0], s.InsertKey(2)); // 이미 있는 키는 Find 의 값
+  EXPECT_EQ(4, s.Size());
+  uint64_t version = s.version();
+  EXPECT_EQ(-1, s.EraseKey(9));
+  EXPECT_EQ(version, s.version()); // 바뀌지 않으면 버전도 그대로
+  EXPECT_GE(s.EraseKey(3), 0);
+  EXPECT_EQ(version + 2, s.version());
+  EXPECT_GE(s.InsertKey(5), 0); // 반환된 노드를 다시 쓴다
+  EXPECT_EQ(5, s.UpperBoundKey(4).v[0]);
+  EXPECT_EQ(2, s.PrevKey(3).v[0]);
+}
+
+TEST(SharedSetTest, ReaderProcessSeesConsistentTree) {
+  string name = "/avlset_test_fork_" + to_string(getpid());
+  AvlSharedSet::Unlink(name.c_str());
+  AvlSharedSet writer;
+  const int n = 20000;
+  ASSERT_TRUE(writer.Create(name.c_str(), n));
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) { // 읽기 프로세스: 짝수 키만 있어야 한다
+    AvlSharedSet reader;
+    if (!reader.Open(name.c_str(), false)) {
+      _exit(2);
+    }
+    mt19937 rng(7);
+    while (reader.Size() < n / 2) {
+      int x = (int)(rng() % n);
+      AvlReply next = reader.UpperBoundKey(x);
+      if (next.v[0] != -1 && (next.v[0] <= x || next.v[0] % 2 != 0)) {
+        _exit(3);
+      }
+      if (x % 2 == 1 && reader.FindKey(x).v[0] != -1) {
+        _exit(4);
+      }
+    }
+    for (int x = 0; x < n; ++x) {
+      if ((reader.RankKey(x).v[0] >= 0) != (x % 2 == 0)) {
+        _exit(5);
+      }
+    }
+    _exit(0);
+  }
+  vector<int> keys;
+  for (int x = 0; x < n; x += 2) {
+    keys.push_back(x);
+  }
+  shuffle(keys.begin(), keys.end(), mt19937(47));
+  for (int x : keys) {
+    writer.InsertKey(x);
+    if (x % 3 == 0) { // 지웠다가 다시 넣어 회전과 노드 재사용을 섞는다
+      writer.EraseKey(x);
+      writer.InsertKey(x);
+    }
+  }
+  int status = 0;
+  waitpid(child, &status, 0);
+  AvlSharedSet::Unlink(name.c_str());
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+TEST(SharedSetTest, WriterDeathMidChangePoisonsSegment) {
+  string name = "/avlset_test_dead_" + to_string(getpid());
+  AvlSharedSet::Unlink(name.c_str());
+  AvlSharedSet writer;
+  ASSERT_TRUE(writer.Create(name.c_str(), 100));
+  writer.InsertKey(1);
+
+  // 뮤텍스를 잡았지만 바꾸지 않고 죽으면 그대로 쓸 수 있다
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    AvlSharedSet w;
+    if (w.Open(name.c_str(), true)) {
+      w.LockWriter();
+    }
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(child, &status, 0);
+  writer.InsertKey(2);
+  EXPECT_NE(-1, writer.FindKey(2).v[0]);
+  EXPECT_FALSE(writer.poisoned());
+
+  // 바꾸던 도중에 죽으면 읽기는 멈추지 않고 실패하고, 쓰기는 오염을 표시한다
+  child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    AvlSharedSet w;
+    if (w.Open(name.c_str(), true)) {
+      w.LockWriter();
+      w.BeginChange();
+    }
+    _exit(0);
+  }
+  waitpid(child, &status, 0); // 좀비가 남지 않아야 죽었다고 판단할 수 있다
+  AvlSharedSet reader;
+  ASSERT_TRUE(reader.Open(name.c_str(), false));
+  EXPECT_THROW(reader.FindKey(1), runtime_error);
+  EXPECT_THROW(writer.InsertKey(3), runtime_error);
+  EXPECT_TRUE(writer.poisoned());
+  EXPECT_THROW(writer.EraseKey(1), runtime_error);
+  EXPECT_THROW(reader.Size(), runtime_error);
+  AvlSharedSet::Unlink(name.c_str());
+}
+
+// -------------------------명령별 지연 시간 테스트--------------------------
+TEST(LatencyHistogramTest, PercentilesWithinBucketError) {
+  AvlLatencyHistogram small; // 64 미만은 값 그대로 센다
+  for (uint64_t v = 1; v <= 10; ++v) {
+    small.Record(v);
+  }
+  EXPECT_EQ(5u, small.Percentile(0.5));
+  EXPECT_EQ(10u, small.Percentile(1.0));
+  EXPECT_DOUBLE_EQ(5.5, small.mean());
+
+  AvlLatencyHistogram h;
+  for (uint64_t v = 1; v <= 100000; ++v) {
+    h.Record(v);
+  }
+  h.Record(1ull << 40); // 드문 꼬리 값
+  h.Merge(small);
+  EXPECT_EQ(100011u, h.count());
+  EXPECT_EQ(1ull << 40, h.max_value());
+  EXPECT_EQ(1ull << 40, h.Percentile(1.0));
+  for (double p : {0.5, 0.9, 0.99, 0.999}) {
+    double exact = p * 100011;
+    double got = (double)h.Percentile(p);
+    EXPECT_GE(got, exact - 11) << p; // 칸의 상한은 참값 이상
+    EXPECT_LE(got, exact * (1 + 1.0 / 32)) << p;
+  }
+  EXPECT_EQ(0u, AvlLatencyHistogram().Percentile(0.99));
+}
+
+TEST(LatencyHistogramTest, TimedSetRecordsEachCommand) {
+  AvlLatencyRecorder recorder;
+  AvlTimedSet<AvlSet>::recorder = &recorder;
+  AvlTimedSet<AvlSet> timed;
+  AvlSet plain;
+  vector<AvlCommand> commands = {{kOpInsert, 5}, {kOpInsert, 3},
+                                 {kOpInsert, 9}, {kOpFind, 3},
+                                 {kOpPrev, 9},   {kOpErase, 5},
+                                 {kOpRank, 9},   {kOpSize, 0}};
+  for (const AvlCommand &c : commands) {
+    AvlReply a = timed.Execute(c.op, c.x);
+    AvlReply b = plain.Execute(c.op, c.x);
+    EXPECT_EQ(b.count, a.count);
+    EXPECT_EQ(b.v[0], a.v[0]);
+    EXPECT_EQ(b.v[1], a.v[1]);
+  }
+  EXPECT_EQ(3u, recorder.histogram(kOpInsert).count());
+  EXPECT_EQ(1u, recorder.histogram(kOpErase).count());
+  EXPECT_EQ(0u, recorder.histogram(kOpNext).count());
+
+  FILE *f = tmpfile();
+  recorder.WriteJson(f);
+  string json(ftell(f), '\0');
+  rewind(f);
+  EXPECT_EQ(json.size(), fread(&json[0], 1, json.size(), f));
+  fclose(f);
+  EXPECT_NE(string::npos, json.find("\"unit\": \"ns\""));
+  EXPECT_NE(string::npos, json.find("\"Insert\": {\"count\": 3,"));
+  EXPECT_NE(string::npos, json.find("\"p999\": "));
+  EXPECT_EQ(string::npos, json.find("\"Next\"")); // 기록 없는 명령은 생략
+  AvlTimedSet<AvlSet>::recorder = nullptr;
+}
+
+// -------------------------재연결 삭제 테스트--------------------------
+TEST(RelinkingEraseTest, RemainingNodesKeepTheirAddresses) {
+  AvlSet s;
+  s.EnableLookupFilter(true);
+  vector<int> keys;
+  for (int i = 0; i < 2000; ++i) {
+    keys.push_back(i * 2);
+  }
+  shuffle(keys.begin(), keys.end(), mt19937(48));
+  map<int, AvlSet::Node *> nodes;
+  for (int key : keys) {
+    s.InsertKey(key);
+  }
+  for (int key : keys) {
+    nodes[key] = s.FindNode(key);
+  }
+  int two_children = 0;
+  for (int i = 0; i < 1000; ++i) {
+    AvlSet::Node *node = nodes[keys[i]];
+    two_children += node->left != nullptr && node->right != nullptr;
+    s.FindKey(keys[i]); // 조회 캐시에 올려 둔다
+    EXPECT_NE(-1, s.EraseKey(keys[i]));
+    nodes.erase(keys[i]);
+  }
+  EXPECT_GT(two_children, 100);
+  CheckAvlSubtree(s.root_, nullptr);
+  for (const auto &entry : nodes) {
+    ASSERT_EQ(entry.second, s.FindNode(entry.first));
+    EXPECT_EQ(entry.first, entry.second->key);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(-1, s.FindKey(keys[i]).v[0]);
+  }
+
+  // 부가 값이 있는 노드도 후임자가 제 값을 그대로 가지고 옮겨간다
+  AvlAggSet<AvlSumMonoid> sums;
+  for (int k : {50, 30, 70, 20, 40, 60, 80}) {
+    sums.InsertKey(k, k + 1);
+  }
+  sums.EraseKey(50);
+  EXPECT_EQ(60, sums.root_->key);
+  EXPECT_EQ(21 + 31 + 41 + 61 + 71 + 81, sums.Aggregate(INT_MIN, INT_MAX));
+  EXPECT_EQ(61 + 71, sums.Aggregate(51, 75));
+}
+
+// -------------------------구간 삭제 테스트--------------------------
+// 같은 명령을 받은 두 집합은 모양이 같으므로 응답 전체가 같아야 한다
+void ExpectSameReply(const AvlReply &a, const AvlReply &b, int x) {
+  ASSERT_EQ(a.count, b.count) << x;
+  for (int i = 0; i < a.count; ++i) {
+    ASSERT_EQ(a.v[i], b.v[i]) << x;
+  }
+}
+
+TEST(RangeEraseTest, MatchesStdSetAndKeepsBalance) {
+  // 조회 필터와 핑거를 켠 집합과 끈 집합에 같은 명령을 준다. 캐시나 핑거에
+  // 남은 깊이가 잘리고 이어진 트리에서 그대로 쓰이면 깊이*높이가 어긋난다
+  AvlSet s, plain;
+  s.EnableLookupFilter(true);
+  s.EnableFinger(true);
+  set<int> expected;
+  mt19937 rng(49);
+  for (int i = 0; i < 20000; ++i) {
+    int key = (int)(rng() % 100000);
+    if (expected.insert(key).second) { // InsertKey 는 없는 키만 받는다
+      s.InsertKey(key);
+      plain.InsertKey(key);
+    }
+  }
+  for (int round = 0; round < 200; ++round) {
+    int lo = (int)(rng() % 100000);
+    int hi = lo + (int)(rng() % 2000) - 100; // 가끔 lo > hi
+    if (round % 3 == 0) { // 키가 없는 틈: 아무것도 지우지 않는다
+      while (expected.count(lo) != 0) {
+        lo++;
+      }
+      hi = lo;
+    }
+    for (int j = 0; j < 8; ++j) { // 캐시와 핑거를 채운다
+      int k = (int)(rng() % 100000);
+      s.FindKey(k);
+      s.RankKey(k);
+    }
+    auto first = expected.lower_bound(lo);
+    auto last = lo <= hi ? expected.upper_bound(hi) : first;
+    vector<int> removed(first, last);
+    expected.erase(first, last);
+    if (round % 2 == 0) {
+      EXPECT_EQ(removed.size(), s.EraseRange(lo, hi));
+      plain.EraseRange(lo, hi);
+    } else {
+      unique_ptr<AvlSet> out = s.ExtractRange(lo, hi);
+      plain.ExtractRange(lo, hi);
+      EXPECT_EQ((int)removed.size(), out->n_);
+      CheckAvlSubtree(out->root_, nullptr);
+      vector<AvlSet::Node *> nodes(out->n_);
+      AvlSet::FlattenSubtree(out->root_, nodes.data());
+      vector<int> keys;
+      for (AvlSet::Node *node : nodes) {
+        keys.push_back(node->key);
+      }
+      EXPECT_EQ(removed, keys);
+    }
+    ASSERT_EQ((int)expected.size(), s.n_);
+    for (int j = 0; j < 32; ++j) { // 절반은 있는 키
+      int k = (int)(rng() % 100000);
+      if (j % 2 == 0 && !expected.empty()) {
+        auto it = expected.lower_bound(k);
+        k = it == expected.end() ? *expected.begin() : *it;
+      }
+      ExpectSameReply(plain.FindKey(k), s.FindKey(k), k);
+      ExpectSameReply(plain.RankKey(k), s.RankKey(k), k);
+    }
+  }
+  CheckAvlSubtree(s.root_, nullptr);
+  int rank = 0;
+  for (int key : expected) {
+    ASSERT_EQ(++rank, s.RankKey(key).v[1]);
+  }
+  EXPECT_EQ(expected.size(), s.EraseRange(INT_MIN, INT_MAX));
+  EXPECT_EQ(nullptr, s.root_);
+  EXPECT_EQ(0u, s.EraseRange(0, 10)); // 빈 집합
+}
+
+TEST(RangeEraseTest, KeepsAugmentationAndCopiesArenaNodes) {
+  AvlAggSet<AvlSumMonoid> sums;
+  for (int i = 1; i <= 1000; ++i) {
+    sums.InsertKey(i, i);
+  }
+  EXPECT_EQ(500u, sums.EraseRange(251, 750));
+  CheckAvlSubtree(sums.root_, nullptr);
+  EXPECT_EQ(250LL * 251 / 2, sums.Aggregate(INT_MIN, 500));
+  EXPECT_EQ(500500LL - (750LL * 751 - 250LL * 251) / 2,
+            sums.Aggregate(INT_MIN, INT_MAX));
+
+  AvlSet s;
+  AvlArenaOptions options;
+  options.huge_pages = false;
+  ASSERT_TRUE(s.EnableArena(options));
+  for (int i = 0; i < 100; ++i) {
+    s.InsertKey(i);
+  }
+  unique_ptr<AvlSet> out = s.ExtractRange(10, 19);
+  EXPECT_EQ(90u, s.arena()->live()); // 떼어낸 노드는 arena 에 반환된다
+  EXPECT_EQ(nullptr, out->arena());
+  EXPECT_EQ(10, out->n_);
+  EXPECT_EQ(10, out->RankKey(19).v[1]);
+  EXPECT_EQ(-1, s.FindKey(15).v[0]);
+  EXPECT_EQ(11, s.RankKey(20).v[1]);
+}
+
+// -------------------------우선순위 큐 테스트--------------------------
+TEST(PriorityQueueTest, MinMaxFollowEveryUpdate) {
+  AvlSet s;
+  set<int> expected;
+  int x = 0;
+  EXPECT_FALSE(s.Min(&x));
+  EXPECT_FALSE(s.PopMax(&x));
+  mt19937 rng(50);
+  for (int i = 0; i < 20000; ++i) {
+    int key = (int)(rng() % 5000);
+    switch (rng() % 6) {
+    case 0:
+    case 1:
+      if (expected.insert(key).second) {
+        s.InsertKey(key);
+      }
+      break;
+    case 2:
+      s.EraseKey(key);
+      expected.erase(key);
+      break;
+    case 3:
+      ASSERT_EQ(!expected.empty(), s.PopMin(&x));
+      if (!expected.empty()) {
+        EXPECT_EQ(*expected.begin(), x);
+        expected.erase(expected.begin());
+      }
+      break;
+    case 4:
+      ASSERT_EQ(!expected.empty(), s.PopMax(&x));
+      if (!expected.empty()) {
+        EXPECT_EQ(*expected.rbegin(), x);
+        expected.erase(prev(expected.end()));
+      }
+      break;
+    default: // 트리를 통째로 바꾸는 작업
+      if (i % 2 == 0) {
+        s.EraseRange(key, key + 50);
+        expected.erase(expected.lower_bound(key),
+                       expected.upper_bound(key + 50));
+      } else {
+        s.EraseIf([&](int k) { return k % 97 == key % 97; }, 0.0);
+        for (auto it = expected.begin(); it != expected.end();) {
+          it = (*it % 97 == key % 97) ? expected.erase(it) : next(it);
+        }
+      }
+    }
+    ASSERT_EQ((int)expected.size(), s.n_);
+    if (expected.empty()) {
+      EXPECT_FALSE(s.Max(&x));
+      continue;
+    }
+    ASSERT_TRUE(s.Min(&x));
+    ASSERT_EQ(*expected.begin(), x) << i;
+    ASSERT_TRUE(s.Max(&x));
+    ASSERT_EQ(*expected.rbegin(), x) << i;
+  }
+  CheckAvlSubtree(s.root_, nullptr);
+
+  const char *path = "avlset_pq_test.bin"; // 복원한 트리도 양 끝을 안다
+  ASSERT_TRUE(s.Save(path));
+  AvlSet loaded;
+  ASSERT_TRUE(loaded.Load(path));
+  remove(path);
+  ASSERT_TRUE(loaded.PopMin(&x));
+  EXPECT_EQ(*expected.begin(), x);
+  ASSERT_TRUE(loaded.Max(&x));
+  EXPECT_EQ(*expected.rbegin(), x);
+  s.Clear();
+  EXPECT_FALSE(s.Min(&x));
+}
@@ -0,0 +1,116 @@
+// MIT License
+// Copyright (c) 2025 blackcow9622
+// Licensed under the MIT License. See LICENSE file in the project root for
+// details.
+//
+// 텍스트 작업 파일과 이진 명령/결과 스트림 사이의 변환기
+// 사용법: avlset_convert to-binary [--fixed32] < 입력.txt > 입력.bin
+//         avlset_convert to-text < 입력.bin > 입력.txt
+//         avlset_convert results-to-text < 결과.bin > 결과.txt
+// to-binary 는 avlset_app 과 같이 알 수 없는 명령은 건너뛰고, 정수 인자가
+// 없으면 그 자리에서 멈춘다. 따라서 변환한 입력의 결과는 원래 입력과 같다
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../src/AVLSet.cpp"
+
+namespace {
+
+int TextToBinary(bool fixed32) {
+  AvlTextReader reader(stdin);
+  AvlBinaryWriter writer(stdout);
+  int T = 0;
+  reader.NextInt(&T);
+  writer.WriteHeader(T, fixed32 ? kAvlBinaryFixed32 : 0);
+  std::vector<AvlCommand> commands; // Q 는 실제로 남는 명령 수로 쓴다
+  std::string token;
+  bool ok = true;
+  while (ok && T-- > 0) {
+    int Q = 0;
+    if (!reader.NextInt(&Q)) {
+      break;
+    }
+    commands.clear();
+    while (Q-- > 0) {
+      AvlOp op;
+      int x = 0;
+      if (!reader.NextToken(&token)) {
+        ok = false;
+        break;
+      }
+      if (!ParseAvlOp(token, &op)) {
+        continue;
+      }
+      if (AvlOpHasArg(op) && !reader.NextInt(&x)) {
+        ok = false;
+        break;
+      }
+      commands.push_back(AvlCommand{op, x});
+    }
+    writer.WriteCount((int)commands.size());
+    for (const AvlCommand &command : commands) {
+      writer.WriteCommand(command.op, command.x);
+    }
+  }
+  return 0;
+}
+
+int BinaryToText() {
+  AvlBinaryReader reader(std::cin);
+  int T;
+  if (!reader.ReadHeader(&T)) {
+    fprintf(stderr, "invalid binary command stream header\n");
+    return 1;
+  }
+  printf("%d\n", T);
+  int Q;
+  while (T-- > 0 && reader.NextCount(&Q)) {
+    printf("%d\n", Q);
+    AvlCommand command;
+    while (Q-- > 0 && reader.NextCommand(&command)) {
+      if (AvlOpHasArg(command.op)) {
+        printf("%s %d\n", kAvlOpNames[command.op], command.x);
+      } else {
+        printf("%s\n", kAvlOpNames[command.op]);
+      }
+    }
+  }
+  return 0;
+}
+
+int ResultsToText() {
+  AvlBinaryReader reader(std::cin);
+  if (!reader.ReadResultHeader()) {
+    fprintf(stderr, "invalid binary result stream header\n");
+    return 1;
+  }
+  AvlTextWriter writer(stdout);
+  AvlReply reply;
+  while (reader.NextReply(&reply)) {
+    writer.Write(reply);
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string mode = argc > 1 ? argv[1] : "";
+  bool fixed32 = argc > 2 && strcmp(argv[2], "--fixed32") == 0;
+  if (mode == "to-binary" && argc <= 3 && (argc == 2 || fixed32)) {
+    return TextToBinary(fixed32);
+  }
+  if (mode == "to-text" && argc == 2) {
+    return BinaryToText();
+  }
+  if (mode == "results-to-text" && argc == 2) {
+    return ResultsToText();
+  }
+  fprintf(stderr,
+          "usage: avlset_convert to-binary [--fixed32] | to-text | "
+          "results-to-text  (stdin -> stdout)\n");
+  return 1;
+}